@@ -11,6 +11,12 @@ namespace Marble
 
 
 
+SparseTileImage
+AbstractTileLoader::loadSparseTileImage( GeoSceneTextureTileDataset const *textureData, TileId const & tileId, DownloadUsage const usage )
+{
+    return SparseTileImage( loadTileImage( textureData, tileId, usage ) );
+}
+
 int
 AbstractTileLoader::maximumTileLevel(const GeoSceneTileDataset &tileData)
 {
@@ -5,6 +5,7 @@
 #include <QString>
 #include <QImage>
 
+#include "SparseTileImage.h"
 #include "TileId.h"
 #include "geodata/data/GeoDataContainer.h"
 #include "PluginManager.h"
@@ -42,6 +43,14 @@ class AbstractTileLoader: public QObject
     QImage
     loadTileImage( GeoSceneTextureTileDataset const *textureData, TileId const & tileId, DownloadUsage const ) = 0;
 
+    /**
+     * Returns the tile image without expanding it if the loader keeps it
+     * sparse. The default implementation wraps loadTileImage().
+     */
+    virtual
+    SparseTileImage
+    loadSparseTileImage( GeoSceneTextureTileDataset const *textureData, TileId const & tileId, DownloadUsage const );
+
     virtual
     void
     createTile( GeoSceneTileDataset const *tileData, TileId const &, DownloadUsage ) = 0;
@@ -10,6 +10,7 @@
 //
 
 #include "GeoGraphicsScene.h"
+#include "GeoGraphicsSceneIndex.h"
 
 #include "geodata/data/GeoDataFeature.h"
 #include "geodata/data/GeoDataLatLonBox.h"
@@ -32,6 +33,7 @@
 #include "geodata/data/GeoDataMultiLineString.h"
 #include "geodata/data/GeoDataScreenOverlay.h"
 #include "geodata/data/GeoDataGroundOverlay.h"
+#include "geodata/scene/GeoSceneTextureTileDataset.h"
 
 #include "geodata/graphicsitem/GeoMultiLineStringGraphicsItem.h"
 #include "geodata/graphicsitem/GeoMultiPolygonGraphicsItem.h"
@@ -41,14 +43,19 @@
 #include "geodata/graphicsitem/GeoGroundGraphicsItem.h"
 #include "geodata/graphicsitem/GeoMultiGraphicsItem.h"
 #include "geodata/graphicsitem/GeoMultiPointGraphicsItem.h"
+#include "geodata/graphicsitem/TileCoverageValidation.h"
 
 #include "graphicsview/GeoGraphicsItem.h"
 #include "TileId.h"
 #include "TileCoordsPyramid.h"
+#include "TileCoverageCache.h"
 #include "MarbleDebug.h"
+#include "MarbleDirs.h"
 #include <QtCore/QMap>
+#include <QtCore/QMutex>
 #include <QtCore/QtMath>
 #include <QtCore/QElapsedTimer>
+#include <QtConcurrent/QtConcurrentMap>
 #include <QtConcurrent/QtConcurrentRun>
 
 namespace Marble
@@ -57,14 +64,81 @@ namespace Marble
 
 
 
+// The item coverage is tracked down to this level for 2048px tiles. Smaller
+// tiles go deeper so that the covered area per level stays the same.
 const int MaxItemTileZoomLevel = 11;
+const int ReferenceTileSize = 2048;
+
+int
+maxItemTileZoomLevel(const GeoSceneTileDataset *tileDataset)
+{
+    int level = MaxItemTileZoomLevel;
+
+    if(tileDataset)
+    {
+        for(int size = tileDataset->tileSize().width(); size > 0 && size < ReferenceTileSize; size *= 2)
+        {
+            ++level;
+        }
+    }
+
+    return level;
+}
+
+QMap<int /* z level */, QVector<TileCoverage> >
+removedTiles(const QVector<GeoGraphicsSceneIndex::Entry> &entries)
+{
+    QMap<int, QVector<TileCoverage> > result;
+    foreach(const GeoGraphicsSceneIndex::Entry &entry, entries)
+    {
+        result[entry.zLevel].append(entry.tiles);
+    }
+
+    return result;
+}
+
+LayeredTileCoverage
+uniteLayers(const QMap<int /* z level */, QVector<TileCoverage> > &zLevelTiles)
+{
+    LayeredTileCoverage result;
+
+    auto it = zLevelTiles.constBegin();
+    auto itEnd = zLevelTiles.constEnd();
+    for(; it != itEnd; ++it)
+    {
+        result[it.key()].unite(it.value());
+    }
+
+    return result;
+}
+
+/**
+ * The state of the scene as seen by queries. All members are implicitly
+ * shared, so a snapshot is copied in constant time and stays consistent
+ * while the scene goes on changing.
+ */
+class GeoGraphicsSceneSnapshot
+{
+public:
+    GeoGraphicsSceneSnapshot()
+        :   m_version(0)
+    {
+    }
+
+    GeoGraphicsSceneIndex m_index;
+    QSet<GeoGraphicsItemPtr> m_selectedItems;
+    QSet<GeoGraphicsItemPtr> m_highlightedItems;
+    quint64 m_version;
+};
+
 class GeoGraphicsScenePrivate
 {
 public:
     GeoGraphicsScene *q;
     GeoGraphicsScenePrivate(GeoGraphicsScene *parent) :
         q(parent),
-        m_tileDataset(nullptr)
+        m_tileDataset(nullptr),
+        m_coverageCache(MarbleDirs::localPath() + QStringLiteral("/cache/coverage"))
     {
         initializeDefaultValues();
     }
@@ -74,10 +148,40 @@ public:
         q->clear();
     }
 
-    QMap<double /* z level */, QMap<double, QMap<double, QMap<double, QMap<double, QHash<GeoGraphicsItemPtr, TileMap> > > > > > m_items;
+    GeoGraphicsSceneSnapshot
+    snapshot() const
+    {
+        QMutexLocker locker(&m_snapshotMutex);
+        return m_snapshot;
+    }
+
+    /// Makes the current state visible to queries, called on the scene's thread after each change.
+    void
+    publish()
+    {
+        GeoGraphicsSceneSnapshot snapshot;
+        snapshot.m_index = m_index;
+        snapshot.m_selectedItems = m_selectedItems;
+        snapshot.m_highlightedItems = m_highlightedItems;
+
+        {
+            QMutexLocker locker(&m_snapshotMutex);
+            snapshot.m_version = m_snapshot.m_version + 1;
+            qSwap(m_snapshot, snapshot);
+        }
+
+        // The previous snapshot is released outside the lock, it may hold the last reference to removed items.
+    }
+
+    GeoGraphicsSceneIndex m_index;
     QMap<const GeoDataFeature *, QList<GeoGraphicsItemPtr> > m_features_graphics_items;
 
+    // the pending batch of every feature still being added
     QHash<const GeoDataFeature *, AddItem*> jobs;
+    QSet<AddItem*> m_addItems;
+
+    // tiles of removed items to expire along with those of a replacing batch
+    QHash<AddItem*, QMap<int /* z level */, QVector<TileCoverage> > > m_replacedTiles;
 
     // Stores the items which have been clicked;
     QSet<GeoGraphicsItemPtr> m_selectedItems;
@@ -85,6 +189,13 @@ public:
 
     GeoSceneTextureTileDataset *m_tileDataset;
 
+    // the coverage and bounds of items of documents loaded before
+    TileCoverageCache m_coverageCache;
+
+    // what other threads query, replaced as a whole by publish()
+    mutable QMutex m_snapshotMutex;
+    GeoGraphicsSceneSnapshot m_snapshot;
+
     static void initializeDefaultValues();
 
     static int s_defaultZValues[GeoDataFeature::LastIndex];
@@ -106,7 +217,7 @@ const int GeoGraphicsScenePrivate::s_defaultZValue = 0;
 class AddItemJob
 {
 public:
-    AddItemJob(GeoSceneTextureTileDataset *tileDataset, const GeoDataFeature *feature);
+    AddItemJob(GeoSceneTextureTileDataset *tileDataset, const TileCoverageCache *coverageCache, const GeoDataFeature *feature);
 
     ~AddItemJob();
 
@@ -131,12 +242,38 @@ public:
         return aItem;
     }
 
-    const TileMap &
+    const TileCoverage &
     tiles() const
     {
         return aTiles;
     }
 
+    const GeoDataLatLonBox &
+    box() const
+    {
+        return aBox;
+    }
+
+    /// Returns the cache key of the feature, empty if it is not cached.
+    const QByteArray &
+    key() const
+    {
+        return aKey;
+    }
+
+    const QString &
+    documentFileName() const
+    {
+        return aDocumentFileName;
+    }
+
+    /// Returns whether the coverage and bounds were taken from the cache.
+    bool
+    isCached() const
+    {
+        return aCached;
+    }
+
     const GeoDataFeature *
     object() const
     {
@@ -150,16 +287,24 @@ private:
     const GeoDataFeature *aFeature;
 
     GeoGraphicsItemPtr aItem;
-    TileMap aTiles;
+    TileCoverage aTiles;
+    GeoDataLatLonBox aBox;
+
+    QString aDocumentFileName;
+    QByteArray aKey;
+    bool aCached;
 
     GeoSceneTextureTileDataset *aTileDataset;
+    const TileCoverageCache *aCoverageCache;
 };
 
 
-AddItemJob::AddItemJob(GeoSceneTextureTileDataset *tileDataset, const GeoDataFeature *feature)
+AddItemJob::AddItemJob(GeoSceneTextureTileDataset *tileDataset, const TileCoverageCache *coverageCache, const GeoDataFeature *feature)
     :   aCancel(false),
         aFeature(feature),
-        aTileDataset(tileDataset)
+        aCached(false),
+        aTileDataset(tileDataset),
+        aCoverageCache(coverageCache)
 {}
 
 AddItemJob::~AddItemJob()
@@ -241,18 +386,39 @@ void AddItemJob::run()
         return;
     }
 
+    if(aCoverageCache)
+    {
+        aDocumentFileName = TileCoverageCache::documentFileName(aFeature);
+        if(!aDocumentFileName.isEmpty())
+        {
+            aKey = TileCoverageCache::contentKey(aFeature);
+        }
+
+        if(!aKey.isEmpty() && aCoverageCache->find(aDocumentFileName, aKey, aTiles, aBox))
+        {
+            // no tiles are computed, line fragments are clipped on the first tile rendered instead
+            tempItem->setTileLayout(aTileDataset, maxItemTileZoomLevel(aTileDataset));
+
+            aCached = true;
+            aItem = tempItem;
+            return;
+        }
+    }
+
     const TileId tileId = TileId(0, 0, 0,0 );
 
     QTime timer;
     timer.start();
 
-    tempItem->getTiles(aTileDataset, tileId, MaxItemTileZoomLevel, aTiles, aCancel);
+    tempItem->getTiles(aTileDataset, tileId, maxItemTileZoomLevel(aTileDataset), aTiles, aCancel);
 
     if(isCancelled())
     {
         return;
     }
 
+    // The bounds of large geometries take a while as well, so they are computed here rather than when indexing.
+    aBox = tempItem->latLonAltBox();
     aItem = tempItem;
 
 
@@ -431,7 +597,6 @@ GeoGraphicsScene::GeoGraphicsScene( QObject* parent ):
     QObject( parent ),
     d( new GeoGraphicsScenePrivate(this) )
 {
-    connect(this, SIGNAL(startAddItem(const GeoDataFeature *)), SLOT(doAddItem(const GeoDataFeature *)), Qt::QueuedConnection);
 }
 
 GeoGraphicsScene::~GeoGraphicsScene()
@@ -442,6 +607,8 @@ GeoGraphicsScene::~GeoGraphicsScene()
 QList< GeoGraphicsItemPtr >
 GeoGraphicsScene::items( const GeoDataLatLonBox &box, bool highlightedItems ) const
 {
+    const GeoGraphicsSceneSnapshot snapshot = d->snapshot();
+
     QList< GeoGraphicsItemPtr > tempItems;
     if ( box.west() > box.east() )
     {
@@ -458,68 +625,52 @@ GeoGraphicsScene::items( const GeoDataLatLonBox &box, bool highlightedItems ) co
         right.setNorth( box.north() );
         right.setSouth( box.south() );
 
-        tempItems = itemsImpl( left, highlightedItems ) + itemsImpl( right, highlightedItems);
+        tempItems = itemsImpl( snapshot, left, highlightedItems ) + itemsImpl( snapshot, right, highlightedItems);
     }
     else
     {
-        tempItems = itemsImpl(box, highlightedItems);
+        tempItems = itemsImpl(snapshot, box, highlightedItems);
     }
 
     return tempItems;
 }
 
-namespace
+QList<GeoGraphicsItemPtr> GeoGraphicsScene::items(const GeoSceneTileDataset *tileData, const TileId tileId, bool highlightedItems, QSet<const GeoGraphicsItem*> *fullItems) const
 {
+    // The tile coverage of the items is computed on the scene's own tile dataset.
+    Q_UNUSED(tileData)
 
-int pow2(int levelDiff)
-{
-    if(levelDiff == 0)
-    {
-        return 1;
-    }
-
-    int value = 2;
-    for(int i = 1; i < levelDiff; ++i)
-    {
-        value *= 2;
-    }
-
-    return value;
-
-}
-
-}
-QList<GeoGraphicsItemPtr> GeoGraphicsScene::items(const GeoSceneTileDataset *tileData, const TileId tileId, bool highlightedItems) const
-{
-    QMap<int, QPair<QPoint, QPoint> > tileRects;
+    const GeoGraphicsSceneSnapshot snapshot = d->snapshot();
 
-    for(int tempZoomLevel = tileId.tileLevel(); tempZoomLevel <= MaxItemTileZoomLevel; ++tempZoomLevel)
-    {
-        tileRects.insert(tempZoomLevel, qMakePair(QPoint(tileId.x()*pow2(tempZoomLevel - tileId.tileLevel()), tileId.y()*pow2(tempZoomLevel - tileId.tileLevel())),
-                                                       QPoint((tileId.x()+1)*pow2(tempZoomLevel - tileId.tileLevel())-1, (tileId.y() + 1)*pow2(tempZoomLevel - tileId.tileLevel())-1)));
-    }
+    QList< GeoGraphicsItemPtr > result;
 
-    for(int tempZoomLevel = qMin(tileId.tileLevel()-1, MaxItemTileZoomLevel); tempZoomLevel > 0; --tempZoomLevel)
+    foreach(const GeoGraphicsSceneIndex::Entry *entry, snapshot.m_index.query(tileId))
     {
-        QPoint point(qFloor(static_cast<double>(tileId.x())/static_cast<double>(pow2(tileId.tileLevel()-tempZoomLevel))),
-                     qFloor(static_cast<double>(tileId.y())/static_cast<double>(pow2(tileId.tileLevel()-tempZoomLevel))));
-        tileRects.insert(tempZoomLevel, qMakePair(point,point));
-    }
+        const GeoGraphicsItemPtr &item = entry->item;
+        if (!item->visible() || (highlightedItems && (!snapshot.m_highlightedItems.contains(item) && !snapshot.m_selectedItems.contains(item))) )
+        {
+            continue;
+        }
 
-    GeoDataLatLonBox latLonBox = tileId.toLatLonBox(tileData);
+        result.append(item);
 
+        if(fullItems && entry->tiles.isFull(tileId.tileLevel(), tileId.x(), tileId.y()))
+        {
+            fullItems->insert(item.data());
+        }
+    }
 
-    return getItems(tileRects, latLonBox, highlightedItems);
+    return result;
 }
 
-QList<GeoGraphicsItemPtr> GeoGraphicsScene::itemsImpl( const GeoDataLatLonBox &box, bool highlightedItems ) const
+QList<GeoGraphicsItemPtr> GeoGraphicsScene::itemsImpl( const GeoGraphicsSceneSnapshot &snapshot, const GeoDataLatLonBox &box, bool highlightedItems ) const
 {
     qreal north, south, east, west;
     box.boundaries( north, south, east, west );
 
     QMap<int, QPair<QPoint, QPoint> > tileRects;
 
-    for(int tempTileLevel = MaxItemTileZoomLevel; tempTileLevel >= 0; tempTileLevel--)
+    for(int tempTileLevel = maxItemTileZoomLevel(d->m_tileDataset); tempTileLevel >= 0; tempTileLevel--)
     {
         TileId topLeftKey = TileId::fromCoordinates( d->m_tileDataset, GeoDataCoordinates(west, north, 0), tempTileLevel );
         TileId bottomRightKey = TileId::fromCoordinates( d->m_tileDataset, GeoDataCoordinates(east, south, 0), tempTileLevel );
@@ -532,114 +683,41 @@ QList<GeoGraphicsItemPtr> GeoGraphicsScene::itemsImpl( const GeoDataLatLonBox &b
         tileRects.insert(tempTileLevel, qMakePair(QPoint(minX, minY), QPoint(maxX, maxY)));
     }
 
-    return getItems(tileRects, box, highlightedItems);
+    return getItems(snapshot, tileRects, box, highlightedItems);
 }
 
 
 
-QList<GeoGraphicsItemPtr> GeoGraphicsScene::getItems(const QMap<int, QPair<QPoint, QPoint> > &tileRects,  const GeoDataLatLonBox &box, bool highlightedItems ) const
+QList<GeoGraphicsItemPtr> GeoGraphicsScene::getItems(const GeoGraphicsSceneSnapshot &snapshot, const QMap<int, QPair<QPoint, QPoint> > &tileRects,  const GeoDataLatLonBox &box, bool highlightedItems ) const
 {
     qreal north, south, east, west;
     box.boundaries( north, south, east, west );
 
 
+    // the callers fill in every level down to the coverage depth
+    const int maxTileLevel = tileRects.isEmpty() ? -1 : tileRects.lastKey();
+
     QList< GeoGraphicsItemPtr > result;
-    auto zLevelIt = d->m_items.constBegin();
-    auto zLevelItEnd = d->m_items.constEnd();
 
-    for(; zLevelIt != zLevelItEnd; ++zLevelIt)
+    foreach(const GeoGraphicsSceneIndex::Entry *entry, snapshot.m_index.query(box))
     {
-        const auto & hash = zLevelIt.value();
+        const GeoGraphicsItemPtr &item = entry->item;
+        if (!item->visible() || (highlightedItems && (!snapshot.m_highlightedItems.contains(item) && !snapshot.m_selectedItems.contains(item))) )
+        {
+            continue;
+        }
 
-        auto itemItLeft = hash.begin();
-        auto itemItLeftEnd = hash.upperBound(east);
+        bool found = false;
+
+        for(int tempTileLevel = maxTileLevel; tempTileLevel >= 0 && !found; tempTileLevel--)
+        {
+            const QPair<QPoint, QPoint> &tileRect = tileRects[tempTileLevel];
+            found = entry->tiles.intersects(tempTileLevel, QRect(tileRect.first, tileRect.second));
+        }
 
-        for(; itemItLeft != itemItLeftEnd && itemItLeft.key() <= east; ++itemItLeft)
+        if(found)
         {
-            const auto & hash = itemItLeft.value();
-
-            auto itemItRight = hash.lowerBound(west);
-            auto itemItRightEnd = hash.constEnd();
-
-            for(; itemItRight != itemItRightEnd; ++itemItRight)
-            {
-                if(itemItRight.key() < west)
-                {
-                    continue;
-                }
-
-                const auto & hash = itemItRight.value();
-
-                auto itemItBottom = hash.begin();
-                auto itemItBottomEnd = hash.upperBound(north);
-
-                for(; itemItBottom != itemItBottomEnd && itemItBottom.key() <= north; ++itemItBottom)
-                {
-                    const auto & hash = itemItBottom.value();
-
-                    auto itemItTop = hash.lowerBound(south);
-                    auto itemItTopEnd = hash.constEnd();
-
-                    for(; itemItTop != itemItTopEnd; ++itemItTop)
-                    {
-                        if(itemItTop.key() < south)
-                        {
-                            continue;
-                        }
-
-                        auto itemIt = itemItTop.value().constBegin();
-                        auto itemItEnd = itemItTop.value().constEnd();
-
-                        for(; itemIt != itemItEnd; ++itemIt)
-                        {
-                            const GeoGraphicsItemPtr &item = itemIt.key();
-                            if (!item->visible() || (highlightedItems && (!d->m_highlightedItems.contains(item) && !d->m_selectedItems.contains(item))) )
-                            {
-                                continue;
-                            }
-
-                            bool found = false;
-
-                            for(int tempTileLevel = MaxItemTileZoomLevel; tempTileLevel >= 0 && !found; tempTileLevel--)
-                            {
-                                const auto & hash = itemIt.value().value(tempTileLevel);
-
-                                auto itX = hash.lowerBound(tileRects[tempTileLevel].first.x());
-                                auto itEnd = hash.constEnd();
-
-                                for(; itX != itEnd && itX.key() <= tileRects[tempTileLevel].second.x() && !found; ++itX)
-                                {
-                                    if(itX.key() < tileRects[tempTileLevel].first.x())
-                                    {
-                                        continue;
-                                    }
-
-
-                                    auto itY = itX.value().lowerBound(tileRects[tempTileLevel].first.y());
-                                    auto itYEnd = itX.value().constEnd();
-
-                                    for(; itY != itYEnd && itY.key() <= tileRects[tempTileLevel].second.y(); ++itY)
-                                    {
-                                        if(itY.key() < tileRects[tempTileLevel].first.y())
-                                        {
-                                            continue;
-                                        }
-
-                                        found = true;
-                                        break;
-                                    }
-                                }
-                            }
-
-                            if(found)
-                            {
-                                result.append(item);
-                            }
-
-                        }
-                    }
-                }
-            }
+            result.append(item);
         }
     }
 
@@ -681,10 +759,17 @@ void GeoGraphicsScene::applyImpl(const QVector<GeoDataFeature*>& features, QSet<
 
     if(tempOldItems != oldItems)
     {
+        d->publish();
         emit repaintNeeded();
     }
 }
 
+quint64
+GeoGraphicsScene::version() const
+{
+    return d->snapshot().m_version;
+}
+
 void
 GeoGraphicsScene::applyHighlight( const QVector< GeoDataFeature* > &selectedFeatures )
 {
@@ -697,34 +782,89 @@ GeoGraphicsScene::applySelected(const QVector<GeoDataFeature *> &selectedFeature
     applyImpl(selectedFeatures, d->m_selectedItems);
 }
 
-void GeoGraphicsScene::doAddItem(const GeoDataFeature *feature)
+void
+GeoGraphicsScene::addGraphicsItems(const QVector<const GeoDataFeature*> &features)
+{
+    if(features.isEmpty())
+    {
+        return;
+    }
+
+    startAddItem(features);
+}
+
+AddItem *
+GeoGraphicsScene::startAddItem(const QVector<const GeoDataFeature*> &features)
 {
-    AddItem *addItem = new AddItem(feature, d->m_tileDataset, this);
-    d->jobs.insert(feature, addItem);
+    AddItem *addItem = new AddItem(features, d->m_tileDataset, &d->m_coverageCache, this);
+    d->m_addItems.insert(addItem);
+    foreach(const GeoDataFeature *feature, features)
+    {
+        d->jobs.insert(feature, addItem);
+    }
 
-    connect(addItem, SIGNAL(finished(const GeoDataFeature *, const GeoGraphicsItemPtr &, const TileMap &)), this, SLOT(handleFinished(const GeoDataFeature *, const GeoGraphicsItemPtr &, const TileMap &)));
-    connect(addItem, SIGNAL(finished(const GeoDataFeature *, const GeoGraphicsItemPtr &, const TileMap &)), addItem, SLOT(deleteLater()));
+    connect(addItem, SIGNAL(finished(AddItem *)), this, SLOT(handleFinished(AddItem *)));
     addItem->run();
+
+    return addItem;
 }
 
 void
-GeoGraphicsScene::handleFinished(const GeoDataFeature *feature, const GeoGraphicsItemPtr &item, const TileMap &tiles)
+GeoGraphicsScene::handleFinished(AddItem *addItem)
 {
-    qDebug() << "GeoGraphicsScene::handleFinished" << tiles.size() << feature->nodeType();
-    d->jobs.remove(feature);
-    d->m_features_graphics_items[feature].append(item);
+    qDebug() << "GeoGraphicsScene::handleFinished" << addItem->jobs().size();
+
+    QVector<GeoGraphicsSceneIndex::Entry> entries;
+    entries.reserve(addItem->jobs().size());
+
+    QMap<int /* z level */, QVector<TileCoverage> > zLevelTiles = d->m_replacedTiles.take(addItem);
 
-    if ( item->latLonAltBox().west() > item->latLonAltBox().east() )
+    foreach(const AddItemJob *job, addItem->jobs())
     {
-        d->m_items[feature->zLevel()][-M_PI][item->latLonAltBox().east()][item->latLonAltBox().south()][item->latLonAltBox().north()][item] = tiles;
-        d->m_items[feature->zLevel()][item->latLonAltBox().west()][M_PI][item->latLonAltBox().south()][item->latLonAltBox().north()][item] = tiles;
+        const GeoDataFeature *feature = job->object();
+        if(d->jobs.value(feature) == addItem)
+        {
+            d->jobs.remove(feature);
+        }
+
+        if(job->isCancelled() || !job->item())
+        {
+            continue;
+        }
+
+        d->m_features_graphics_items[feature].append(job->item());
+
+        GeoGraphicsSceneIndex::Entry entry;
+        entry.item = job->item();
+        entry.tiles = job->tiles();
+        entry.box = job->box();
+        entry.zLevel = feature->zLevel();
+        entry.serial = 0;
+        entries.append(entry);
+
+        if(!job->isCached() && !job->key().isEmpty())
+        {
+            d->m_coverageCache.insert(job->documentFileName(), job->key(), job->tiles(), job->box());
+        }
+
+        zLevelTiles[entry.zLevel].append(entry.tiles);
     }
-    else
+
+    d->m_addItems.remove(addItem);
+    addItem->deleteLater();
+
+    d->m_index.insert(entries);
+    d->publish();
+
+    if(d->m_addItems.isEmpty())
     {
-        d->m_items[feature->zLevel()][item->latLonAltBox().west()][item->latLonAltBox().east()][item->latLonAltBox().south()][item->latLonAltBox().north()][item] = tiles;
+        d->m_coverageCache.save();
     }
 
-    emit updatedTiles(tiles);
+    if(!zLevelTiles.isEmpty())
+    {
+        emit updatedTiles(uniteLayers(zLevelTiles));
+    }
 
 //    Marble::GeoDataStyle::Ptr style(new Marble::GeoDataStyle);
 
@@ -798,158 +938,35 @@ GeoGraphicsScene::handleFinished(const GeoDataFeature *feature, const GeoGraphic
 //    }
 }
 
-TileMap
-removeGeoItem(const GeoGraphicsItemPtr &geoItem,
-              QMap<double /* z level */, QMap<double, QMap<double, QMap<double, QMap<double, QHash<GeoGraphicsItemPtr, TileMap> > > > > > &items,
-              const GeoDataLatLonBox &latLonBox)
-{
-    TileMap tiles;
-    double zLevel = geoItem->feature()->zLevel();
-
-    tiles = items[zLevel][latLonBox.west()][latLonBox.east()][latLonBox.south()][latLonBox.north()][geoItem];
-    items[zLevel][latLonBox.west()][latLonBox.east()][latLonBox.south()][latLonBox.north()].remove(geoItem);
-    if(items[zLevel][latLonBox.west()][latLonBox.east()][latLonBox.south()][latLonBox.north()].isEmpty())
-    {
-        items[zLevel][latLonBox.west()][latLonBox.east()][latLonBox.south()].remove(latLonBox.north());
-    }
-
-    if(items[zLevel][latLonBox.west()][latLonBox.east()][latLonBox.south()].isEmpty())
-    {
-        items[zLevel][latLonBox.west()][latLonBox.east()].remove(latLonBox.south());
-    }
-
-    if(items[zLevel][latLonBox.west()][latLonBox.east()].isEmpty())
-    {
-        items[zLevel][latLonBox.west()].remove(latLonBox.east());
-    }
-
-    if(items[zLevel][latLonBox.west()].isEmpty())
-    {
-        items[zLevel].remove(latLonBox.west());
-    }
-
-    if(items[zLevel].isEmpty())
-    {
-        items.remove(zLevel);
-    }
-
-    return tiles;
-}
-
-namespace
-{
-
-
-void
-uniteY(QMap<int /* y */, TileStatus> &map, const QMap<int /* y */, TileStatus> &otherMap)
-{
-    auto it = otherMap.constBegin();
-    auto itEnd = otherMap.constEnd();
-    for(; it != itEnd; ++it)
-    {
-        TileStatus status = map[it.key()];
-        TileStatus otherStatus = it.value();
-        if(status == TileStatus::Full || otherStatus == TileStatus::Full)
-        {
-            status = TileStatus::Full;
-        }
-        else if (status == TileStatus::Partially || otherStatus == TileStatus::Partially)
-        {
-            status = TileStatus::Partially;
-        }
-
-        map[it.key()] = status;
-    }
-}
-
-
-void
-uniteX(QMap<int /* x */, QMap<int /* y */, TileStatus> > &map, const QMap<int /* x */, QMap<int /* y */, TileStatus> > &otherMap)
-{
-    auto it = otherMap.constBegin();
-    auto itEnd = otherMap.constEnd();
-    for(; it != itEnd; ++it)
-    {
-        uniteY(map[it.key()], it.value());
-    }
-
-}
-
-
-void
-unite(TileMap &map, const TileMap &otherMap)
-{
-    auto it = otherMap.constBegin();
-    auto itEnd = otherMap.constEnd();
-    for(; it != itEnd; ++it)
-    {
-        uniteX(map[it.key()], it.value());
-    }
-}
-
-}
-
 bool
-GeoGraphicsScene::removeItem( const GeoDataFeature* feature, TileMap &tiles )
+GeoGraphicsScene::removeItem( const GeoDataFeature* feature, QVector<GeoGraphicsItemPtr> &items )
 {
-    if(d->jobs.contains(feature))
+    AddItem *addItem = d->jobs.take(feature);
+    if(addItem)
     {
-        delete d->jobs[feature];
-        d->jobs.remove(feature);
+        addItem->cancel(feature);
     }
 
-    QElapsedTimer timer;
-    timer.start();
-
-    foreach(const auto &geoItem, d->m_features_graphics_items[feature])
+    foreach(const auto &geoItem, d->m_features_graphics_items.value(feature))
     {
         d->m_highlightedItems.remove(geoItem);
         d->m_selectedItems.remove(geoItem);
 
-        TileMap tempTiles;
-
-        GeoDataLatLonBox box = geoItem->latLonAltBox();
-
-        if ( box.west() > box.east() )
-        {
-            // Handle boxes crossing the IDL by splitting it into two separate boxes
-            GeoDataLatLonBox left;
-            left.setWest( -M_PI );
-            left.setEast( box.east() );
-            left.setNorth( box.north() );
-            left.setSouth( box.south() );
-
-            GeoDataLatLonBox right;
-            right.setWest( box.west() );
-            right.setEast( M_PI );
-            right.setNorth( box.north() );
-            right.setSouth( box.south() );
-
-            tempTiles = removeGeoItem(geoItem, d->m_items, left);
-            unite(tempTiles, removeGeoItem(geoItem, d->m_items, right));
-        }
-        else
-        {
-            tempTiles = removeGeoItem(geoItem, d->m_items, box);
-        }
-
-        unite(tiles, tempTiles);
-
+        items.append(geoItem);
     }
 
     d->m_features_graphics_items.remove( feature );
-    qWarning() << "removeItem finised elapsed" << timer.nsecsElapsed();
 
     return true;
 }
 
-bool GeoGraphicsScene::removeGraphicsItemsImpl(const GeoDataFeature *feature, TileMap &tiles)
+bool GeoGraphicsScene::removeGraphicsItemsImpl(const GeoDataFeature *feature, QVector<GeoGraphicsItemPtr> &items)
 {
     bool doUpdate = false;
     if( feature->nodeType() == GeoDataTypes::GeoDataPlacemarkType ||
         feature->nodeType() == GeoDataTypes::GeoDataGroundOverlayType)
     {
-        doUpdate = removeItem( feature, tiles );
+        doUpdate = removeItem( feature, items );
     }
     else if( feature->nodeType() == GeoDataTypes::GeoDataFolderType
              || feature->nodeType() == GeoDataTypes::GeoDataDocumentType )
@@ -957,7 +974,7 @@ bool GeoGraphicsScene::removeGraphicsItemsImpl(const GeoDataFeature *feature, Ti
         const GeoDataContainer *container = static_cast<const GeoDataContainer*>( feature );
         foreach( const GeoDataFeature *child, container->featureList() )
         {
-             doUpdate |= removeGraphicsItemsImpl( child, tiles );
+             doUpdate |= removeGraphicsItemsImpl( child, items );
         }
     }
 
@@ -969,18 +986,15 @@ void GeoGraphicsScene::clear()
 {
     emit aboutToClear();
 
-    d->m_items.clear();
+    d->m_index.clear();
     d->m_features_graphics_items.clear();
-    auto it = d->jobs.begin();
-    auto itEnd = d->jobs.end();
-    for(; it != itEnd; ++it)
-    {
-        delete it.value();
-    }
-    qDeleteAll(d->jobs);
+    qDeleteAll(d->m_addItems);
+    d->m_addItems.clear();
+    d->m_replacedTiles.clear();
     d->jobs.clear();
     d->m_selectedItems.clear();
     d->m_highlightedItems.clear();
+    d->publish();
 
     emit cleared();
 }
@@ -989,20 +1003,75 @@ void GeoGraphicsScene::clear()
 bool
 GeoGraphicsScene::removeGraphicsItems( const GeoDataFeature *feature )
 {
-    TileMap tiles;
+    return removeGraphicsItems(QVector<const GeoDataFeature*>() << feature);
+}
+
+bool
+GeoGraphicsScene::removeGraphicsItems( const QVector<const GeoDataFeature*> &features )
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QVector<GeoGraphicsItemPtr> items;
+
+    bool doUpdate = false;
+    foreach(const GeoDataFeature *feature, features)
+    {
+        doUpdate |= removeGraphicsItemsImpl(feature, items);
+    }
+
+    const QMap<int, QVector<TileCoverage> > zLevelTiles = removedTiles(d->m_index.remove(items));
+    d->publish();
 
-    bool doUpdate = removeGraphicsItemsImpl(feature, tiles);
+    qDebug() << "GeoGraphicsScene::removeGraphicsItems" << features.size() << items.size() << timer.elapsed();
 
     if(doUpdate)
     {
-        emit updatedTiles(tiles);
+        emit updatedTiles(uniteLayers(zLevelTiles));
     }
 
     return doUpdate;
 }
 
+void
+GeoGraphicsScene::replaceGraphicsItems( const GeoDataFeature *oldFeature, const GeoDataFeature *newFeature )
+{
+    // The old items go right away since they may refer to the old geometry,
+    // their tiles stay valid until the new items are in place.
+    QVector<GeoGraphicsItemPtr> items;
+    removeGraphicsItemsImpl(oldFeature, items);
+
+    const QMap<int, QVector<TileCoverage> > zLevelTiles = removedTiles(d->m_index.remove(items));
+    d->publish();
+
+    QVector<const GeoDataFeature*> features;
+    collectFeatures(newFeature, features);
+
+    if(features.isEmpty())
+    {
+        if(!zLevelTiles.isEmpty())
+        {
+            emit updatedTiles(uniteLayers(zLevelTiles));
+        }
+
+        return;
+    }
+
+    AddItem *addItem = startAddItem(features);
+    d->m_replacedTiles.insert(addItem, zLevelTiles);
+}
+
 void
 GeoGraphicsScene::createGraphicsItems( const GeoDataFeature *feature )
+{
+    QVector<const GeoDataFeature*> features;
+    collectFeatures(feature, features);
+
+    addGraphicsItems(features);
+}
+
+void
+GeoGraphicsScene::collectFeatures( const GeoDataFeature *feature, QVector<const GeoDataFeature*> &features ) const
 {
     // parse all child objects of the container
     if ( const GeoDataContainer *container = dynamic_cast<const GeoDataContainer*>( feature ) )
@@ -1010,25 +1079,62 @@ GeoGraphicsScene::createGraphicsItems( const GeoDataFeature *feature )
         int rowCount = container->size();
         for ( int row = 0; row < rowCount; ++row )
         {
-            createGraphicsItems( container->child( row ) );
+            collectFeatures( container->child( row ), features );
         }
     }
     else
     {
-        emit startAddItem(feature);
+        features.append(feature);
     }
 }
 
 void GeoGraphicsScene::setTextureLayer(GeoSceneTextureTileDataset *tileDataset)
 {
     d->m_tileDataset = tileDataset;
+    d->m_coverageCache.setTileDataset(tileDataset, maxItemTileZoomLevel(tileDataset));
+
+#ifdef VALIDATE_TILE_COVERAGE
+    if(tileDataset)
+    {
+        TileCoverageValidation::validate(tileDataset, maxItemTileZoomLevel(tileDataset));
+    }
+#endif
+}
+
+
+namespace
+{
+
+// Features handled by one worker before it takes the next chunk.
+const int AddItemChunkSize = 256;
+
+void
+runChunk(QVector<AddItemJob*> &chunk)
+{
+    foreach(AddItemJob *job, chunk)
+    {
+        job->run();
+    }
 }
 
+}
 
-AddItem::AddItem(const GeoDataFeature *feature, GeoSceneTextureTileDataset *tileDataset, QObject *parent)
-    :   QObject(parent),
-        job(new AddItemJob(tileDataset, feature))
+AddItem::AddItem(const QVector<const GeoDataFeature*> &features, GeoSceneTextureTileDataset *tileDataset, const TileCoverageCache *coverageCache, QObject *parent)
+    :   QObject(parent)
 {
+    m_jobs.reserve(features.size());
+    foreach(const GeoDataFeature *feature, features)
+    {
+        AddItemJob *job = new AddItemJob(tileDataset, coverageCache, feature);
+        m_jobs.append(job);
+        m_featureJobs.insert(feature, job);
+    }
+
+    for(int i = 0; i < m_jobs.size(); i += AddItemChunkSize)
+    {
+        m_chunks.append(m_jobs.mid(i, AddItemChunkSize));
+    }
+
     connect(&watcher, SIGNAL(finished()), this, SLOT(handleFinished()));
 }
 
@@ -1037,29 +1143,43 @@ AddItem::~AddItem()
     disconnect(&watcher, SIGNAL(finished()), this, SLOT(handleFinished()));
     if(!watcher.isFinished())
     {
-        job->cancel();
+        watcher.cancel();
+        foreach(AddItemJob *job, m_jobs)
+        {
+            job->cancel();
+        }
         watcher.waitForFinished();
     }
-    delete job;
+    qDeleteAll(m_jobs);
 }
 
 void AddItem::run()
 {
-    QFuture<void> future = QtConcurrent::run(job, &AddItemJob::run);
+    QFuture<void> future = QtConcurrent::map(m_chunks, runChunk);
     watcher.setFuture(future);
 }
 
-void AddItem::handleFinished()
+void AddItem::cancel(const GeoDataFeature *feature)
 {
-    qDebug() << "AddItem::handleFinished";
-
-    emit finished(job->object(), job->item(), job->tiles());
+    AddItemJob *job = m_featureJobs.value(feature, nullptr);
+    if(job)
+    {
+        job->cancel();
+    }
 }
 
+const QVector<AddItemJob*> &
+AddItem::jobs() const
+{
+    return m_jobs;
+}
 
+void AddItem::handleFinished()
+{
+    qDebug() << "AddItem::handleFinished";
 
-
-
+    emit finished(this);
+}
 
 }
 
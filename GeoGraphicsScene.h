@@ -16,7 +16,10 @@
 #include "MarbleGlobal.h"
 #include "graphicsview/GeoGraphicsItem.h"
 #include <QtCore/QObject>
+#include <QtCore/QHash>
 #include <QtCore/QList>
+#include <QtCore/QSet>
+#include <QtCore/QVector>
 #include <QtGui/QColor>
 #include <QtCore/QSharedPointer>
 #include <QtCore/QFutureWatcher>
@@ -28,6 +31,7 @@ namespace Marble
 class GeoDataFeature;
 class GeoDataLatLonBox;
 class GeoGraphicsScenePrivate;
+class GeoGraphicsSceneSnapshot;
 class GeoDataDocument;
 class GeoDataStyleMap;
 class GeoDataPlacemark;
@@ -36,13 +40,18 @@ class GeoDataGeometry;
 class GeoDataFeature;
 class TileId;
 class AddItemJob;
+class TileCoverageCache;
 
+/**
+ * Builds the graphics items and their tile coverage for a batch of features.
+ * The features are split into chunks which are processed in parallel.
+ */
 class AddItem : public QObject
 {
     Q_OBJECT
 
 public:
-    AddItem(const GeoDataFeature *feature, GeoSceneTextureTileDataset *tileDataset, QObject *parent);
+    AddItem(const QVector<const GeoDataFeature*> &features, GeoSceneTextureTileDataset *tileDataset, const TileCoverageCache *coverageCache, QObject *parent);
 
     
     ~AddItem() override;
@@ -50,17 +59,28 @@ public:
     void
     run();
 
+    /**
+     * Drops @p feature from the batch, it gets no item.
+     */
+    void
+    cancel(const GeoDataFeature *feature);
+
+    const QVector<AddItemJob*> &
+    jobs() const;
+
 public slots:
     void
     handleFinished();
 
 signals:
     void
-    finished(const GeoDataFeature *feature, const GeoGraphicsItemPtr &item, const TileMap &tiles);
+    finished(AddItem *addItem);
 
 private:
     QFutureWatcher<void> watcher;
-    AddItemJob *job;
+    QVector<AddItemJob*> m_jobs;
+    QHash<const GeoDataFeature*, AddItemJob*> m_featureJobs;
+    QVector<QVector<AddItemJob*> > m_chunks;
 };
 
 
@@ -94,18 +114,53 @@ public:
     QList<GeoGraphicsItemPtr>
     items(const GeoDataLatLonBox &box , bool highlightedItems = false) const;
 
+    /**
+     * Returns the items drawn into @p tileId in render order. If @p fullItems
+     * is given, it receives the returned items covering the whole tile.
+     */
     QList<GeoGraphicsItemPtr>
-    items(const GeoSceneTileDataset *tileData, const TileId tileId, bool highlightedItems = false) const;
+    items(const GeoSceneTileDataset *tileData, const TileId tileId, bool highlightedItems = false, QSet<const GeoGraphicsItem*> *fullItems = nullptr) const;
 
     bool
     removeGraphicsItems(const GeoDataFeature *feature);
 
+    /**
+     * Removes the items of all @p features in one go and emits a single
+     * tile update for all of them.
+     */
+    bool
+    removeGraphicsItems(const QVector<const GeoDataFeature*> &features);
+
+    /**
+     * Replaces the items of @p oldFeature and its children by the items of
+     * @p newFeature, which may be the same feature after it changed. The
+     * tiles of both are expired together once the new items are ready.
+     */
+    void
+    replaceGraphicsItems(const GeoDataFeature *oldFeature, const GeoDataFeature *newFeature);
+
     void
     createGraphicsItems(const GeoDataFeature *feature);
 
+    /**
+     * Adds the items of many features at once. Their tile coverage is built
+     * in parallel, the items are loaded into the index in one step and a
+     * single tile update is emitted for the whole batch.
+     */
+    void
+    addGraphicsItems(const QVector<const GeoDataFeature*> &features);
+
     void
     setTextureLayer(GeoSceneTextureTileDataset *tileDataset);
 
+    /**
+     * The version of the scene contents answering queries, incremented with
+     * every change. Queries may come from any thread; each one works on the
+     * version current when it started and never waits for changes.
+     */
+    quint64
+    version() const;
+
 public Q_SLOTS:
     void
     applyHighlight( const QVector<GeoDataFeature*>& );
@@ -115,17 +170,14 @@ public Q_SLOTS:
 
 private slots:
     void
-    doAddItem(const GeoDataFeature *feature);
-
-    void
-    handleFinished(const GeoDataFeature *feature, const GeoGraphicsItemPtr &item, const TileMap &tiles);
+    handleFinished(AddItem *addItem);
 
 Q_SIGNALS:
     void
     repaintNeeded();
 
     void
-    updatedTiles(const TileMap &tiles);
+    updatedTiles(const LayeredTileCoverage &tiles);
 
     void
     aboutToClear();
@@ -133,9 +185,6 @@ Q_SIGNALS:
     void
     cleared();
 
-    void
-    startAddItem(const GeoDataFeature *feature);
-
 private:
     /**
      * @brief Add an item to the GeoGraphicsScene
@@ -147,13 +196,19 @@ private:
      * @brief Remove all concerned items from the GeoGraphicsScene
      * Removes all items which are associated with @p object from the GeoGraphicsScene
      */
-    bool removeItem( const GeoDataFeature *feature, TileMap &tiles );
+    bool removeItem( const GeoDataFeature *feature, QVector<GeoGraphicsItemPtr> &items );
 
     bool
-    removeGraphicsItemsImpl( const GeoDataFeature *feature, TileMap &tiles );
+    removeGraphicsItemsImpl( const GeoDataFeature *feature, QVector<GeoGraphicsItemPtr> &items );
+
+    AddItem *
+    startAddItem( const QVector<const GeoDataFeature*> &features );
+
+    void
+    collectFeatures( const GeoDataFeature *feature, QVector<const GeoDataFeature*> &features ) const;
 
     QList<GeoGraphicsItemPtr>
-    itemsImpl(const GeoDataLatLonBox &box, bool highlightedItems) const;
+    itemsImpl(const GeoGraphicsSceneSnapshot &snapshot, const GeoDataLatLonBox &box, bool highlightedItems) const;
 
     QSet<GeoGraphicsItemPtr>
     itemsTileImpl(const GeoDataLatLonBox &box, int tileLevel) const;
@@ -162,7 +217,7 @@ private:
     applyImpl(const QVector<GeoDataFeature*>& features, QSet<GeoGraphicsItemPtr> &oldItems);
 
     QList<GeoGraphicsItemPtr>
-    getItems(const QMap<int, QPair<QPoint, QPoint> > &tileRects, const GeoDataLatLonBox &box, bool highlightedItems) const;
+    getItems(const GeoGraphicsSceneSnapshot &snapshot, const QMap<int, QPair<QPoint, QPoint> > &tileRects, const GeoDataLatLonBox &box, bool highlightedItems) const;
 
     GeoGraphicsScenePrivate * const d;
 };
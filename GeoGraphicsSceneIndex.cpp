@@ -0,0 +1,673 @@
+#define QT_NO_DEBUG_OUTPUT
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#include "GeoGraphicsSceneIndex.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QSet>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QtMath>
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <utility>
+
+#include <boost/geometry.hpp>
+#include <boost/geometry/geometries/box.hpp>
+#include <boost/geometry/geometries/point.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+#include "geodata/data/GeoDataLatLonBox.h"
+
+namespace
+{
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+typedef bg::model::point<double, 2, bg::cs::cartesian> Point;
+typedef bg::model::box<Point> Box;
+typedef std::pair<Box, Marble::GeoGraphicsSceneIndex::Entry*> Value;
+typedef bgi::rtree<Value, bgi::rstar<16> > Tree;
+
+// Entries and tile postings are split into shards, so that changing a copy
+// of the index only copies the shards it touches.
+const int ShardCount = 256;
+
+// Postings are sharded by their ancestor on this level, 4^4 == ShardCount,
+// which keeps the postings of neighbouring tiles in the same shard.
+const int ShardLevel = 4;
+
+// The least number of changes a layer collects before packing its tree again.
+const std::size_t MinLayerChanges = 1024;
+
+int
+postingShard(int level, quint64 code)
+{
+    return int((code >> (2 * qMax(0, level - ShardLevel))) & (ShardCount - 1));
+}
+
+int
+entryShard(const Marble::GeoGraphicsItemPtr &item)
+{
+    // Fibonacci hashing spreads the aligned item addresses over all shards.
+    return int((quint64(quintptr(item.data())) * Q_UINT64_C(0x9E3779B97F4A7C15)) >> 56);
+}
+
+// A box crossing the date line is split into its western and eastern half.
+QVector<Box>
+toBoxes(const Marble::GeoDataLatLonBox &latLonBox)
+{
+    qreal north, south, east, west;
+    latLonBox.boundaries(north, south, east, west);
+
+    QVector<Box> boxes;
+    if(west > east)
+    {
+        boxes.append(Box(Point(-M_PI, south), Point(east, north)));
+        boxes.append(Box(Point(west, south), Point(M_PI, north)));
+    }
+    else
+    {
+        boxes.append(Box(Point(west, south), Point(east, north)));
+    }
+
+    return boxes;
+}
+
+bool
+lessSerial(const Marble::GeoGraphicsSceneIndex::Entry *entry, const Marble::GeoGraphicsSceneIndex::Entry *otherEntry)
+{
+    return entry->serial < otherEntry->serial;
+}
+
+bool
+lessZLevel(const Marble::GeoGraphicsSceneIndex::Entry *entry, const Marble::GeoGraphicsSceneIndex::Entry *otherEntry)
+{
+    return entry->zLevel < otherEntry->zLevel || (entry->zLevel == otherEntry->zLevel && entry->serial < otherEntry->serial);
+}
+
+// Returns per level the tiles kept in @p tiles together with all of their ancestors.
+QVector<QVector<quint64> >
+touchedCodes(const Marble::TileCoverage &tiles)
+{
+    QVector<QVector<quint64> > levels(tiles.maxLevel() + 1);
+
+    for(int level = levels.size() - 1; level >= 0; --level)
+    {
+        QVector<quint64> codes = tiles.mortonCodes(level);
+
+        if(level + 1 < levels.size())
+        {
+            QVector<quint64> parents;
+            foreach(quint64 child, levels.at(level + 1))
+            {
+                // Children are sorted, so equal parents are adjacent.
+                const quint64 parent = child >> 2;
+                if(parents.isEmpty() || parents.last() != parent)
+                {
+                    parents.append(parent);
+                }
+            }
+
+            QVector<quint64> merged;
+            merged.reserve(codes.size() + parents.size());
+            std::set_union(codes.constBegin(), codes.constEnd(), parents.constBegin(), parents.constEnd(), std::back_inserter(merged));
+            codes = merged;
+        }
+
+        levels[level] = codes;
+    }
+
+    return levels;
+}
+
+}
+
+namespace Marble
+{
+
+class GeoGraphicsSceneIndexPrivate : public QSharedData
+{
+public:
+    typedef QVector<const GeoGraphicsSceneIndex::Entry*> PostingList;
+    typedef QHash<quint64 /* Morton code */, PostingList> TilePostings;
+    typedef QHash<GeoGraphicsItemPtr, QSharedPointer<GeoGraphicsSceneIndex::Entry> > Entries;
+
+    /**
+     * The tree of one z level. A packed base tree is shared by all copies of
+     * the layer; later insertions go to a small tree of changes and removals
+     * from the base are only recorded. Copying the layer for a change thus
+     * only copies the changes, the base is packed again once they grow.
+     */
+    struct Layer : public QSharedData
+    {
+        Layer(std::vector<Value>::const_iterator first, std::vector<Value>::const_iterator last)
+            :   base(new Tree(first, last)),
+                removedValues(0)
+        {
+        }
+
+        std::size_t
+        size() const
+        {
+            return base->size() - removedValues + changes.size();
+        }
+
+        template<typename Predicate, typename OutputIterator>
+        void
+        query(const Predicate &predicate, OutputIterator out) const
+        {
+            if(removed.isEmpty())
+            {
+                base->query(predicate, out);
+            }
+            else
+            {
+                std::vector<Value> values;
+                base->query(predicate, std::back_inserter(values));
+                for(const Value &value : values)
+                {
+                    // Removed entries may already be deleted, they are recognized by address only.
+                    if(!removed.contains(value.second))
+                    {
+                        *out++ = value;
+                    }
+                }
+            }
+
+            changes.query(predicate, out);
+        }
+
+        void
+        insert(const std::vector<Value> &values)
+        {
+            changes.insert(values.begin(), values.end());
+            packIfNeeded();
+        }
+
+        void
+        remove(GeoGraphicsSceneIndex::Entry *entry, const QVector<Box> &boxes)
+        {
+            foreach(const Box &box, boxes)
+            {
+                if(changes.remove(Value(box, entry)) == 0)
+                {
+                    removed.insert(entry);
+                    ++removedValues;
+                }
+            }
+
+            packIfNeeded();
+        }
+
+        std::vector<Value>
+        values() const
+        {
+            std::vector<Value> result;
+            result.reserve(size());
+            query(bgi::satisfies([](const Value &) { return true; }), std::back_inserter(result));
+            return result;
+        }
+
+        void
+        pack(const std::vector<Value> &values)
+        {
+            base = QSharedPointer<const Tree>(new Tree(values.begin(), values.end()));
+            changes.clear();
+            removed.clear();
+            removedValues = 0;
+        }
+
+        void
+        packIfNeeded()
+        {
+            // Growing with the square root keeps both the copies and the packing cheap per change.
+            const std::size_t maxChanges = qMax(MinLayerChanges, std::size_t(8 * std::sqrt(double(base->size()))));
+            if(changes.size() + removedValues > maxChanges)
+            {
+                pack(values());
+            }
+        }
+
+        QSharedPointer<const Tree> base;
+        Tree changes;
+
+        // the entries removed from the base tree and the number of their values
+        QSet<const GeoGraphicsSceneIndex::Entry*> removed;
+        std::size_t removedValues;
+    };
+
+    GeoGraphicsSceneIndexPrivate()
+        :   m_entries(ShardCount),
+            m_size(0),
+            m_nextSerial(0)
+    {
+    }
+
+    void
+    clear()
+    {
+        m_layers.clear();
+        m_entries = QVector<Entries>(ShardCount);
+        m_size = 0;
+        m_tilePostings.clear();
+        m_leafPostings.clear();
+    }
+
+    QSharedPointer<GeoGraphicsSceneIndex::Entry>
+    entry(const GeoGraphicsItemPtr &item) const
+    {
+        return m_entries.at(entryShard(item)).value(item);
+    }
+
+    void
+    removeEntry(GeoGraphicsSceneIndex::Entry *entry);
+
+    static void
+    insertPosting(QVector<TilePostings> &tilePostings, int level, quint64 code, const GeoGraphicsSceneIndex::Entry *entry);
+
+    static void
+    removePosting(QVector<TilePostings> &tilePostings, int level, quint64 code, const GeoGraphicsSceneIndex::Entry *entry);
+
+    static const PostingList *
+    findPostings(const QVector<QVector<TilePostings> > &levelPostings, int level, quint64 code);
+
+    void
+    addPostings(const GeoGraphicsSceneIndex::Entry *entry);
+
+    void
+    removePostings(const GeoGraphicsSceneIndex::Entry *entry);
+
+    // Entries are shared by all copies of the index referring to them.
+    QMap<int /* z level */, QSharedDataPointer<Layer> > m_layers;
+    QVector<Entries> m_entries;
+    int m_size;
+    quint64 m_nextSerial;
+
+    // Per tile level and shard the entries drawn into a tile, i.e. keeping it or one of its descendants.
+    QVector<QVector<TilePostings> > m_tilePostings;
+
+    // Per tile level and shard the entries keeping exactly that tile, which covers all of its descendants.
+    QVector<QVector<TilePostings> > m_leafPostings;
+};
+
+void
+GeoGraphicsSceneIndexPrivate::insertPosting(QVector<TilePostings> &tilePostings, int level, quint64 code, const GeoGraphicsSceneIndex::Entry *entry)
+{
+    PostingList &postings = tilePostings[postingShard(level, code)][code];
+    postings.insert(std::upper_bound(postings.begin(), postings.end(), entry, lessZLevel), entry);
+}
+
+void
+GeoGraphicsSceneIndexPrivate::removePosting(QVector<TilePostings> &tilePostings, int level, quint64 code, const GeoGraphicsSceneIndex::Entry *entry)
+{
+    const int shard = postingShard(level, code);
+
+    // Looking up through the const shard keeps one not holding the code from being copied.
+    if(!tilePostings.at(shard).contains(code))
+    {
+        return;
+    }
+
+    TilePostings &shardPostings = tilePostings[shard];
+    auto it = shardPostings.find(code);
+
+    PostingList &postings = it.value();
+    auto itEntry = std::lower_bound(postings.begin(), postings.end(), entry, lessZLevel);
+    if(itEntry != postings.end() && *itEntry == entry)
+    {
+        postings.erase(itEntry);
+    }
+
+    if(postings.isEmpty())
+    {
+        shardPostings.erase(it);
+    }
+}
+
+const GeoGraphicsSceneIndexPrivate::PostingList *
+GeoGraphicsSceneIndexPrivate::findPostings(const QVector<QVector<TilePostings> > &levelPostings, int level, quint64 code)
+{
+    if(level >= levelPostings.size())
+    {
+        return nullptr;
+    }
+
+    const TilePostings &shardPostings = levelPostings.at(level).at(postingShard(level, code));
+    auto it = shardPostings.constFind(code);
+
+    return it != shardPostings.constEnd() ? &it.value() : nullptr;
+}
+
+void
+GeoGraphicsSceneIndexPrivate::addPostings(const GeoGraphicsSceneIndex::Entry *entry)
+{
+    const QVector<QVector<quint64> > touched = touchedCodes(entry->tiles);
+    while(touched.size() > m_tilePostings.size())
+    {
+        m_tilePostings.append(QVector<TilePostings>(ShardCount));
+        m_leafPostings.append(QVector<TilePostings>(ShardCount));
+    }
+
+    for(int level = 0; level < touched.size(); ++level)
+    {
+        foreach(quint64 code, touched.at(level))
+        {
+            insertPosting(m_tilePostings[level], level, code, entry);
+        }
+
+        foreach(quint64 code, entry->tiles.mortonCodes(level))
+        {
+            insertPosting(m_leafPostings[level], level, code, entry);
+        }
+    }
+}
+
+void
+GeoGraphicsSceneIndexPrivate::removePostings(const GeoGraphicsSceneIndex::Entry *entry)
+{
+    const QVector<QVector<quint64> > touched = touchedCodes(entry->tiles);
+
+    for(int level = 0; level < touched.size() && level < m_tilePostings.size(); ++level)
+    {
+        foreach(quint64 code, touched.at(level))
+        {
+            removePosting(m_tilePostings[level], level, code, entry);
+        }
+
+        foreach(quint64 code, entry->tiles.mortonCodes(level))
+        {
+            removePosting(m_leafPostings[level], level, code, entry);
+        }
+    }
+}
+
+void
+GeoGraphicsSceneIndexPrivate::removeEntry(GeoGraphicsSceneIndex::Entry *entry)
+{
+    auto it = m_layers.find(entry->zLevel);
+    if(it != m_layers.end())
+    {
+        it.value()->remove(entry, toBoxes(entry->box));
+
+        if(it.value().constData()->size() == 0)
+        {
+            m_layers.erase(it);
+        }
+    }
+
+    removePostings(entry);
+
+    // Dropping the last reference deletes the entry along with its item pointer, so the key is copied.
+    const GeoGraphicsItemPtr item = entry->item;
+    if(m_entries[entryShard(item)].remove(item) > 0)
+    {
+        --m_size;
+    }
+}
+
+GeoGraphicsSceneIndex::GeoGraphicsSceneIndex()
+    :   d(new GeoGraphicsSceneIndexPrivate)
+{
+}
+
+GeoGraphicsSceneIndex::GeoGraphicsSceneIndex(const GeoGraphicsSceneIndex &other)
+    :   d(other.d)
+{
+}
+
+GeoGraphicsSceneIndex::~GeoGraphicsSceneIndex()
+{
+}
+
+GeoGraphicsSceneIndex &
+GeoGraphicsSceneIndex::operator=(const GeoGraphicsSceneIndex &other)
+{
+    d = other.d;
+    return *this;
+}
+
+void
+GeoGraphicsSceneIndex::insert(const GeoGraphicsItemPtr &item, int zLevel, const TileCoverage &tiles)
+{
+    Entry entry;
+    entry.item = item;
+    entry.tiles = tiles;
+    entry.box = item->latLonAltBox();
+    entry.zLevel = zLevel;
+    entry.serial = 0;
+
+    insert(QVector<Entry>() << entry);
+}
+
+void
+GeoGraphicsSceneIndex::insert(const QVector<Entry> &entries)
+{
+    QMap<int, std::vector<Value> > layerValues;
+
+    foreach(const Entry &entry, entries)
+    {
+        const QSharedPointer<Entry> oldEntry = d->entry(entry.item);
+        if(oldEntry)
+        {
+            d->removeEntry(oldEntry.data());
+        }
+
+        QSharedPointer<Entry> newEntry(new Entry(entry));
+        newEntry->serial = d->m_nextSerial++;
+        d->m_entries[entryShard(newEntry->item)].insert(newEntry->item, newEntry);
+        ++d->m_size;
+        d->addPostings(newEntry.data());
+
+        foreach(const Box &box, toBoxes(newEntry->box))
+        {
+            layerValues[newEntry->zLevel].push_back(Value(box, newEntry.data()));
+        }
+    }
+
+    auto it = layerValues.constBegin();
+    auto itEnd = layerValues.constEnd();
+    for(; it != itEnd; ++it)
+    {
+        auto itLayer = d->m_layers.find(it.key());
+        if(itLayer == d->m_layers.end())
+        {
+            // The range constructor packs the tree, which queries faster than one grown by insertion.
+            d->m_layers.insert(it.key(), QSharedDataPointer<GeoGraphicsSceneIndexPrivate::Layer>(new GeoGraphicsSceneIndexPrivate::Layer(it.value().begin(), it.value().end())));
+        }
+        else
+        {
+            itLayer.value()->insert(it.value());
+        }
+    }
+
+    qDebug() << "GeoGraphicsSceneIndex::insert" << entries.size() << d->m_size;
+}
+
+bool
+GeoGraphicsSceneIndex::remove(const GeoGraphicsItemPtr &item, TileCoverage &tiles)
+{
+    const QSharedPointer<Entry> entry = d->entry(item);
+    if(!entry)
+    {
+        return false;
+    }
+
+    tiles = entry->tiles;
+    d->removeEntry(entry.data());
+
+    return true;
+}
+
+QVector<GeoGraphicsSceneIndex::Entry>
+GeoGraphicsSceneIndex::remove(const QVector<GeoGraphicsItemPtr> &items)
+{
+    QVector<Entry> result;
+    QMap<int, QVector<QSharedPointer<Entry> > > layerEntries;
+
+    foreach(const GeoGraphicsItemPtr &item, items)
+    {
+        const int shard = entryShard(item);
+        if(!d->m_entries.at(shard).contains(item))
+        {
+            continue;
+        }
+
+        const QSharedPointer<Entry> entry = d->m_entries[shard].take(item);
+        layerEntries[entry->zLevel].append(entry);
+        --d->m_size;
+    }
+
+    auto it = layerEntries.constBegin();
+    auto itEnd = layerEntries.constEnd();
+    for(; it != itEnd; ++it)
+    {
+        auto itLayer = d->m_layers.find(it.key());
+
+        // Reading through constData() keeps a layer shared with a copy from being copied just to be rebuilt.
+        if(itLayer != d->m_layers.end() && std::size_t(it.value().size()) * 2 >= itLayer.value().constData()->size())
+        {
+            QSet<const Entry*> removed;
+            removed.reserve(it.value().size());
+            foreach(const QSharedPointer<Entry> &entry, it.value())
+            {
+                removed.insert(entry.data());
+            }
+
+            std::vector<Value> values = itLayer.value().constData()->values();
+            values.erase(std::remove_if(values.begin(), values.end(), [&removed](const Value &value) { return removed.contains(value.second); }), values.end());
+
+            if(values.empty())
+            {
+                d->m_layers.erase(itLayer);
+            }
+            else
+            {
+                itLayer.value() = QSharedDataPointer<GeoGraphicsSceneIndexPrivate::Layer>(new GeoGraphicsSceneIndexPrivate::Layer(values.begin(), values.end()));
+            }
+        }
+        else if(itLayer != d->m_layers.end())
+        {
+            GeoGraphicsSceneIndexPrivate::Layer *layer = itLayer.value().data();
+            foreach(const QSharedPointer<Entry> &entry, it.value())
+            {
+                layer->remove(entry.data(), toBoxes(entry->box));
+            }
+
+            if(layer->size() == 0)
+            {
+                d->m_layers.erase(itLayer);
+            }
+        }
+
+        foreach(const QSharedPointer<Entry> &entry, it.value())
+        {
+            d->removePostings(entry.data());
+            result.append(*entry);
+        }
+    }
+
+    return result;
+}
+
+bool
+GeoGraphicsSceneIndex::contains(const GeoGraphicsItemPtr &item) const
+{
+    return !d->entry(item).isNull();
+}
+
+int
+GeoGraphicsSceneIndex::size() const
+{
+    return d->m_size;
+}
+
+void
+GeoGraphicsSceneIndex::clear()
+{
+    d->clear();
+}
+
+QVector<const GeoGraphicsSceneIndex::Entry*>
+GeoGraphicsSceneIndex::query(const GeoDataLatLonBox &box) const
+{
+    QVector<const Entry*> result;
+
+    const QVector<Box> boxes = toBoxes(box);
+
+    auto it = d->m_layers.constBegin();
+    auto itEnd = d->m_layers.constEnd();
+    for(; it != itEnd; ++it)
+    {
+        std::vector<Value> values;
+        foreach(const Box &queryBox, boxes)
+        {
+            it.value()->query(bgi::intersects(queryBox), std::back_inserter(values));
+        }
+
+        if(values.empty())
+        {
+            continue;
+        }
+
+        QVector<const Entry*> layerEntries;
+        layerEntries.reserve(int(values.size()));
+        for(const Value &value : values)
+        {
+            layerEntries.append(value.second);
+        }
+
+        // The tree order depends on its shape; drawing overlapping items of one z level in a fixed
+        // order keeps neighbouring tiles consistent. Both halves of a date line item may match.
+        std::sort(layerEntries.begin(), layerEntries.end(), lessSerial);
+        layerEntries.erase(std::unique(layerEntries.begin(), layerEntries.end()), layerEntries.end());
+
+        result += layerEntries;
+    }
+
+    return result;
+}
+
+QVector<const GeoGraphicsSceneIndex::Entry*>
+GeoGraphicsSceneIndex::query(const TileId &tileId) const
+{
+    const int level = tileId.tileLevel();
+    const quint64 code = TileCoverage::mortonCode(tileId.x(), tileId.y());
+
+    QVector<const Entry*> result;
+    if(const GeoGraphicsSceneIndexPrivate::PostingList *postings = GeoGraphicsSceneIndexPrivate::findPostings(d->m_tilePostings, level, code))
+    {
+        result = *postings;
+    }
+
+    // Entries keeping an ancestor cover the whole tile without being listed for it.
+    bool merge = false;
+    for(int tempLevel = qMin(level, d->m_leafPostings.size()) - 1; tempLevel >= 0; --tempLevel)
+    {
+        if(const GeoGraphicsSceneIndexPrivate::PostingList *postings = GeoGraphicsSceneIndexPrivate::findPostings(d->m_leafPostings, tempLevel, code >> (2 * (level - tempLevel))))
+        {
+            result += *postings;
+            merge = true;
+        }
+    }
+
+    if(merge)
+    {
+        std::sort(result.begin(), result.end(), lessZLevel);
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+    }
+
+    return result;
+}
+
+}
@@ -0,0 +1,123 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#ifndef MARBLE_GEOGRAPHICSSCENEINDEX_H
+#define MARBLE_GEOGRAPHICSSCENEINDEX_H
+
+#include <QtCore/QSharedDataPointer>
+#include <QtCore/QVector>
+
+#include "geodata/data/GeoDataLatLonBox.h"
+#include "graphicsview/GeoGraphicsItem.h"
+
+namespace Marble
+{
+
+class GeoGraphicsSceneIndexPrivate;
+
+/**
+ * The spatial index of the GeoGraphicsScene.
+ *
+ * Items are kept in one R-tree per z level, keyed by their bounding box.
+ * Boxes crossing the date line are stored as two halves, queries may cross
+ * it as well. Layers filled in one go are bulk loaded into a packed tree,
+ * later changes are inserted and removed dynamically.
+ *
+ * Next to the trees the index keeps posting lists from tiles to the entries
+ * drawn into them, so rendering a tile does not need to filter candidates.
+ *
+ * The index is implicitly shared. A copy is taken in constant time and
+ * stays unchanged while the original is modified. Entries and postings are
+ * split into shards, postings by their ancestor tile, and each tree keeps
+ * its changes apart from a packed base shared by all copies. Changing an
+ * item after taking a copy thus only copies the shards it touches and the
+ * recent changes of its z level, not the whole index. Copies may be handed
+ * to and queried from other threads.
+ */
+class GeoGraphicsSceneIndex
+{
+public:
+    struct Entry
+    {
+        GeoGraphicsItemPtr item;
+        TileCoverage tiles;
+
+        // the bounding box the item is indexed by, kept so it is removed by the same box
+        GeoDataLatLonBox box;
+        int zLevel;
+        quint64 serial;
+    };
+
+    GeoGraphicsSceneIndex();
+    GeoGraphicsSceneIndex(const GeoGraphicsSceneIndex &other);
+    ~GeoGraphicsSceneIndex();
+
+    GeoGraphicsSceneIndex &
+    operator=(const GeoGraphicsSceneIndex &other);
+
+    /**
+     * Adds @p item with its tile coverage, replacing an entry already kept
+     * for it.
+     */
+    void
+    insert(const GeoGraphicsItemPtr &item, int zLevel, const TileCoverage &tiles);
+
+    /**
+     * Adds many items at once. Z levels holding no items yet are packed
+     * in a single pass instead of growing the tree item by item. An item
+     * may only appear once in @p entries.
+     */
+    void
+    insert(const QVector<Entry> &entries);
+
+    /**
+     * Removes @p item and hands out its tile coverage in @p tiles.
+     * Returns false if the item is not indexed.
+     */
+    bool
+    remove(const GeoGraphicsItemPtr &item, TileCoverage &tiles);
+
+    /**
+     * Removes all of @p items and returns their entries. Z levels losing
+     * most of their items are packed again instead of shrinking item by item.
+     */
+    QVector<Entry>
+    remove(const QVector<GeoGraphicsItemPtr> &items);
+
+    bool
+    contains(const GeoGraphicsItemPtr &item) const;
+
+    int
+    size() const;
+
+    void
+    clear();
+
+    /**
+     * Returns the entries whose bounding box intersects @p box, in ascending
+     * z order and in insertion order within a z level. The entries stay
+     * valid until this copy of the index is modified or destroyed.
+     */
+    QVector<const Entry*>
+    query(const GeoDataLatLonBox &box) const;
+
+    /**
+     * Returns the entries whose tile coverage touches @p tileId, either by
+     * a tile within it or by one of its ancestors, in the same order as the
+     * bounding box query.
+     */
+    QVector<const Entry*>
+    query(const TileId &tileId) const;
+
+private:
+    QSharedDataPointer<GeoGraphicsSceneIndexPrivate> d;
+};
+
+}
+
+#endif // MARBLE_GEOGRAPHICSSCENEINDEX_H
@@ -471,6 +471,11 @@ void GeoPainter::drawPolygon ( const GeoDataPolygon & polygon,
 
             // Create the inner screen polygons
             foreach( const GeoDataLinearRing& itInnerBoundary, innerBoundaries ) {
+                if ( d->m_viewport->isCancelled() ) {
+                    setPen( oldPen );
+                    return;
+                }
+
                 QVector<QPolygonF> innerPolygonsPerBoundary;
 
                 d->m_viewport->screenCoordinates( itInnerBoundary, innerPolygonsPerBoundary );
@@ -0,0 +1,587 @@
+#define QT_NO_DEBUG_OUTPUT
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#include "GeometryTileStore.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSet>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QTemporaryFile>
+
+namespace
+{
+
+const qint64 SegmentSize = 64 * 1024 * 1024;
+
+// A full segment is compacted once its entries fill less than this share of it.
+const qreal MinLiveFraction = 0.25;
+
+typedef QPair<Marble::TileId, int /* layer */> EntryKey;
+
+// keeps entries 16 byte aligned for the scanline readers
+qint64
+alignedLength(qint64 length)
+{
+    return (length + 15) & ~qint64(15);
+}
+
+struct Segment
+{
+    Segment()
+        :   file(QDir::tempPath() + QStringLiteral("/marble_tiles_XXXXXX.seg")),
+            data(nullptr),
+            size(0),
+            used(0),
+            storedBytes(0)
+    {
+    }
+
+    ~Segment()
+    {
+        if(data)
+        {
+            file.unmap(data);
+        }
+    }
+
+    /// Hands out a free range of @p length bytes, returns -1 if none is large enough.
+    qint64
+    take(qint64 length)
+    {
+        QMutexLocker locker(&freeMutex);
+
+        for(auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+        {
+            if(it.value() < length)
+            {
+                continue;
+            }
+
+            const qint64 offset = it.key();
+            const qint64 rest = it.value() - length;
+            freeRanges.erase(it);
+
+            if(rest > 0)
+            {
+                freeRanges.insert(offset + length, rest);
+            }
+
+            return offset;
+        }
+
+        return -1;
+    }
+
+    /// Returns a range nothing refers to any more, merging it with free neighbours.
+    void
+    free(qint64 offset, qint64 length)
+    {
+        QMutexLocker locker(&freeMutex);
+
+        auto itNext = freeRanges.lowerBound(offset);
+        if(itNext != freeRanges.end() && offset + length == itNext.key())
+        {
+            length += itNext.value();
+            itNext = freeRanges.erase(itNext);
+        }
+
+        if(itNext != freeRanges.begin())
+        {
+            auto itPrevious = itNext - 1;
+            if(itPrevious.key() + itPrevious.value() == offset)
+            {
+                itPrevious.value() += length;
+                return;
+            }
+        }
+
+        freeRanges.insert(offset, length);
+    }
+
+    QTemporaryFile file;
+    uchar *data;
+    qint64 size;
+    qint64 used;
+
+    // the bytes and the keys of the entries the store keeps in the segment, guarded by the store mutex
+    qint64 storedBytes;
+    QSet<EntryKey> entries;
+
+    // Ranges are freed by the last image reading from them, on any thread.
+    QMutex freeMutex;
+    QMap<qint64 /* offset */, qint64 /* length */> freeRanges;
+};
+
+typedef QSharedPointer<Segment> SegmentPtr;
+
+// Space in a segment, returned to it once neither the store nor an image refers to it.
+struct Range
+{
+    SegmentPtr segment;
+    qint64 offset;
+    qint64 length;
+};
+
+typedef QSharedPointer<Range> RangePtr;
+
+void
+freeRange(Range *range)
+{
+    range->segment->free(range->offset, range->length);
+    delete range;
+}
+
+struct Entry
+{
+    // null for uniform entries, which only keep their color
+    RangePtr range;
+    qint64 length;
+    int width;
+    int height;
+    int bytesPerLine;
+    qreal devicePixelRatio;
+    bool compressed;
+    bool uniform;
+    QRgb color;
+};
+
+void
+releaseRange(void *info)
+{
+    delete static_cast<RangePtr*>(info);
+}
+
+}
+
+namespace Marble
+{
+
+class GeometryTileStorePrivate
+{
+public:
+    explicit GeometryTileStorePrivate(GeometryTileStore::Compression compression)
+        :   m_compression(compression),
+            m_byteCount(0)
+    {
+    }
+
+    RangePtr
+    allocate(qint64 length);
+
+    void
+    release(const EntryKey &key, const Entry &entry);
+
+    void
+    compact(const SegmentPtr &segment);
+
+    void
+    removeEntry(const TileId &tileId, int layer);
+
+    QImage
+    image(const TileId &tileId, const Entry &entry) const;
+
+    const GeometryTileStore::Compression m_compression;
+    QHash<TileId, QMap<int /* layer */, Entry> > m_tiles;
+
+    // the segments new entries may go to, the current one is filled up at its end
+    QList<SegmentPtr> m_segments;
+    SegmentPtr m_currentSegment;
+
+    qint64 m_byteCount;
+    mutable QMutex m_mutex;
+};
+
+RangePtr
+GeometryTileStorePrivate::allocate(qint64 length)
+{
+    length = alignedLength(length);
+
+    // Space of replaced and removed tiles goes first, so the files don't grow while tiles are rendered again.
+    SegmentPtr segment;
+    qint64 offset = -1;
+    foreach(const SegmentPtr &tempSegment, m_segments)
+    {
+        offset = tempSegment->take(length);
+        if(offset >= 0)
+        {
+            segment = tempSegment;
+            break;
+        }
+    }
+
+    if(!segment && m_currentSegment && m_currentSegment->used + length <= m_currentSegment->size)
+    {
+        segment = m_currentSegment;
+        offset = segment->used;
+        segment->used += length;
+    }
+
+    if(!segment)
+    {
+        // Older segments stay alive as long as entries or handed out images refer to them.
+        segment = SegmentPtr(new Segment);
+        segment->size = qMax(SegmentSize, length);
+
+        if(!segment->file.open() || !segment->file.resize(segment->size))
+        {
+            qWarning() << "GeometryTileStore: unable to create segment" << segment->file.fileName() << segment->file.errorString();
+            return RangePtr();
+        }
+
+        segment->data = segment->file.map(0, segment->size);
+        if(!segment->data)
+        {
+            qWarning() << "GeometryTileStore: unable to map segment" << segment->file.fileName() << segment->file.errorString();
+            return RangePtr();
+        }
+
+        m_segments.append(segment);
+        m_currentSegment = segment;
+
+        offset = 0;
+        segment->used = length;
+    }
+
+    segment->storedBytes += length;
+
+    Range *range = new Range;
+    range->segment = segment;
+    range->offset = offset;
+    range->length = length;
+
+    return RangePtr(range, freeRange);
+}
+
+void
+GeometryTileStorePrivate::release(const EntryKey &key, const Entry &entry)
+{
+    m_byteCount -= entry.length;
+
+    if(!entry.range)
+    {
+        return;
+    }
+
+    const SegmentPtr segment = entry.range->segment;
+    segment->storedBytes -= entry.range->length;
+    segment->entries.remove(key);
+
+    // Free ranges may be too small for the tiles to come, a sparse segment is emptied instead.
+    if(segment != m_currentSegment && segment->storedBytes < MinLiveFraction * segment->used && m_segments.contains(segment))
+    {
+        compact(segment);
+    }
+}
+
+void
+GeometryTileStorePrivate::compact(const SegmentPtr &segment)
+{
+    m_segments.removeOne(segment);
+
+    bool moved = true;
+    foreach(const EntryKey &key, segment->entries)
+    {
+        Entry &entry = m_tiles[key.first][key.second];
+
+        const RangePtr range = allocate(entry.length);
+        if(!range)
+        {
+            moved = false;
+            continue;
+        }
+
+        // Images still reading the old range keep it until they are released.
+        memcpy(range->segment->data + range->offset, segment->data + entry.range->offset, entry.length);
+        segment->storedBytes -= entry.range->length;
+        segment->entries.remove(key);
+        range->segment->entries.insert(key);
+        entry.range = range;
+    }
+
+    if(!moved)
+    {
+        m_segments.append(segment);
+    }
+
+    qDebug() << "GeometryTileStore: compacted segment" << segment->file.fileName() << moved;
+}
+
+void
+GeometryTileStorePrivate::removeEntry(const TileId &tileId, int layer)
+{
+    auto it = m_tiles.find(tileId);
+    if(it == m_tiles.end())
+    {
+        return;
+    }
+
+    auto itLayer = it.value().find(layer);
+    if(itLayer == it.value().end())
+    {
+        return;
+    }
+
+    // taken out first, so that compacting doesn't move the entry
+    const Entry entry = itLayer.value();
+    it.value().erase(itLayer);
+
+    if(it.value().isEmpty())
+    {
+        m_tiles.erase(it);
+    }
+
+    release(EntryKey(tileId, layer), entry);
+}
+
+QImage
+GeometryTileStorePrivate::image(const TileId &tileId, const Entry &entry) const
+{
+    QImage image;
+    if(entry.uniform)
+    {
+        image = QImage(entry.width, entry.height, QImage::Format_ARGB32_Premultiplied);
+        image.fill(entry.color);
+        image.setDevicePixelRatio(entry.devicePixelRatio);
+        return image;
+    }
+
+    const uchar *data = entry.range->segment->data + entry.range->offset;
+
+    if(entry.compressed)
+    {
+        const QByteArray bits = qUncompress(data, entry.length);
+        if(bits.size() != entry.bytesPerLine * entry.height)
+        {
+            qWarning() << "GeometryTileStore: corrupt tile" << tileId.tileLevel() << tileId.x() << tileId.y();
+            return QImage();
+        }
+
+        image = QImage(entry.width, entry.height, QImage::Format_ARGB32_Premultiplied);
+        memcpy(image.bits(), bits.constData(), bits.size());
+    }
+    else
+    {
+        // The image reads straight from the mapping and keeps its range from being reused.
+        image = QImage(data, entry.width, entry.height, entry.bytesPerLine, QImage::Format_ARGB32_Premultiplied,
+                       releaseRange, new RangePtr(entry.range));
+    }
+
+    image.setDevicePixelRatio(entry.devicePixelRatio);
+    return image;
+}
+
+GeometryTileStore::GeometryTileStore(Compression compression)
+    :   d(new GeometryTileStorePrivate(compression))
+{
+}
+
+GeometryTileStore::~GeometryTileStore()
+{
+    delete d;
+}
+
+GeometryTileStore::Compression
+GeometryTileStore::compression() const
+{
+    return d->m_compression;
+}
+
+QByteArray
+GeometryTileStore::compress(const QImage &image)
+{
+    return qCompress(image.constBits(), image.byteCount(), 1);
+}
+
+bool
+GeometryTileStore::insert(const TileId &tileId, const QImage &image, const QByteArray &compressedBits, int layer)
+{
+    if(image.isNull())
+    {
+        return false;
+    }
+
+    QImage tile = image;
+    if(tile.format() != QImage::Format_ARGB32_Premultiplied)
+    {
+        tile = tile.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+
+    QByteArray compressed;
+    if(d->m_compression == ZlibCompression)
+    {
+        compressed = compressedBits.isEmpty() ? compress(tile) : compressedBits;
+    }
+
+    const uchar *source = compressed.isEmpty() ? tile.constBits() : reinterpret_cast<const uchar*>(compressed.constData());
+    const qint64 length = compressed.isEmpty() ? tile.byteCount() : compressed.size();
+
+    QMutexLocker locker(&d->m_mutex);
+
+    d->removeEntry(tileId, layer);
+
+    const RangePtr range = d->allocate(length);
+    if(!range)
+    {
+        return false;
+    }
+
+    Entry entry;
+    entry.range = range;
+    entry.length = length;
+    entry.width = tile.width();
+    entry.height = tile.height();
+    entry.bytesPerLine = tile.bytesPerLine();
+    entry.devicePixelRatio = tile.devicePixelRatio();
+    entry.compressed = !compressed.isEmpty();
+    entry.uniform = false;
+    entry.color = 0;
+
+    memcpy(range->segment->data + range->offset, source, length);
+    range->segment->entries.insert(EntryKey(tileId, layer));
+
+    d->m_byteCount += length;
+    d->m_tiles[tileId].insert(layer, entry);
+
+    return true;
+}
+
+bool
+GeometryTileStore::insertUniform(const TileId &tileId, const QSize &size, QRgb color, qreal devicePixelRatio, int layer)
+{
+    if(size.isEmpty())
+    {
+        return false;
+    }
+
+    Entry entry;
+    entry.length = 0;
+    entry.width = size.width();
+    entry.height = size.height();
+    entry.bytesPerLine = 0;
+    entry.devicePixelRatio = devicePixelRatio;
+    entry.compressed = false;
+    entry.uniform = true;
+    entry.color = color;
+
+    QMutexLocker locker(&d->m_mutex);
+
+    d->removeEntry(tileId, layer);
+    d->m_tiles[tileId].insert(layer, entry);
+
+    return true;
+}
+
+QImage
+GeometryTileStore::load(const TileId &tileId, int layer) const
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    auto it = d->m_tiles.constFind(tileId);
+    if(it == d->m_tiles.constEnd() || !it.value().contains(layer))
+    {
+        return QImage();
+    }
+
+    return d->image(tileId, it.value().value(layer));
+}
+
+SparseTileImage
+GeometryTileStore::loadSparse(const TileId &tileId, int layer) const
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    auto it = d->m_tiles.constFind(tileId);
+    if(it == d->m_tiles.constEnd() || !it.value().contains(layer))
+    {
+        return SparseTileImage();
+    }
+
+    const Entry entry = it.value().value(layer);
+    if(entry.uniform)
+    {
+        return SparseTileImage::uniform(QSize(entry.width, entry.height), entry.color, entry.devicePixelRatio);
+    }
+
+    return SparseTileImage(d->image(tileId, entry));
+}
+
+bool
+GeometryTileStore::contains(const TileId &tileId, int layer) const
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    auto it = d->m_tiles.constFind(tileId);
+    return it != d->m_tiles.constEnd() && it.value().contains(layer);
+}
+
+void
+GeometryTileStore::remove(const TileId &tileId)
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    // taken out first, so that compacting doesn't move the entries
+    const QMap<int, Entry> entries = d->m_tiles.take(tileId);
+    for(auto it = entries.begin(); it != entries.end(); ++it)
+    {
+        d->release(EntryKey(tileId, it.key()), it.value());
+    }
+}
+
+void
+GeometryTileStore::remove(const TileId &tileId, int layer)
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    d->removeEntry(tileId, layer);
+}
+
+QList<int>
+GeometryTileStore::layers(const TileId &tileId) const
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    QList<int> result = d->m_tiles.value(tileId).keys();
+    result.removeOne(CompositeLayer);
+
+    return result;
+}
+
+QList<TileId>
+GeometryTileStore::tileIds() const
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    return d->m_tiles.keys();
+}
+
+void
+GeometryTileStore::clear()
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    d->m_tiles.clear();
+    d->m_segments.clear();
+    d->m_currentSegment.clear();
+    d->m_byteCount = 0;
+}
+
+qint64
+GeometryTileStore::byteCount() const
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    return d->m_byteCount;
+}
+
+}
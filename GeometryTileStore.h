@@ -0,0 +1,143 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#ifndef MARBLE_GEOMETRYTILESTORE_H
+#define MARBLE_GEOMETRYTILESTORE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QMetaType>
+#include <QtGui/QImage>
+
+#include <climits>
+
+#include "SparseTileImage.h"
+#include "TileId.h"
+
+namespace Marble
+{
+
+class GeometryTileStorePrivate;
+
+/**
+ * A rendered z level sublayer of a geometry tile, along with its compressed
+ * pixels when the store compresses.
+ */
+struct GeometryTileLayer
+{
+    QImage image;
+    QByteArray compressedBits;
+};
+
+typedef QMap<int /* z level */, GeometryTileLayer> GeometryTileLayers;
+
+/**
+ * Backing store for rendered geometry tiles.
+ *
+ * Tiles are kept as raw premultiplied ARGB32 pixels (or zlib compressed
+ * pixels) in memory-mapped segment files. The index lives in memory, so
+ * lookups never touch the filesystem, and uncompressed tiles are handed
+ * out as QImages that point straight into the mapping.
+ *
+ * Each tile has a composited image and may additionally keep its z level
+ * sublayers, so that a change to one z level does not require rendering
+ * the others again.
+ *
+ * Tiles of a single colour keep only that colour, no pixels at all.
+ *
+ * The space of replaced and removed tiles is reused once no handed out
+ * image reads from it any more. Segments left mostly empty are compacted,
+ * their remaining tiles are moved and the file goes with its last image.
+ */
+class GeometryTileStore
+{
+public:
+    enum Compression
+    {
+        NoCompression,
+        ZlibCompression
+    };
+
+    /// The layer key of the composited tile image.
+    static const int CompositeLayer = INT_MIN;
+
+    explicit GeometryTileStore(Compression compression = NoCompression);
+    ~GeometryTileStore();
+
+    Compression
+    compression() const;
+
+    /**
+     * Compresses the pixels of @p image for a later insert(). This is the
+     * expensive part of storing a compressed tile and is meant to be called
+     * from the render thread.
+     */
+    static QByteArray
+    compress(const QImage &image);
+
+    /**
+     * Stores @p image as @p layer of @p tileId, replacing any previous entry. If the
+     * store is compressing and @p compressedBits is empty the pixels are compressed here.
+     */
+    bool
+    insert(const TileId &tileId, const QImage &image, const QByteArray &compressedBits = QByteArray(), int layer = CompositeLayer);
+
+    /**
+     * Stores @p layer of @p tileId as @p size device pixels of the
+     * premultiplied @p color, replacing any previous entry.
+     */
+    bool
+    insertUniform(const TileId &tileId, const QSize &size, QRgb color, qreal devicePixelRatio, int layer = CompositeLayer);
+
+    /// Loads @p layer of @p tileId, tiles stored uniform are filled into a new image.
+    QImage
+    load(const TileId &tileId, int layer = CompositeLayer) const;
+
+    /// Loads @p layer of @p tileId, tiles stored uniform are handed out without any pixels.
+    SparseTileImage
+    loadSparse(const TileId &tileId, int layer = CompositeLayer) const;
+
+    bool
+    contains(const TileId &tileId, int layer = CompositeLayer) const;
+
+    /**
+     * Removes the composited image and all sublayers of @p tileId.
+     */
+    void
+    remove(const TileId &tileId);
+
+    void
+    remove(const TileId &tileId, int layer);
+
+    /**
+     * Returns the z levels of the sublayers stored for @p tileId.
+     */
+    QList<int>
+    layers(const TileId &tileId) const;
+
+    QList<TileId>
+    tileIds() const;
+
+    void
+    clear();
+
+    qint64
+    byteCount() const;
+
+private:
+    Q_DISABLE_COPY(GeometryTileStore)
+
+    GeometryTileStorePrivate *d;
+};
+
+}
+
+Q_DECLARE_METATYPE( Marble::GeometryTileLayers )
+
+#endif // MARBLE_GEOMETRYTILESTORE_H
@@ -166,6 +166,12 @@ StackedTile *MergedLayerDecorator::Private::createTile( const QVector<QSharedPoi
     const TileId firstId = tiles.first()->id();
     const TileId id( 0, firstId.tileLevel(), firstId.x(), firstId.y() );
 
+    // A single sparse tile is sampled as it is, merging it would expand it to a full image.
+    const bool paintsOnTile = ( m_showSunShading && !m_showCityLights ) || m_showTileId;
+    if ( tiles.count() == 1 && tiles.first()->isSparse() && !tiles.first()->blending() && !paintsOnTile ) {
+        return new StackedTile( id, tiles.first()->sparseImage(), tiles );
+    }
+
     // Image for blending all the texture tiles on it
     QImage resultImage;
 
@@ -228,7 +234,7 @@ StackedTile *MergedLayerDecorator::loadTile( const TileId &stackedTileId )
         }
 
         const GeoSceneTextureTileDataset *const textureLayer = static_cast<const GeoSceneTextureTileDataset *>( layer );
-        const QImage tileImage = d->m_tileLoader->loadTileImage( textureLayer, tileId, DownloadBrowse );
+        const SparseTileImage tileImage = d->m_tileLoader->loadSparseTileImage( textureLayer, tileId, DownloadBrowse );
 
         QSharedPointer<TextureTile> tile( new TextureTile( tileId, tileImage, blending ) );
         tiles.append( tile );
@@ -245,6 +251,11 @@ bool MergedLayerDecorator::hasTextureLayer() const
 }
 
 StackedTile *MergedLayerDecorator::updateTile( const StackedTile &stackedTile, const TileId &tileId, const QImage &tileImage )
+{
+    return updateTile( stackedTile, tileId, SparseTileImage( tileImage ) );
+}
+
+StackedTile *MergedLayerDecorator::updateTile( const StackedTile &stackedTile, const TileId &tileId, const SparseTileImage &tileImage )
 {
     Q_ASSERT( !tileImage.isNull() );
 
@@ -29,6 +29,7 @@ class QString;
 namespace Marble
 {
 
+class SparseTileImage;
 class SunLocator;
 class StackedTile;
 class Tile;
@@ -67,6 +68,7 @@ class MergedLayerDecorator
     StackedTile *loadTile( const TileId &id );
 
     StackedTile *updateTile( const StackedTile &stackedTile, const TileId &tileId, const QImage &tileImage );
+    StackedTile *updateTile( const StackedTile &stackedTile, const TileId &tileId, const SparseTileImage &tileImage );
 
     void downloadStackedTile( const TileId &id, DownloadUsage usage );
 
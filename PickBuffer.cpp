@@ -0,0 +1,158 @@
+#define QT_NO_DEBUG_OUTPUT
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#include "PickBuffer.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QtMath>
+
+#include "MarbleMath.h"
+#include "TileId.h"
+#include "geodata/data/GeoDataLatLonBox.h"
+#include "geodata/scene/GeoSceneTileDataset.h"
+
+namespace
+{
+
+const QRgb IdMask = 0x00ffffff;
+
+}
+
+namespace Marble
+{
+
+PickBuffer::PickBuffer()
+    :   m_sceneVersion(0)
+{
+}
+
+PickBuffer::PickBuffer(const QImage &ids, const QVector<QWeakPointer<GeoGraphicsItem> > &items, const QSize &tileSize, quint64 sceneVersion)
+    :   m_ids(ids),
+        m_items(items),
+        m_tileSize(tileSize),
+        m_sceneVersion(sceneVersion)
+{
+}
+
+PickBuffer
+PickBuffer::empty(const QSize &tileSize, quint64 sceneVersion)
+{
+    QImage ids(1, 1, QImage::Format_RGB32);
+    ids.fill(idColor(0));
+
+    return PickBuffer(ids, QVector<QWeakPointer<GeoGraphicsItem> >(), tileSize, sceneVersion);
+}
+
+bool
+PickBuffer::isNull() const
+{
+    return m_ids.isNull() || m_tileSize.isEmpty();
+}
+
+int
+PickBuffer::byteCount() const
+{
+    return m_ids.byteCount() + m_items.size() * int(sizeof(QWeakPointer<GeoGraphicsItem>));
+}
+
+quint64
+PickBuffer::sceneVersion() const
+{
+    return m_sceneVersion;
+}
+
+PickBuffer::Hit
+PickBuffer::pick(const QPointF &pixel, int radius, QList<GeoGraphicsItemPtr> &items) const
+{
+    if(isNull())
+    {
+        return Unknown;
+    }
+
+    const int x = int(pixel.x() * m_ids.width() / m_tileSize.width());
+    const int y = int(pixel.y() * m_ids.height() / m_tileSize.height());
+    if(x < 0 || y < 0 || x >= m_ids.width() || y >= m_ids.height())
+    {
+        return Unknown;
+    }
+
+    // Items are widened by the pick radius, an empty pixel means none is near.
+    if((reinterpret_cast<const QRgb*>(m_ids.constScanLine(y))[x] & IdMask) == 0)
+    {
+        return Nothing;
+    }
+
+    const int radiusX = qCeil(double(radius) * m_ids.width() / m_tileSize.width());
+    const int radiusY = qCeil(double(radius) * m_ids.height() / m_tileSize.height());
+
+    // The topmost item at the position goes first, then those visible around it.
+    QVector<int> ids;
+    ids.append(int(reinterpret_cast<const QRgb*>(m_ids.constScanLine(y))[x] & IdMask));
+
+    for(int tempY = qMax(0, y - radiusY); tempY <= qMin(m_ids.height() - 1, y + radiusY); ++tempY)
+    {
+        const QRgb *line = reinterpret_cast<const QRgb*>(m_ids.constScanLine(tempY));
+        for(int tempX = qMax(0, x - radiusX); tempX <= qMin(m_ids.width() - 1, x + radiusX); ++tempX)
+        {
+            const int id = int(line[tempX] & IdMask);
+            if(id != 0 && !ids.contains(id))
+            {
+                ids.append(id);
+            }
+        }
+    }
+
+    items.clear();
+    foreach(int id, ids)
+    {
+        if(id > m_items.size())
+        {
+            qWarning() << "PickBuffer::pick invalid id" << id << m_items.size();
+            return Unknown;
+        }
+
+        const GeoGraphicsItemPtr item = m_items.at(id - 1).toStrongRef();
+        if(!item)
+        {
+            return Unknown;
+        }
+
+        items.append(item);
+    }
+
+    return Item;
+}
+
+QPointF
+PickBuffer::tilePixel(const GeoSceneTileDataset *tileData, const TileId &tileId, double lon, double lat)
+{
+    const GeoDataLatLonBox box = tileId.toLatLonBox(tileData);
+    const QSize size = tileData->tileSize();
+
+    double north, south, east, west;
+    box.boundaries(north, south, east, west);
+
+    const double x = (lon - west) / (east - west) * size.width();
+
+    if(tileData->projection() == GeoSceneTileDataset::Mercator)
+    {
+        const double top = gdInv(north);
+        return QPointF(x, (top - gdInv(lat)) / (top - gdInv(south)) * size.height());
+    }
+
+    return QPointF(x, (north - lat) / (north - south) * size.height());
+}
+
+QRgb
+PickBuffer::idColor(int id)
+{
+    return qRgb(0, 0, 0) | (QRgb(id) & IdMask);
+}
+
+}
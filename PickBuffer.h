@@ -0,0 +1,100 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#ifndef MARBLE_PICKBUFFER_H
+#define MARBLE_PICKBUFFER_H
+
+#include <QtCore/QList>
+#include <QtCore/QMetaType>
+#include <QtCore/QPointF>
+#include <QtCore/QSize>
+#include <QtCore/QVector>
+#include <QtCore/QWeakPointer>
+#include <QtGui/QImage>
+
+#include "graphicsview/GeoGraphicsItem.h"
+
+namespace Marble
+{
+
+class GeoSceneTileDataset;
+class TileId;
+
+/**
+ * Tells which item is drawn where in a geometry tile.
+ *
+ * Each pixel of the id image holds the id of the topmost item drawn there,
+ * 0 where there is none. The items are widened by the pick radius, so an
+ * empty pixel means no item is near. The image may be smaller than the tile,
+ * positions are given in tile pixels either way.
+ *
+ * Items are referenced weakly; an item removed from the scene since the
+ * buffer was rendered is reported as unknown. The buffer keeps the scene
+ * version its items were taken at, so it can be told apart from changes
+ * not yet rendered.
+ *
+ * As only the topmost item of each pixel is kept, the buffer narrows down
+ * the candidates near a position rather than choosing among them.
+ */
+class PickBuffer
+{
+public:
+    enum Hit
+    {
+        Unknown,    ///< the buffer can't tell, e.g. it is null or the item is gone
+        Nothing,    ///< no item is drawn near the position
+        Item        ///< the items drawn near the position are known
+    };
+
+    PickBuffer();
+
+    /// @p items holds the item of id i at index i - 1.
+    PickBuffer(const QImage &ids, const QVector<QWeakPointer<GeoGraphicsItem> > &items, const QSize &tileSize, quint64 sceneVersion);
+
+    /// Returns a buffer of a tile without any items.
+    static PickBuffer
+    empty(const QSize &tileSize, quint64 sceneVersion);
+
+    bool
+    isNull() const;
+
+    int
+    byteCount() const;
+
+    /// Returns the version of the scene the items were taken from.
+    quint64
+    sceneVersion() const;
+
+    /**
+     * Looks up the position @p pixel of the tile. If an item is drawn there,
+     * hands out in @p items every item drawn within @p radius tile pixels
+     * around it, the topmost one at the position first.
+     */
+    Hit
+    pick(const QPointF &pixel, int radius, QList<GeoGraphicsItemPtr> &items) const;
+
+    /// Returns the position of @p lon, @p lat in radian in the pixels of @p tileId.
+    static QPointF
+    tilePixel(const GeoSceneTileDataset *tileData, const TileId &tileId, double lon, double lat);
+
+    /// Returns the color items of @p id are painted with into the id image.
+    static QRgb
+    idColor(int id);
+
+private:
+    QImage m_ids;
+    QVector<QWeakPointer<GeoGraphicsItem> > m_items;
+    QSize m_tileSize;
+    quint64 m_sceneVersion;
+};
+
+}
+
+Q_DECLARE_METATYPE( Marble::PickBuffer )
+
+#endif // MARBLE_PICKBUFFER_H
@@ -0,0 +1,369 @@
+#define QT_NO_DEBUG_OUTPUT
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#include "SparseTileImage.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QRectF>
+#include <QtGui/QColor>
+#include <QtGui/QPainter>
+
+#include <cstring>
+
+namespace Marble
+{
+
+SparseTileImage::SparseTileImage()
+    :   m_mode(Dense),
+        m_devicePixelRatio(1.0),
+        m_color(0),
+        m_blockColumns(0)
+{
+}
+
+SparseTileImage::SparseTileImage(const QImage &image)
+    :   m_mode(Dense),
+        m_size(image.size()),
+        m_devicePixelRatio(image.devicePixelRatio()),
+        m_boundingRect(image.rect()),
+        m_color(0),
+        m_image(image),
+        m_blockColumns(0)
+{
+}
+
+SparseTileImage
+SparseTileImage::fromImage(const QImage &image)
+{
+    if(image.isNull())
+    {
+        return SparseTileImage();
+    }
+
+    QImage source = image;
+    if(source.format() != QImage::Format_ARGB32_Premultiplied)
+    {
+        source = source.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+
+    const int width = source.width();
+    const int height = source.height();
+    const int blockColumns = (width + BlockMask) >> BlockShift;
+    const int blockRows = (height + BlockMask) >> BlockShift;
+
+    QVector<bool> painted(blockColumns * blockRows, false);
+    const quint32 first = reinterpret_cast<const quint32*>(source.constScanLine(0))[0];
+    bool isUniform = true;
+
+    for(int y = 0; y < height; ++y)
+    {
+        const quint32 *line = reinterpret_cast<const quint32*>(source.constScanLine(y));
+        bool *paintedRow = painted.data() + (y >> BlockShift) * blockColumns;
+
+        for(int blockX = 0; blockX < blockColumns; ++blockX)
+        {
+            const int start = blockX << BlockShift;
+            const int end = qMin(start + BlockSize, width);
+
+            quint32 combined = 0;
+            quint32 difference = 0;
+            for(int x = start; x < end; ++x)
+            {
+                combined |= line[x];
+                difference |= line[x] ^ first;
+            }
+
+            if(combined)
+            {
+                paintedRow[blockX] = true;
+            }
+
+            if(difference)
+            {
+                isUniform = false;
+            }
+        }
+    }
+
+    if(isUniform)
+    {
+        return uniform(source.size(), first, source.devicePixelRatio());
+    }
+
+    int paintedCount = 0;
+    QRect boundingRect;
+    for(int i = 0; i < painted.size(); ++i)
+    {
+        if(painted.at(i))
+        {
+            ++paintedCount;
+            boundingRect |= QRect((i % blockColumns) << BlockShift, (i / blockColumns) << BlockShift, BlockSize, BlockSize);
+        }
+    }
+    boundingRect &= source.rect();
+
+    // Packing only pays off while most of the tile is transparent.
+    if(4 * paintedCount > 3 * painted.size())
+    {
+        SparseTileImage result(source);
+        result.m_boundingRect = boundingRect;
+        return result;
+    }
+
+    SparseTileImage result;
+    result.m_mode = Blocks;
+    result.m_size = source.size();
+    result.m_devicePixelRatio = source.devicePixelRatio();
+    result.m_boundingRect = boundingRect;
+    result.m_blockColumns = blockColumns;
+    result.m_blockIndex = QVector<int>(painted.size(), -1);
+
+    result.m_image = QImage(BlockStride, paintedCount * BlockStride, QImage::Format_ARGB32_Premultiplied);
+    result.m_image.fill(0);
+
+    int next = 0;
+    for(int i = 0; i < painted.size(); ++i)
+    {
+        if(!painted.at(i))
+        {
+            continue;
+        }
+
+        const int left = (i % blockColumns) << BlockShift;
+        const int top = (i / blockColumns) << BlockShift;
+        const int rows = qMin(BlockSize, height - top);
+        const int columns = qMin(BlockSize, width - left);
+
+        // The padding repeats the pixels around the block, so smooth scaling blends across its edges as in the full image.
+        for(int row = -BlockPadding; row < rows + BlockPadding; ++row)
+        {
+            const quint32 *sourceLine = reinterpret_cast<const quint32*>(source.constScanLine(qBound(0, top + row, height - 1)));
+            quint32 *line = reinterpret_cast<quint32*>(result.m_image.scanLine(next * BlockStride + BlockPadding + row)) + BlockPadding;
+
+            for(int column = -BlockPadding; column < columns + BlockPadding; ++column)
+            {
+                line[column] = sourceLine[qBound(0, left + column, width - 1)];
+            }
+        }
+
+        result.m_blockIndex[i] = next++;
+    }
+
+    qDebug() << "SparseTileImage::fromImage" << paintedCount << "of" << painted.size() << "blocks";
+
+    return result;
+}
+
+SparseTileImage
+SparseTileImage::uniform(const QSize &size, QRgb color, qreal devicePixelRatio)
+{
+    SparseTileImage result;
+    result.m_mode = Uniform;
+    result.m_size = size;
+    result.m_devicePixelRatio = devicePixelRatio;
+    result.m_color = color;
+
+    if(qAlpha(color) != 0)
+    {
+        result.m_boundingRect = QRect(QPoint(0, 0), size);
+    }
+
+    return result;
+}
+
+bool
+SparseTileImage::isNull() const
+{
+    return m_size.isEmpty();
+}
+
+bool
+SparseTileImage::isDense() const
+{
+    return m_mode == Dense;
+}
+
+bool
+SparseTileImage::isUniform() const
+{
+    return m_mode == Uniform;
+}
+
+QSize
+SparseTileImage::size() const
+{
+    return m_size;
+}
+
+qreal
+SparseTileImage::devicePixelRatio() const
+{
+    return m_devicePixelRatio;
+}
+
+QRect
+SparseTileImage::boundingRect() const
+{
+    return m_boundingRect;
+}
+
+QRgb
+SparseTileImage::uniformColor() const
+{
+    return m_color;
+}
+
+QImage
+SparseTileImage::denseImage() const
+{
+    return m_mode == Dense ? m_image : QImage();
+}
+
+int
+SparseTileImage::byteCount() const
+{
+    switch(m_mode)
+    {
+    case Dense:
+        return m_image.byteCount();
+    case Blocks:
+        return m_image.byteCount() + m_blockIndex.size() * int(sizeof(int));
+    case Uniform:
+        break;
+    }
+
+    // Uniform tiles still have to be accounted for, otherwise caches would never evict them.
+    return int(sizeof(SparseTileImage));
+}
+
+QImage
+SparseTileImage::toImage() const
+{
+    if(m_mode == Dense || isNull())
+    {
+        return m_image;
+    }
+
+    QImage image(m_size, QImage::Format_ARGB32_Premultiplied);
+
+    if(m_mode == Uniform)
+    {
+        image.fill(m_color);
+    }
+    else
+    {
+        image.fill(0);
+
+        for(int i = 0; i < m_blockIndex.size(); ++i)
+        {
+            const int block = m_blockIndex.at(i);
+            if(block < 0)
+            {
+                continue;
+            }
+
+            const int left = (i % m_blockColumns) << BlockShift;
+            const int top = (i / m_blockColumns) << BlockShift;
+            const int rows = qMin(BlockSize, m_size.height() - top);
+            const int bytes = qMin(BlockSize, m_size.width() - left) * 4;
+
+            for(int row = 0; row < rows; ++row)
+            {
+                memcpy(image.scanLine(top + row) + left * 4, m_image.constScanLine(block * BlockStride + BlockPadding + row) + BlockPadding * 4, bytes);
+            }
+        }
+    }
+
+    image.setDevicePixelRatio(m_devicePixelRatio);
+    return image;
+}
+
+void
+SparseTileImage::draw(QPainter *painter, const QRectF &target, const QRect &source) const
+{
+    if(isNull() || source.isEmpty())
+    {
+        return;
+    }
+
+    switch(m_mode)
+    {
+    case Dense:
+        painter->drawImage(target, m_image, QRectF(source));
+        return;
+    case Uniform:
+        if(qAlpha(m_color) != 0)
+        {
+            painter->fillRect(target, QColor::fromRgba(qUnpremultiply(m_color)));
+        }
+        return;
+    case Blocks:
+        break;
+    }
+
+    const qreal scaleX = target.width() / source.width();
+    const qreal scaleY = target.height() / source.height();
+    const int blockRows = m_blockIndex.size() / m_blockColumns;
+
+    const int firstColumn = qMax(0, source.left() >> BlockShift);
+    const int lastColumn = qMin(m_blockColumns - 1, source.right() >> BlockShift);
+    const int firstRow = qMax(0, source.top() >> BlockShift);
+    const int lastRow = qMin(blockRows - 1, source.bottom() >> BlockShift);
+
+    // Block edges are snapped to whole device pixels, so neighbouring blocks meet without an antialiased seam.
+    const QTransform transform = painter->deviceTransform();
+    const bool snap = transform.type() <= QTransform::TxScale;
+    const QTransform inverted = transform.inverted();
+
+    auto edgeX = [&](int x)
+    {
+        const qreal targetX = target.x() + (x - source.x()) * scaleX;
+        return snap ? inverted.map(QPointF(qRound(transform.map(QPointF(targetX, 0)).x()), 0)).x() : targetX;
+    };
+
+    auto edgeY = [&](int y)
+    {
+        const qreal targetY = target.y() + (y - source.y()) * scaleY;
+        return snap ? inverted.map(QPointF(0, qRound(transform.map(QPointF(0, targetY)).y()))).y() : targetY;
+    };
+
+    for(int blockY = firstRow; blockY <= lastRow; ++blockY)
+    {
+        for(int blockX = firstColumn; blockX <= lastColumn; ++blockX)
+        {
+            const int block = m_blockIndex.at(blockY * m_blockColumns + blockX);
+            if(block < 0)
+            {
+                continue;
+            }
+
+            const QRect blockRect = QRect(blockX << BlockShift, blockY << BlockShift, BlockSize, BlockSize) & source;
+            const QRect stripRect = blockRect.translated(BlockPadding - (blockX << BlockShift), block * BlockStride + BlockPadding - (blockY << BlockShift));
+            const QRectF targetRect(QPointF(edgeX(blockRect.left()), edgeY(blockRect.top())),
+                                    QPointF(edgeX(blockRect.right() + 1), edgeY(blockRect.bottom() + 1)));
+
+            painter->drawImage(targetRect, m_image, QRectF(stripRect));
+        }
+    }
+}
+
+QImage
+SparseTileImage::scaled(const QRect &source, const QSize &size) const
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+    draw(&painter, QRectF(QPointF(0, 0), QSizeF(size)), source);
+
+    return image;
+}
+
+}
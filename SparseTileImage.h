@@ -0,0 +1,164 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#ifndef MARBLE_SPARSETILEIMAGE_H
+#define MARBLE_SPARSETILEIMAGE_H
+
+#include <QtCore/QMetaType>
+#include <QtCore/QRect>
+#include <QtCore/QSize>
+#include <QtCore/QVector>
+#include <QtGui/QImage>
+
+class QPainter;
+class QRectF;
+
+namespace Marble
+{
+
+/**
+ * A tile image which only keeps the pixels that are actually painted.
+ *
+ * The tile is split into square blocks, fully transparent blocks are not
+ * stored at all and the remaining ones are packed into a narrow strip image.
+ * A tile of a single colour, e.g. one lying completely inside a filled
+ * polygon, is kept as that colour only. Tiles that are mostly painted stay
+ * dense. All representations can be sampled and drawn without expanding
+ * them to a full image.
+ */
+class SparseTileImage
+{
+public:
+    /// Creates a null image.
+    SparseTileImage();
+
+    /// Wraps @p image as it is, without looking at its pixels.
+    explicit SparseTileImage(const QImage &image);
+
+    /**
+     * Analyses the pixels of @p image and picks the smallest representation.
+     * This scans the whole image and is meant to be called from a render thread.
+     */
+    static SparseTileImage
+    fromImage(const QImage &image);
+
+    /// Creates a tile of @p size device pixels filled with the premultiplied @p color.
+    static SparseTileImage
+    uniform(const QSize &size, QRgb color, qreal devicePixelRatio = 1.0);
+
+    bool
+    isNull() const;
+
+    bool
+    isDense() const;
+
+    bool
+    isUniform() const;
+
+    /// The size in device pixels.
+    QSize
+    size() const;
+
+    qreal
+    devicePixelRatio() const;
+
+    /**
+     * The area holding non-transparent pixels, rounded to whole blocks
+     * for sparse tiles.
+     */
+    QRect
+    boundingRect() const;
+
+    QRgb
+    uniformColor() const;
+
+    /// The wrapped image of a dense tile, a null image otherwise.
+    QImage
+    denseImage() const;
+
+    int
+    byteCount() const;
+
+    /// Returns the premultiplied pixel at @p x, @p y.
+    QRgb
+    pixel(int x, int y) const;
+
+    /// Expands the tile to a full image, dense tiles are returned as they are.
+    QImage
+    toImage() const;
+
+    /**
+     * Draws the @p source part of the tile into @p target, skipping
+     * transparent blocks.
+     */
+    void
+    draw(QPainter *painter, const QRectF &target, const QRect &source) const;
+
+    /// Returns the @p source part of the tile scaled to @p size.
+    QImage
+    scaled(const QRect &source, const QSize &size) const;
+
+private:
+    enum Mode
+    {
+        Dense,
+        Blocks,
+        Uniform
+    };
+
+    static const int BlockShift = 6;
+    static const int BlockSize = 1 << BlockShift;
+    static const int BlockMask = BlockSize - 1;
+
+    // pixels repeated around each block in the strip, for smooth scaling across block edges
+    static const int BlockPadding = 1;
+    static const int BlockStride = BlockSize + 2 * BlockPadding;
+
+    Mode m_mode;
+    QSize m_size;
+    qreal m_devicePixelRatio;
+    QRect m_boundingRect;
+    QRgb m_color;
+
+    // the dense image, or the padded painted blocks stacked on top of each other
+    QImage m_image;
+
+    // row major, index of the block in m_image or -1 for a transparent block
+    QVector<int> m_blockIndex;
+    int m_blockColumns;
+};
+
+inline QRgb
+SparseTileImage::pixel(int x, int y) const
+{
+    switch(m_mode)
+    {
+    case Uniform:
+        return m_color;
+    case Blocks:
+    {
+        const int block = m_blockIndex.at((y >> BlockShift) * m_blockColumns + (x >> BlockShift));
+        if(block < 0)
+        {
+            return 0;
+        }
+
+        return reinterpret_cast<const QRgb*>(m_image.constScanLine(block * BlockStride + BlockPadding + (y & BlockMask)))[BlockPadding + (x & BlockMask)];
+    }
+    case Dense:
+        break;
+    }
+
+    return m_image.pixel(x, y);
+}
+
+}
+
+Q_DECLARE_METATYPE( Marble::SparseTileImage )
+
+#endif // MARBLE_SPARSETILEIMAGE_H
@@ -59,6 +59,8 @@ static const uchar **jumpTableFromQImage8( const QImage &img )
 StackedTile::StackedTile( const TileId &id, const QImage &resultImage, QVector<QSharedPointer<TextureTile> > const &tiles ) :
       Tile( id ),
       m_resultImage( resultImage ),
+      m_isSparse( false ),
+      m_size( resultImage.size() ),
       m_depth( resultImage.depth() ),
       m_isGrayscale( resultImage.isGrayscale() ),
       m_tiles( tiles ),
@@ -74,6 +76,22 @@ StackedTile::StackedTile( const TileId &id, const QImage &resultImage, QVector<Q
     }
 }
 
+StackedTile::StackedTile( const TileId &id, const SparseTileImage &resultImage, QVector<QSharedPointer<TextureTile> > const &tiles ) :
+      Tile( id ),
+      m_sparseImage( resultImage ),
+      m_isSparse( true ),
+      m_size( resultImage.size() ),
+      m_depth( 32 ),
+      m_isGrayscale( false ),
+      m_tiles( tiles ),
+      jumpTable8( nullptr ),
+      jumpTable32( nullptr ),
+      m_byteCount( resultImage.byteCount() + calcByteCount( QImage(), tiles ) ),
+      m_isUsed( false )
+{
+    Q_ASSERT( !tiles.isEmpty() );
+}
+
 StackedTile::~StackedTile()
 {
       delete [] jumpTable32;
@@ -82,6 +100,9 @@ StackedTile::~StackedTile()
 
 uint StackedTile::pixel( int x, int y ) const
 {
+    if ( m_isSparse )
+        return m_sparseImage.pixel( x, y );
+
     if ( m_depth == 8 ) {
         if ( m_isGrayscale )
             return (jumpTable8)[y][x];
@@ -107,7 +128,7 @@ uint StackedTile::pixelF( qreal x, qreal y, const QRgb& topLeftValue ) const
     qreal fY = y - iY;
 
     // Interpolation in y-direction
-    if ( ( iY + 1 ) < m_resultImage.height() ) {
+    if ( ( iY + 1 ) < m_size.height() ) {
 
         QRgb bottomLeftValue  =  pixel( iX, iY + 1 );
 // #define CHEAPHIGH
@@ -129,7 +150,7 @@ uint StackedTile::pixelF( qreal x, qreal y, const QRgb& topLeftValue ) const
 
 #endif
         // Interpolation in x-direction
-        if ( iX + 1 < m_resultImage.width() ) {
+        if ( iX + 1 < m_size.width() ) {
 
             qreal fX = x - iX;
 
@@ -183,7 +204,7 @@ uint StackedTile::pixelF( qreal x, qreal y, const QRgb& topLeftValue ) const
     }
     else {
         // Interpolation in x-direction
-        if ( iX + 1 < m_resultImage.width() ) {
+        if ( iX + 1 < m_size.width() ) {
 
             qreal fX = x - iX;
 
@@ -269,3 +290,18 @@ QImage const * StackedTile::resultImage() const
     return &m_resultImage;
 }
 
+bool StackedTile::isSparse() const
+{
+    return m_isSparse;
+}
+
+SparseTileImage const & StackedTile::sparseImage() const
+{
+    return m_sparseImage;
+}
+
+QSize StackedTile::size() const
+{
+    return m_size;
+}
+
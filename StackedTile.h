@@ -19,6 +19,7 @@
 #include <QtGui/QColor>
 #include <QImage>
 
+#include "SparseTileImage.h"
 #include "Tile.h"
 
 namespace Marble
@@ -57,6 +58,11 @@ class StackedTile : public Tile
 {
  public:
     explicit StackedTile( TileId const &id, QImage const &resultImage, QVector<QSharedPointer<TextureTile> > const &tiles );
+
+/*!
+    \brief Creates a tile that samples @p resultImage directly instead of a merged QImage
+*/
+    explicit StackedTile( TileId const &id, SparseTileImage const &resultImage, QVector<QSharedPointer<TextureTile> > const &tiles );
     ~StackedTile() override;
 
     void setUsed( bool used );
@@ -77,6 +83,18 @@ class StackedTile : public Tile
 */
     QImage const * resultImage() const;
 
+/*!
+    \brief Returns whether the tile is kept sparse, resultImage() is null in that case
+*/
+    bool isSparse() const;
+
+    SparseTileImage const & sparseImage() const;
+
+/*!
+    \brief Returns the size of the result tile in pixels
+*/
+    QSize size() const;
+
 /*!
     \brief Returns the color value of the result tile at the given integer position.
     \return The uint that describes the color value of the given pixel 
@@ -103,6 +121,9 @@ class StackedTile : public Tile
     Q_DISABLE_COPY( StackedTile )
 
     const QImage m_resultImage;
+    const SparseTileImage m_sparseImage;
+    const bool m_isSparse;
+    const QSize m_size;
     const int m_depth;
     const bool m_isGrayscale;
     const QVector<QSharedPointer<TextureTile> > m_tiles;
@@ -172,6 +172,11 @@ void StackedTileLoader::setVolatileCacheLimit( quint64 kiloBytes )
 }
 
 void StackedTileLoader::updateTile( TileId const &tileId, QImage const &tileImage )
+{
+    updateTile( tileId, SparseTileImage( tileImage ) );
+}
+
+void StackedTileLoader::updateTile( TileId const &tileId, SparseTileImage const &tileImage )
 {
     const TileId stackedTileId( 0, tileId.tileLevel(), tileId.x(), tileId.y() );
 
@@ -192,17 +197,28 @@ void StackedTileLoader::updateTile( TileId const &tileId, QImage const &tileImag
     }
 }
 
-void StackedTileLoader::setTileExpired(TileMap tileMap)
+QList<TileId> StackedTileLoader::setTileExpired(const TileCoverage &tiles)
 {
-    foreach(TileId tileId, d->m_tileCache.keys())
+    QWriteLocker locker(&d->m_cacheLock);
+
+    foreach(const TileId &tileId, d->m_tileCache.keys())
     {
-        if(tileMap.contains(tileId.tileLevel()) &&
-           tileMap[tileId.tileLevel()].contains(tileId.x()) &&
-           tileMap[tileId.tileLevel()][tileId.x()].contains(tileId.y()))
+        if(tiles.touches(tileId.tileLevel(), tileId.x(), tileId.y()))
         {
             d->m_tileCache.remove(tileId);
         }
     }
+
+    QList<TileId> displayedTiles;
+    for(auto it = d->m_tilesOnDisplay.constBegin(); it != d->m_tilesOnDisplay.constEnd(); ++it)
+    {
+        if(tiles.touches(it.key().tileLevel(), it.key().x(), it.key().y()))
+        {
+            displayedTiles.append(it.key());
+        }
+    }
+
+    return displayedTiles;
 }
 
 void StackedTileLoader::clear()
@@ -142,10 +142,16 @@ class StackedTileLoader : public QObject
         /**
          */
         void updateTile(TileId const & tileId, QImage const &tileImage );
+        void updateTile(TileId const & tileId, SparseTileImage const &tileImage );
 
 
-        void
-        setTileExpired(TileMap tileMap);
+        /**
+         * Drops the cached tiles touched by @p tiles, so they are loaded
+         * again when needed. Tiles on display are kept until updateTile()
+         * replaces them; the touched ones are returned.
+         */
+        QList<TileId>
+        setTileExpired(const TileCoverage &tiles);
 
     Q_SIGNALS:
         void tileLoaded( TileId const &tileId );
@@ -30,6 +30,16 @@ namespace Marble
 TextureTile::TextureTile( TileId const & tileId, QImage const & image, const Blending * blending )
     : Tile( tileId ),
       m_image( image ),
+      m_sparseImage( image ),
+      m_blending( blending )
+{
+    Q_ASSERT( !image.isNull() );
+}
+
+TextureTile::TextureTile( TileId const & tileId, SparseTileImage const & image, const Blending * blending )
+    : Tile( tileId ),
+      m_image( image.denseImage() ),
+      m_sparseImage( image ),
       m_blending( blending )
 {
     Q_ASSERT( !image.isNull() );
@@ -23,6 +23,7 @@ License along with this library. If not, see <http://www.gnu.org/licenses/>.
 #include <QDateTime>
 #include <QImage>
 
+#include "SparseTileImage.h"
 #include "Tile.h"
 #include "TileId.h"
 
@@ -61,6 +62,7 @@ class TextureTile : public Tile
 {
  public:
     TextureTile(TileId const & tileId, QImage const & image, const Blending * blending );
+    TextureTile(TileId const & tileId, SparseTileImage const & image, const Blending * blending );
     ~TextureTile() override;
 
 /*!
@@ -70,6 +72,15 @@ class TextureTile : public Tile
     QImage
     image() const;
 
+/*!
+    \brief Returns the image of the Tile without expanding a sparse tile
+*/
+    SparseTileImage
+    sparseImage() const;
+
+    bool
+    isSparse() const;
+
 /*!
     \brief Returns the kind of blending used for the texture tile.
     \return A pointer to the blending object used for painting/merging the Tile.
@@ -85,6 +96,7 @@ class TextureTile : public Tile
     Q_DISABLE_COPY( TextureTile )
 
     QImage const m_image;
+    SparseTileImage const m_sparseImage;
     Blending const * const m_blending;
 
 };
@@ -93,7 +105,22 @@ inline
 QImage
 TextureTile::image() const
 {
-    return m_image;
+    // only blendings and other texture layers need a sparse tile expanded
+    return m_image.isNull() ? m_sparseImage.toImage() : m_image;
+}
+
+inline
+SparseTileImage
+TextureTile::sparseImage() const
+{
+    return m_sparseImage;
+}
+
+inline
+bool
+TextureTile::isSparse() const
+{
+    return m_image.isNull();
 }
 
 inline Blending const * TextureTile::blending() const
@@ -103,7 +130,7 @@ inline Blending const * TextureTile::blending() const
 
 inline int TextureTile::byteCount() const
 {
-    return m_image.byteCount();
+    return isSparse() ? m_sparseImage.byteCount() : m_image.byteCount();
 }
 
 }
@@ -0,0 +1,518 @@
+#define QT_NO_DEBUG_OUTPUT
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#include "TileCoverage.h"
+
+#include <algorithm>
+
+namespace
+{
+
+const quint64 FullBit = Q_UINT64_C(1);
+const quint64 EvenBits = Q_UINT64_C(0x5555555555555555);
+const quint64 OddBits = Q_UINT64_C(0xAAAAAAAAAAAAAAAA);
+
+quint64
+spreadBits(quint32 value)
+{
+    quint64 bits = value;
+    bits = (bits | (bits << 16)) & Q_UINT64_C(0x0000FFFF0000FFFF);
+    bits = (bits | (bits << 8)) & Q_UINT64_C(0x00FF00FF00FF00FF);
+    bits = (bits | (bits << 4)) & Q_UINT64_C(0x0F0F0F0F0F0F0F0F);
+    bits = (bits | (bits << 2)) & Q_UINT64_C(0x3333333333333333);
+    bits = (bits | (bits << 1)) & EvenBits;
+    return bits;
+}
+
+quint32
+compactBits(quint64 bits)
+{
+    bits &= EvenBits;
+    bits = (bits | (bits >> 1)) & Q_UINT64_C(0x3333333333333333);
+    bits = (bits | (bits >> 2)) & Q_UINT64_C(0x0F0F0F0F0F0F0F0F);
+    bits = (bits | (bits >> 4)) & Q_UINT64_C(0x00FF00FF00FF00FF);
+    bits = (bits | (bits >> 8)) & Q_UINT64_C(0x0000FFFF0000FFFF);
+    bits = (bits | (bits >> 16)) & Q_UINT64_C(0x00000000FFFFFFFF);
+    return quint32(bits);
+}
+
+inline quint64
+mortonOf(quint64 value)
+{
+    return value >> 1;
+}
+
+// Returns the smallest Morton code greater than @p code which lies within the rectangle
+// spanned by @p minCode and @p maxCode (Tropf and Herzog), 0 if there is none.
+quint64
+nextCodeInRect(quint64 code, quint64 minCode, quint64 maxCode)
+{
+    quint64 result = 0;
+
+    for(int bit = 63; bit >= 0; --bit)
+    {
+        const quint64 mask = Q_UINT64_C(1) << bit;
+        const quint64 lowerBits = (bit % 2 == 0 ? EvenBits : OddBits) & (mask - 1);
+
+        const bool codeBit = code & mask;
+        const bool minBit = minCode & mask;
+        const bool maxBit = maxCode & mask;
+
+        if(!codeBit && !minBit && maxBit)
+        {
+            result = (minCode & ~lowerBits) | mask;
+            maxCode = (maxCode & ~mask) | lowerBits;
+        }
+        else if(!codeBit && minBit && maxBit)
+        {
+            return minCode;
+        }
+        else if(codeBit && !minBit && !maxBit)
+        {
+            return result;
+        }
+        else if(codeBit && !minBit && maxBit)
+        {
+            minCode = (minCode & ~lowerBits) | mask;
+        }
+    }
+
+    return result;
+}
+
+}
+
+namespace Marble
+{
+
+TileCoverage::TileCoverage()
+{
+}
+
+bool
+TileCoverage::isEmpty() const
+{
+    return maxLevel() < 0;
+}
+
+int
+TileCoverage::size() const
+{
+    int result = 0;
+    foreach(const QVector<quint64> &codes, m_levels)
+    {
+        result += codes.size();
+    }
+
+    return result;
+}
+
+int
+TileCoverage::maxLevel() const
+{
+    for(int level = m_levels.size() - 1; level >= 0; --level)
+    {
+        if(!m_levels.at(level).isEmpty())
+        {
+            return level;
+        }
+    }
+
+    return -1;
+}
+
+int
+TileCoverage::byteCount() const
+{
+    return size() * int(sizeof(quint64));
+}
+
+void
+TileCoverage::insert(int level, int x, int y, TileStatus status)
+{
+    if(level < 0 || x < 0 || y < 0)
+    {
+        return;
+    }
+
+    if(level >= m_levels.size())
+    {
+        m_levels.resize(level + 1);
+    }
+
+    QVector<quint64> &codes = m_levels[level];
+    const quint64 value = (mortonCode(x, y) << 1) | (status == Full ? FullBit : 0);
+
+    if(codes.isEmpty() || mortonOf(codes.last()) < mortonOf(value))
+    {
+        codes.append(value);
+        return;
+    }
+
+    auto it = std::lower_bound(codes.begin(), codes.end(), value & ~FullBit);
+    if(it != codes.end() && mortonOf(*it) == mortonOf(value))
+    {
+        *it |= value;
+    }
+    else
+    {
+        codes.insert(it, value);
+    }
+}
+
+void
+TileCoverage::unite(const TileCoverage &other)
+{
+    if(other.m_levels.size() > m_levels.size())
+    {
+        m_levels.resize(other.m_levels.size());
+    }
+
+    for(int level = 0; level < other.m_levels.size(); ++level)
+    {
+        const QVector<quint64> &otherCodes = other.m_levels.at(level);
+        if(otherCodes.isEmpty())
+        {
+            continue;
+        }
+
+        QVector<quint64> &codes = m_levels[level];
+        if(codes.isEmpty())
+        {
+            codes = otherCodes;
+            continue;
+        }
+
+        QVector<quint64> merged;
+        merged.reserve(codes.size() + otherCodes.size());
+
+        auto it = codes.constBegin();
+        auto itEnd = codes.constEnd();
+        auto itOther = otherCodes.constBegin();
+        auto itOtherEnd = otherCodes.constEnd();
+
+        while(it != itEnd && itOther != itOtherEnd)
+        {
+            if(mortonOf(*it) < mortonOf(*itOther))
+            {
+                merged.append(*it++);
+            }
+            else if(mortonOf(*itOther) < mortonOf(*it))
+            {
+                merged.append(*itOther++);
+            }
+            else
+            {
+                merged.append(*it++ | *itOther++);
+            }
+        }
+
+        for(; it != itEnd; ++it)
+        {
+            merged.append(*it);
+        }
+
+        for(; itOther != itOtherEnd; ++itOther)
+        {
+            merged.append(*itOther);
+        }
+
+        codes = merged;
+    }
+}
+
+void
+TileCoverage::unite(const QVector<TileCoverage> &others)
+{
+    int levelCount = m_levels.size();
+    foreach(const TileCoverage &other, others)
+    {
+        levelCount = qMax(levelCount, other.m_levels.size());
+    }
+
+    m_levels.resize(levelCount);
+
+    for(int level = 0; level < levelCount; ++level)
+    {
+        QVector<quint64> &codes = m_levels[level];
+        foreach(const TileCoverage &other, others)
+        {
+            if(level < other.m_levels.size())
+            {
+                codes += other.m_levels.at(level);
+            }
+        }
+
+        if(codes.isEmpty())
+        {
+            continue;
+        }
+
+        std::sort(codes.begin(), codes.end());
+
+        // A partial and a full entry of the same tile are adjacent now, the full one last.
+        int last = 0;
+        for(int i = 1; i < codes.size(); ++i)
+        {
+            if(mortonOf(codes.at(i)) == mortonOf(codes.at(last)))
+            {
+                codes[last] |= codes.at(i);
+            }
+            else
+            {
+                codes[++last] = codes.at(i);
+            }
+        }
+
+        codes.resize(last + 1);
+    }
+}
+
+bool
+TileCoverage::contains(int level, int x, int y) const
+{
+    TileStatus status;
+    return contains(level, x, y, status);
+}
+
+bool
+TileCoverage::contains(int level, int x, int y, TileStatus &status) const
+{
+    if(level < 0 || level >= m_levels.size() || x < 0 || y < 0)
+    {
+        return false;
+    }
+
+    const QVector<quint64> &codes = m_levels.at(level);
+    const quint64 value = mortonCode(x, y) << 1;
+
+    auto it = std::lower_bound(codes.constBegin(), codes.constEnd(), value);
+    if(it == codes.constEnd() || mortonOf(*it) != mortonOf(value))
+    {
+        return false;
+    }
+
+    status = (*it & FullBit) ? Full : Partially;
+    return true;
+}
+
+bool
+TileCoverage::isFull(int level, int x, int y) const
+{
+    for(int ancestorLevel = qMin(level, m_levels.size() - 1); ancestorLevel >= 0; --ancestorLevel)
+    {
+        const int shift = level - ancestorLevel;
+
+        TileStatus status;
+        if(contains(ancestorLevel, x >> shift, y >> shift, status) && status == Full)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+QVector<quint64>
+TileCoverage::mortonCodes(int level) const
+{
+    QVector<quint64> result;
+    if(level < 0 || level >= m_levels.size())
+    {
+        return result;
+    }
+
+    const QVector<quint64> &codes = m_levels.at(level);
+    result.reserve(codes.size());
+    foreach(quint64 value, codes)
+    {
+        result.append(mortonOf(value));
+    }
+
+    return result;
+}
+
+bool
+TileCoverage::intersects(int level, const QRect &rect) const
+{
+    if(level < 0 || level >= m_levels.size() || rect.right() < 0 || rect.bottom() < 0)
+    {
+        return false;
+    }
+
+    const QVector<quint64> &codes = m_levels.at(level);
+    if(codes.isEmpty())
+    {
+        return false;
+    }
+
+    const int left = qMax(0, rect.left());
+    const int top = qMax(0, rect.top());
+    const quint64 minCode = mortonCode(left, top);
+    const quint64 maxCode = mortonCode(rect.right(), rect.bottom());
+
+    auto it = std::lower_bound(codes.constBegin(), codes.constEnd(), minCode << 1);
+    auto itEnd = codes.constEnd();
+    while(it != itEnd)
+    {
+        const quint64 code = mortonOf(*it);
+        if(code > maxCode)
+        {
+            return false;
+        }
+
+        int x, y;
+        fromMortonCode(code, x, y);
+        if(x >= left && x <= rect.right() && y >= top && y <= rect.bottom())
+        {
+            return true;
+        }
+
+        // Skip the codes of the Z-order range that leave the rectangle.
+        const quint64 nextCode = nextCodeInRect(code, minCode, maxCode);
+        if(nextCode <= code)
+        {
+            return false;
+        }
+
+        it = std::lower_bound(it, itEnd, nextCode << 1);
+    }
+
+    return false;
+}
+
+bool
+TileCoverage::touches(int level, int x, int y) const
+{
+    if(level < 0 || x < 0 || y < 0)
+    {
+        return false;
+    }
+
+    for(int ancestorLevel = qMin(level, m_levels.size() - 1); ancestorLevel >= 0; --ancestorLevel)
+    {
+        const int shift = level - ancestorLevel;
+        if(contains(ancestorLevel, x >> shift, y >> shift))
+        {
+            return true;
+        }
+    }
+
+    for(int descendantLevel = level + 1; descendantLevel < m_levels.size(); ++descendantLevel)
+    {
+        const int shift = descendantLevel - level;
+        if(intersects(descendantLevel, QRect(x << shift, y << shift, 1 << shift, 1 << shift)))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+TileCoverage
+TileCoverage::coarsened(int maxTiles) const
+{
+    TileCoverage result(*this);
+    int tileCount = result.size();
+
+    for(int level = result.m_levels.size() - 1; level > 0; --level)
+    {
+        const bool mergeLevel = tileCount > maxTiles;
+        const QVector<quint64> codes = result.m_levels.at(level);
+
+        QVector<quint64> kept;
+        TileCoverage parents;
+        parents.m_levels.resize(level);
+
+        // Siblings are adjacent in Morton order, so each run of codes sharing a parent is one family.
+        for(int i = 0; i < codes.size();)
+        {
+            const quint64 parentCode = mortonOf(codes.at(i)) >> 2;
+
+            int end = i;
+            quint64 fullBit = FullBit;
+            for(; end < codes.size() && mortonOf(codes.at(end)) >> 2 == parentCode; ++end)
+            {
+                fullBit &= codes.at(end);
+            }
+
+            const int siblingCount = end - i;
+            if(mergeLevel || siblingCount == 4)
+            {
+                parents.m_levels[level - 1].append((parentCode << 1) | (siblingCount == 4 ? fullBit : 0));
+                tileCount -= siblingCount - 1;
+            }
+            else
+            {
+                kept += codes.mid(i, siblingCount);
+            }
+
+            i = end;
+        }
+
+        result.m_levels[level] = kept;
+        result.unite(parents);
+    }
+
+    while(!result.m_levels.isEmpty() && result.m_levels.last().isEmpty())
+    {
+        result.m_levels.removeLast();
+    }
+
+    return result;
+}
+
+bool
+TileCoverage::operator==(const TileCoverage &other) const
+{
+    const int levelCount = qMax(m_levels.size(), other.m_levels.size());
+    for(int level = 0; level < levelCount; ++level)
+    {
+        if(m_levels.value(level) != other.m_levels.value(level))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool
+TileCoverage::operator!=(const TileCoverage &other) const
+{
+    return !(*this == other);
+}
+
+quint64
+TileCoverage::mortonCode(int x, int y)
+{
+    return spreadBits(quint32(x)) | (spreadBits(quint32(y)) << 1);
+}
+
+void
+TileCoverage::fromMortonCode(quint64 code, int &x, int &y)
+{
+    x = int(compactBits(code));
+    y = int(compactBits(code >> 1));
+}
+
+QDataStream &
+operator<<(QDataStream &stream, const TileCoverage &tiles)
+{
+    return stream << tiles.m_levels;
+}
+
+QDataStream &
+operator>>(QDataStream &stream, TileCoverage &tiles)
+{
+    return stream >> tiles.m_levels;
+}
+
+}
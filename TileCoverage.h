@@ -0,0 +1,141 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#ifndef MARBLE_TILECOVERAGE_H
+#define MARBLE_TILECOVERAGE_H
+
+#include <QtCore/QDataStream>
+#include <QtCore/QMap>
+#include <QtCore/QRect>
+#include <QtCore/QVector>
+
+#include "marble_export.h"
+
+namespace Marble
+{
+
+enum TileStatus
+{
+    Full,
+    Partially,
+};
+
+/**
+ * The set of tiles an item covers, over all tile levels.
+ *
+ * Each level keeps its tiles as a sorted array of Morton (Z-order) codes
+ * carrying the tile status in the lowest bit. The descendants of a tile form
+ * a contiguous code range one level deeper, so both membership tests and
+ * rectangle queries are binary searches over a flat array. Parents implied
+ * by their children are not stored; producers only add the deepest partially
+ * covered tiles and the tiles at which coverage becomes full.
+ *
+ * Tile coordinates are limited to 31 bits.
+ */
+class MARBLE_EXPORT TileCoverage
+{
+public:
+    TileCoverage();
+
+    bool
+    isEmpty() const;
+
+    /// Returns the number of tiles kept over all levels.
+    int
+    size() const;
+
+    /// Returns the deepest level holding a tile, -1 if the coverage is empty.
+    int
+    maxLevel() const;
+
+    int
+    byteCount() const;
+
+    /**
+     * Adds the tile @p x, @p y at @p level. A tile added twice is full if it
+     * was added as full at least once. Adding tiles in Z-order, as a
+     * recursive descent into the tile quadtree does, only appends.
+     */
+    void
+    insert(int level, int x, int y, TileStatus status);
+
+    /// Merges @p other into this coverage, full tiles win.
+    void
+    unite(const TileCoverage &other);
+
+    /// Merges all of @p others at once, which is cheaper than merging them one by one.
+    void
+    unite(const QVector<TileCoverage> &others);
+
+    bool
+    contains(int level, int x, int y) const;
+
+    bool
+    contains(int level, int x, int y, TileStatus &status) const;
+
+    /**
+     * Returns whether the tile @p x, @p y at @p level lies completely within
+     * the covered area, i.e. it or one of its ancestors is kept as full.
+     */
+    bool
+    isFull(int level, int x, int y) const;
+
+    /// Returns the Morton codes of the tiles kept at @p level in ascending order.
+    QVector<quint64>
+    mortonCodes(int level) const;
+
+    /// Returns whether a tile within @p rect is kept at @p level.
+    bool
+    intersects(int level, const QRect &rect) const;
+
+    /**
+     * Returns whether the tile @p x, @p y at @p level is touched by the
+     * coverage, i.e. it, one of its ancestors or one of its descendants is kept.
+     */
+    bool
+    touches(int level, int x, int y) const;
+
+    /**
+     * Returns a coverage keeping at most about @p maxTiles tiles which touches
+     * every tile this one touches. Four siblings are merged into their parent,
+     * which may add the parent's other descendants, and the deepest levels are
+     * merged into their parents as a whole while there are too many tiles.
+     * Meant for invalidation, where touching a few tiles more is cheaper than
+     * testing against many.
+     */
+    TileCoverage
+    coarsened(int maxTiles) const;
+
+    /// Returns whether both coverages keep the same tiles with the same status.
+    bool
+    operator==(const TileCoverage &other) const;
+
+    bool
+    operator!=(const TileCoverage &other) const;
+
+    static quint64
+    mortonCode(int x, int y);
+
+    static void
+    fromMortonCode(quint64 code, int &x, int &y);
+
+    friend QDataStream &
+    operator<<(QDataStream &stream, const TileCoverage &tiles);
+
+    friend QDataStream &
+    operator>>(QDataStream &stream, TileCoverage &tiles);
+
+private:
+    QVector<QVector<quint64> > m_levels;
+};
+
+typedef QMap<int /* z level */, TileCoverage> LayeredTileCoverage;
+
+}
+
+#endif // MARBLE_TILECOVERAGE_H
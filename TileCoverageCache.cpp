@@ -0,0 +1,610 @@
+#define QT_NO_DEBUG_OUTPUT
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#include "TileCoverageCache.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSaveFile>
+#include <QtCore/QSet>
+#include <QtCore/QThreadPool>
+#include <QtCore/QtEndian>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include <cstring>
+
+#include "geodata/data/GeoDataDocument.h"
+#include "geodata/data/GeoDataGroundOverlay.h"
+#include "geodata/data/GeoDataLatLonBox.h"
+#include "geodata/data/GeoDataLineString.h"
+#include "geodata/data/GeoDataLinearRing.h"
+#include "geodata/data/GeoDataMultiGeometry.h"
+#include "geodata/data/GeoDataMultiLineString.h"
+#include "geodata/data/GeoDataMultiPoint.h"
+#include "geodata/data/GeoDataMultiPolygon.h"
+#include "geodata/data/GeoDataPlacemark.h"
+#include "geodata/data/GeoDataPoint.h"
+#include "geodata/data/GeoDataPolygon.h"
+#include "geodata/parser/GeoDataTypes.h"
+#include "geodata/scene/GeoSceneTileDataset.h"
+
+namespace
+{
+
+const quint32 Magic = 0x4d544343; // "MTCC"
+const quint32 FormatVersion = 1;
+
+// Header: magic, format version and entry count. Each record: key, offset and length of the entry.
+const int HeaderSize = 3 * sizeof(quint32);
+const int KeySize = 16;
+const int RecordSize = KeySize + sizeof(quint64) + sizeof(quint32);
+
+struct CacheFile
+{
+    CacheFile()
+        :   data(nullptr),
+            size(0),
+            count(0)
+    {
+    }
+
+    ~CacheFile()
+    {
+        unmap();
+    }
+
+    void
+    unmap()
+    {
+        if(data)
+        {
+            file.unmap(data);
+            data = nullptr;
+        }
+
+        file.close();
+        size = 0;
+        count = 0;
+    }
+
+    QFile file;
+    uchar *data;
+    qint64 size;
+    quint32 count;
+
+    // serialised entries inserted since the file was opened
+    QHash<QByteArray, QByteArray> pending;
+
+    // keys of the mapped entries which were found since the file was opened
+    QSet<QByteArray> used;
+};
+
+void
+addData(QCryptographicHash &hash, double lon, double lat)
+{
+    const double lonLat[2] = { lon, lat };
+    hash.addData(reinterpret_cast<const char*>(lonLat), sizeof(lonLat));
+}
+
+void
+addLineString(QCryptographicHash &hash, const Marble::GeoDataLineString &lineString)
+{
+    const int count = lineString.size();
+    hash.addData(reinterpret_cast<const char*>(&count), sizeof(count));
+
+    lineString.forEachLonLat(Marble::GeoDataCoordinates::Radian, [&hash](int, double lon, double lat)
+    {
+        addData(hash, lon, lat);
+    });
+}
+
+void
+addPolygon(QCryptographicHash &hash, const Marble::GeoDataPolygon &polygon)
+{
+    addLineString(hash, polygon.outerBoundary());
+
+    const int count = polygon.innerBoundaries().size();
+    hash.addData(reinterpret_cast<const char*>(&count), sizeof(count));
+
+    foreach(const Marble::GeoDataLinearRing &innerBoundary, polygon.innerBoundaries())
+    {
+        addLineString(hash, innerBoundary);
+    }
+}
+
+bool
+addGeometry(QCryptographicHash &hash, const Marble::GeoDataGeometry *geometry)
+{
+    using namespace Marble;
+
+    if(!geometry)
+    {
+        return false;
+    }
+
+    const char *nodeType = geometry->nodeType();
+    hash.addData(nodeType, int(qstrlen(nodeType)) + 1);
+
+    if(nodeType == GeoDataTypes::GeoDataLineStringType || nodeType == GeoDataTypes::GeoDataLinearRingType)
+    {
+        addLineString(hash, *static_cast<const GeoDataLineString*>(geometry));
+    }
+    else if(nodeType == GeoDataTypes::GeoDataPolygonType)
+    {
+        addPolygon(hash, *static_cast<const GeoDataPolygon*>(geometry));
+    }
+    else if(nodeType == GeoDataTypes::GeoDataMultiLineStringType)
+    {
+        foreach(const GeoDataLineString &lineString, static_cast<const GeoDataMultiLineString*>(geometry)->lineStrings())
+        {
+            addLineString(hash, lineString);
+        }
+    }
+    else if(nodeType == GeoDataTypes::GeoDataMultiPolygonType)
+    {
+        foreach(const GeoDataPolygon &polygon, static_cast<const GeoDataMultiPolygon*>(geometry)->polygons())
+        {
+            addPolygon(hash, polygon);
+        }
+    }
+    else if(nodeType == GeoDataTypes::GeoDataPointType)
+    {
+        const GeoDataCoordinates &coordinates = static_cast<const GeoDataPoint*>(geometry)->coordinates();
+        addData(hash, coordinates.longitude(), coordinates.latitude());
+    }
+    else if(nodeType == GeoDataTypes::GeoDataMultiPointType)
+    {
+        const GeoDataMultiPoint *multiPoint = static_cast<const GeoDataMultiPoint*>(geometry);
+        for(int i = 0; i < multiPoint->size(); ++i)
+        {
+            double lon;
+            double lat;
+            multiPoint->getLonLat(i, lon, lat, GeoDataCoordinates::Radian);
+            addData(hash, lon, lat);
+        }
+    }
+    else if(nodeType == GeoDataTypes::GeoDataMultiGeometryType)
+    {
+        const GeoDataMultiGeometry *multiGeometry = static_cast<const GeoDataMultiGeometry*>(geometry);
+        for(auto it = multiGeometry->constBegin(); it != multiGeometry->constEnd(); ++it)
+        {
+            if(!addGeometry(hash, *it))
+            {
+                return false;
+            }
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+QByteArray
+serialise(const Marble::TileCoverage &tiles, const Marble::GeoDataLatLonBox &box)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << tiles << box.west() << box.east() << box.south() << box.north();
+
+    return data;
+}
+
+bool
+deserialise(const QByteArray &data, Marble::TileCoverage &tiles, Marble::GeoDataLatLonBox &box)
+{
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    double west, east, south, north;
+    stream >> tiles >> west >> east >> south >> north;
+    if(stream.status() != QDataStream::Ok)
+    {
+        return false;
+    }
+
+    box.setBoundaries(north, south, east, west);
+    return true;
+}
+
+}
+
+namespace Marble
+{
+
+class TileCoverageCachePrivate
+{
+public:
+    explicit TileCoverageCachePrivate(const QString &directory)
+        :   m_directory(directory)
+    {
+        // one writer at a time, so saves don't overtake each other
+        m_writePool.setMaxThreadCount(1);
+    }
+
+    ~TileCoverageCachePrivate()
+    {
+        m_writePool.waitForDone();
+        qDeleteAll(m_files);
+    }
+
+    QString
+    filePath(const QString &documentFileName) const;
+
+    CacheFile *
+    file(const QString &documentFileName) const;
+
+    CacheFile *
+    open(const QString &documentFileName) const;
+
+    static QByteArray
+    mappedEntry(const CacheFile *cacheFile, const QByteArray &key);
+
+    static QMap<QByteArray, QByteArray>
+    entriesToWrite(const CacheFile *cacheFile);
+
+    bool
+    write(QSaveFile &saveFile, const QMap<QByteArray, QByteArray> &entries) const;
+
+    void
+    saveFiles();
+
+    const QString m_directory;
+    QString m_layout;
+
+    mutable QMutex m_mutex;
+    mutable QHash<QString /* document */, CacheFile*> m_files;
+
+    QThreadPool m_writePool;
+};
+
+QString
+TileCoverageCachePrivate::filePath(const QString &documentFileName) const
+{
+    // Coverage computed for another tile layout doesn't apply, so the layout is part of the name.
+    const QByteArray name = QCryptographicHash::hash((m_layout + QLatin1Char('\n') + documentFileName).toUtf8(), QCryptographicHash::Md5).toHex();
+    return m_directory + QLatin1Char('/') + QString::fromLatin1(name) + QStringLiteral(".coverage");
+}
+
+CacheFile *
+TileCoverageCachePrivate::file(const QString &documentFileName) const
+{
+    CacheFile *cacheFile = m_files.value(documentFileName, nullptr);
+    if(!cacheFile)
+    {
+        cacheFile = open(documentFileName);
+        m_files.insert(documentFileName, cacheFile);
+    }
+
+    return cacheFile;
+}
+
+CacheFile *
+TileCoverageCachePrivate::open(const QString &documentFileName) const
+{
+    CacheFile *cacheFile = new CacheFile;
+
+    cacheFile->file.setFileName(filePath(documentFileName));
+    if(!cacheFile->file.open(QIODevice::ReadOnly) || cacheFile->file.size() < HeaderSize)
+    {
+        cacheFile->unmap();
+        return cacheFile;
+    }
+
+    cacheFile->size = cacheFile->file.size();
+    cacheFile->data = cacheFile->file.map(0, cacheFile->size);
+    if(!cacheFile->data)
+    {
+        qWarning() << "TileCoverageCache: unable to map" << cacheFile->file.fileName() << cacheFile->file.errorString();
+        cacheFile->unmap();
+        return cacheFile;
+    }
+
+    const quint32 magic = qFromBigEndian<quint32>(cacheFile->data);
+    const quint32 version = qFromBigEndian<quint32>(cacheFile->data + sizeof(quint32));
+    const quint32 count = qFromBigEndian<quint32>(cacheFile->data + 2 * sizeof(quint32));
+
+    if(magic != Magic || version != FormatVersion || HeaderSize + qint64(count) * RecordSize > cacheFile->size)
+    {
+        qDebug() << "TileCoverageCache: ignoring" << cacheFile->file.fileName();
+        cacheFile->unmap();
+        return cacheFile;
+    }
+
+    cacheFile->count = count;
+    return cacheFile;
+}
+
+QByteArray
+TileCoverageCachePrivate::mappedEntry(const CacheFile *cacheFile, const QByteArray &key)
+{
+    if(!cacheFile->data || key.size() != KeySize)
+    {
+        return QByteArray();
+    }
+
+    const uchar *records = cacheFile->data + HeaderSize;
+
+    quint32 first = 0;
+    quint32 last = cacheFile->count;
+    while(first < last)
+    {
+        const quint32 middle = first + (last - first) / 2;
+        const uchar *record = records + qint64(middle) * RecordSize;
+
+        const int order = memcmp(record, key.constData(), KeySize);
+        if(order < 0)
+        {
+            first = middle + 1;
+        }
+        else if(order > 0)
+        {
+            last = middle;
+        }
+        else
+        {
+            const quint64 offset = qFromBigEndian<quint64>(record + KeySize);
+            const quint32 length = qFromBigEndian<quint32>(record + KeySize + sizeof(quint64));
+            if(offset + length > quint64(cacheFile->size))
+            {
+                return QByteArray();
+            }
+
+            // The entry is decoded right away, so it doesn't need to be copied out of the mapping.
+            return QByteArray::fromRawData(reinterpret_cast<const char*>(cacheFile->data + offset), int(length));
+        }
+    }
+
+    return QByteArray();
+}
+
+QMap<QByteArray, QByteArray>
+TileCoverageCachePrivate::entriesToWrite(const CacheFile *cacheFile)
+{
+    // Mapped entries still in use are kept, new ones replace them.
+    QMap<QByteArray, QByteArray> entries;
+    foreach(const QByteArray &key, cacheFile->used)
+    {
+        const QByteArray entry = mappedEntry(cacheFile, key);
+        if(!entry.isEmpty())
+        {
+            entries.insert(key, QByteArray(entry.constData(), entry.size()));
+        }
+    }
+
+    for(auto it = cacheFile->pending.constBegin(); it != cacheFile->pending.constEnd(); ++it)
+    {
+        entries.insert(it.key(), it.value());
+    }
+
+    return entries;
+}
+
+bool
+TileCoverageCachePrivate::write(QSaveFile &saveFile, const QMap<QByteArray, QByteArray> &entries) const
+{
+    QDir().mkpath(m_directory);
+
+    if(!saveFile.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "TileCoverageCache: unable to write" << saveFile.fileName() << saveFile.errorString();
+        return false;
+    }
+
+    QDataStream stream(&saveFile);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << Magic << FormatVersion << quint32(entries.size());
+
+    quint64 offset = HeaderSize + quint64(entries.size()) * RecordSize;
+    for(auto it = entries.constBegin(); it != entries.constEnd(); ++it)
+    {
+        stream.writeRawData(it.key().constData(), KeySize);
+        stream << offset << quint32(it.value().size());
+        offset += it.value().size();
+    }
+
+    foreach(const QByteArray &entry, entries)
+    {
+        stream.writeRawData(entry.constData(), entry.size());
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+void
+TileCoverageCachePrivate::saveFiles()
+{
+    QMutexLocker locker(&m_mutex);
+
+    foreach(const QString &documentFileName, m_files.keys())
+    {
+        CacheFile *cacheFile = m_files.value(documentFileName, nullptr);
+        if(!cacheFile || cacheFile->pending.isEmpty())
+        {
+            continue;
+        }
+
+        const QString layout = m_layout;
+        const QMap<QByteArray, QByteArray> entries = entriesToWrite(cacheFile);
+        QSaveFile saveFile(filePath(documentFileName));
+
+        // Lookups and inserts go on while the file is written.
+        locker.unlock();
+        const bool written = write(saveFile, entries);
+        locker.relock();
+
+        // The layout may have changed and the files been dropped in the meantime.
+        if(!written || m_layout != layout || m_files.value(documentFileName, nullptr) != cacheFile)
+        {
+            saveFile.cancelWriting();
+            continue;
+        }
+
+        // The old file is replaced, so its mapping has to go first.
+        cacheFile->unmap();
+
+        const bool committed = saveFile.commit();
+        if(!committed)
+        {
+            qWarning() << "TileCoverageCache: unable to write" << saveFile.fileName() << saveFile.errorString();
+        }
+
+        // Entries inserted while writing stay pending, the written ones are in use in the new file.
+        CacheFile *reopened = open(documentFileName);
+        reopened->used = cacheFile->used;
+        reopened->pending = cacheFile->pending;
+        if(committed)
+        {
+            for(auto it = entries.constBegin(); it != entries.constEnd(); ++it)
+            {
+                reopened->pending.remove(it.key());
+                reopened->used.insert(it.key());
+            }
+        }
+
+        m_files.insert(documentFileName, reopened);
+        delete cacheFile;
+
+        qDebug() << "TileCoverageCache::save" << saveFile.fileName() << entries.size();
+    }
+}
+
+TileCoverageCache::TileCoverageCache(const QString &directory)
+    :   d(new TileCoverageCachePrivate(directory))
+{
+}
+
+TileCoverageCache::~TileCoverageCache()
+{
+    delete d;
+}
+
+void
+TileCoverageCache::setTileDataset(const GeoSceneTileDataset *tileDataset, int maxLevel)
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    const QString layout = tileDataset ? QStringLiteral("%1 %2 %3 %4").arg(int(tileDataset->projection()))
+                                                                        .arg(tileDataset->levelZeroColumns())
+                                                                        .arg(tileDataset->levelZeroRows())
+                                                                        .arg(maxLevel)
+                                       : QString();
+
+    if(layout != d->m_layout)
+    {
+        qDeleteAll(d->m_files);
+        d->m_files.clear();
+        d->m_layout = layout;
+    }
+}
+
+QString
+TileCoverageCache::documentFileName(const GeoDataFeature *feature)
+{
+    for(const GeoDataObject *object = feature; object; object = object->parent())
+    {
+        if(object->nodeType() == GeoDataTypes::GeoDataDocumentType)
+        {
+            const QString fileName = static_cast<const GeoDataDocument*>(object)->fileName();
+            if(!fileName.isEmpty())
+            {
+                return fileName;
+            }
+        }
+    }
+
+    return QString();
+}
+
+QByteArray
+TileCoverageCache::contentKey(const GeoDataFeature *feature)
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+
+    if(feature->nodeType() == GeoDataTypes::GeoDataPlacemarkType)
+    {
+        if(!addGeometry(hash, static_cast<const GeoDataPlacemark*>(feature)->geometry()))
+        {
+            return QByteArray();
+        }
+    }
+    else if(feature->nodeType() == GeoDataTypes::GeoDataGroundOverlayType)
+    {
+        const GeoDataLatLonBox &box = static_cast<const GeoDataGroundOverlay*>(feature)->latLonBox();
+        hash.addData(GeoDataTypes::GeoDataGroundOverlayType);
+        addData(hash, box.west(), box.north());
+        addData(hash, box.east(), box.south());
+    }
+    else
+    {
+        return QByteArray();
+    }
+
+    return hash.result();
+}
+
+bool
+TileCoverageCache::find(const QString &documentFileName, const QByteArray &key, TileCoverage &tiles, GeoDataLatLonBox &box) const
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    if(d->m_layout.isEmpty())
+    {
+        return false;
+    }
+
+    CacheFile *cacheFile = d->file(documentFileName);
+
+    auto it = cacheFile->pending.constFind(key);
+    if(it != cacheFile->pending.constEnd())
+    {
+        return deserialise(it.value(), tiles, box);
+    }
+
+    const QByteArray entry = TileCoverageCachePrivate::mappedEntry(cacheFile, key);
+    if(entry.isEmpty() || !deserialise(entry, tiles, box))
+    {
+        return false;
+    }
+
+    cacheFile->used.insert(key);
+    return true;
+}
+
+void
+TileCoverageCache::insert(const QString &documentFileName, const QByteArray &key, const TileCoverage &tiles, const GeoDataLatLonBox &box)
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    if(d->m_layout.isEmpty() || key.size() != KeySize)
+    {
+        return;
+    }
+
+    d->file(documentFileName)->pending.insert(key, serialise(tiles, box));
+}
+
+void
+TileCoverageCache::save()
+{
+    // Large documents take long to write, which must not hold up the caller.
+    QtConcurrent::run(&d->m_writePool, d, &TileCoverageCachePrivate::saveFiles);
+}
+
+}
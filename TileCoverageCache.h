@@ -0,0 +1,86 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#ifndef MARBLE_TILECOVERAGECACHE_H
+#define MARBLE_TILECOVERAGECACHE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+#include "TileCoverage.h"
+
+namespace Marble
+{
+
+class GeoDataFeature;
+class GeoDataLatLonBox;
+class GeoSceneTileDataset;
+class TileCoverageCachePrivate;
+
+/**
+ * Keeps the tile coverage and bounds computed for features on disk, so
+ * loading the same document again does not compute them a second time.
+ *
+ * There is one file per source document and tile layout. Entries are keyed
+ * by a hash of the feature geometry, so unchanged features of an edited
+ * document are still found. The files consist of a sorted key table and
+ * the serialised entries and are memory-mapped, lookups decode single
+ * entries straight from the mapping.
+ *
+ * Lookups may come from any thread. New entries are collected in memory
+ * and written by save().
+ */
+class TileCoverageCache
+{
+public:
+    /// Keeps the cache files in @p directory.
+    explicit TileCoverageCache(const QString &directory);
+    ~TileCoverageCache();
+
+    /**
+     * Sets the tile layout the coverage is computed for, along with the
+     * deepest coverage level. Files of other layouts are not looked at.
+     */
+    void
+    setTileDataset(const GeoSceneTileDataset *tileDataset, int maxLevel);
+
+    /**
+     * Returns the name of the document file @p feature comes from, empty
+     * if it was not loaded from a file. Only such features are cached.
+     */
+    static QString
+    documentFileName(const GeoDataFeature *feature);
+
+    /// Returns the hash of the geometry of @p feature, empty if it has none.
+    static QByteArray
+    contentKey(const GeoDataFeature *feature);
+
+    bool
+    find(const QString &documentFileName, const QByteArray &key, TileCoverage &tiles, GeoDataLatLonBox &box) const;
+
+    void
+    insert(const QString &documentFileName, const QByteArray &key, const TileCoverage &tiles, const GeoDataLatLonBox &box);
+
+    /**
+     * Writes the files of all documents with new entries on a worker thread.
+     * Entries neither found nor inserted since the file was opened are
+     * dropped, they belong to features which are gone. Entries inserted
+     * while writing are kept for the next save.
+     */
+    void
+    save();
+
+private:
+    Q_DISABLE_COPY(TileCoverageCache)
+
+    TileCoverageCachePrivate *const d;
+};
+
+}
+
+#endif // MARBLE_TILECOVERAGECACHE_H
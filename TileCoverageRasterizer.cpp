@@ -0,0 +1,524 @@
+#define QT_NO_DEBUG_OUTPUT
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#include "TileCoverageRasterizer.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QtMath>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+const int CancelCheckInterval = 256;
+
+// Maps a longitude difference into [-pi, pi], i.e. the short way around.
+double
+wrapLongitude(double delta)
+{
+    if(delta > M_PI)
+    {
+        return delta - 2 * M_PI;
+    }
+    else if(delta < -M_PI)
+    {
+        return delta + 2 * M_PI;
+    }
+
+    return delta;
+}
+
+int
+floorDiv(int value, int divisor)
+{
+    return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+int
+ceilDiv(int value, int divisor)
+{
+    return -floorDiv(-value, divisor);
+}
+
+struct Span
+{
+    int first;
+    int last;
+};
+
+QVector<Span>
+subtractSpans(const QVector<Span> &spans, const QVector<Span> &removed)
+{
+    QVector<Span> result;
+
+    int i = 0;
+    foreach(const Span &span, spans)
+    {
+        while(i < removed.size() && removed.at(i).last < span.first)
+        {
+            ++i;
+        }
+
+        int first = span.first;
+        for(int j = i; j < removed.size() && removed.at(j).first <= span.last; ++j)
+        {
+            if(removed.at(j).first > first)
+            {
+                const Span piece = { first, removed.at(j).first - 1 };
+                result.append(piece);
+            }
+
+            first = qMax(first, removed.at(j).last + 1);
+        }
+
+        if(first <= span.last)
+        {
+            const Span piece = { first, span.last };
+            result.append(piece);
+        }
+    }
+
+    return result;
+}
+
+QVector<Span>
+intersectSpans(const QVector<Span> &spans, const QVector<Span> &otherSpans)
+{
+    QVector<Span> result;
+
+    int i = 0;
+    int j = 0;
+    while(i < spans.size() && j < otherSpans.size())
+    {
+        const Span span = { qMax(spans.at(i).first, otherSpans.at(j).first), qMin(spans.at(i).last, otherSpans.at(j).last) };
+        if(span.first <= span.last)
+        {
+            result.append(span);
+        }
+
+        if(spans.at(i).last < otherSpans.at(j).last)
+        {
+            ++i;
+        }
+        else
+        {
+            ++j;
+        }
+    }
+
+    return result;
+}
+
+// Returns the parent columns both of whose children lie within @p spans.
+QVector<Span>
+halveSpans(const QVector<Span> &spans)
+{
+    QVector<Span> result;
+    foreach(const Span &span, spans)
+    {
+        const Span parent = { ceilDiv(span.first, 2), floorDiv(span.last - 1, 2) };
+        if(parent.first <= parent.last)
+        {
+            result.append(parent);
+        }
+    }
+
+    return result;
+}
+
+QVector<Span>
+doubleSpans(const QVector<Span> &spans)
+{
+    QVector<Span> result;
+    result.reserve(spans.size());
+    foreach(const Span &span, spans)
+    {
+        const Span child = { 2 * span.first, 2 * span.last + 1 };
+        result.append(child);
+    }
+
+    return result;
+}
+
+typedef QVector<QVector<Span> > RowSpans;
+
+// The spans of the rows a polygon reaches at one level, starting at firstRow.
+struct LevelSpans
+{
+    int firstRow;
+    RowSpans rows;
+
+    int lastRow() const
+    {
+        return firstRow + rows.size() - 1;
+    }
+
+    QVector<Span>
+    at(int row) const
+    {
+        return row >= firstRow && row <= lastRow() ? rows.at(row - firstRow) : QVector<Span>();
+    }
+};
+
+}
+
+namespace Marble
+{
+
+TileCoverageRasterizer::TileCoverageRasterizer(const GeoSceneTileDataset *tileDataset, int level)
+    :   m_projection(tileDataset->projection()),
+        m_levelZeroColumns(tileDataset->levelZeroColumns()),
+        m_levelZeroRows(tileDataset->levelZeroRows()),
+        m_level(level),
+        m_columns(m_levelZeroColumns << level),
+        m_rows(m_levelZeroRows << level)
+{
+}
+
+QPolygonF
+TileCoverageRasterizer::unwrapRing(const QPolygonF &ring)
+{
+    QPolygonF result(ring.size());
+    result[0] = ring.first();
+    for(int i = 1; i < ring.size(); ++i)
+    {
+        result[i] = QPointF(result.at(i - 1).x() + wrapLongitude(ring.at(i).x() - ring.at(i - 1).x()), ring.at(i).y());
+    }
+
+    const double closingLon = result.last().x() + wrapLongitude(ring.first().x() - ring.last().x());
+    if(qAbs(closingLon - result.first().x()) > M_PI)
+    {
+        return ring;
+    }
+
+    return result;
+}
+
+double
+TileCoverageRasterizer::tileX(double lon) const
+{
+    return (lon + M_PI) / (2 * M_PI) * m_columns;
+}
+
+double
+TileCoverageRasterizer::tileY(double lat) const
+{
+    const double radius = m_rows / 2.0;
+
+    if(m_projection == GeoSceneTileDataset::Mercator)
+    {
+        static const double maxLat = atan(sinh(M_PI));
+        return radius * (1.0 - asinh(tan(qBound(-maxLat, lat, maxLat))) / M_PI);
+    }
+
+    return radius * (1.0 - lat / (M_PI / 2.0));
+}
+
+double
+TileCoverageRasterizer::lonAt(double x) const
+{
+    return x / m_columns * 2 * M_PI - M_PI;
+}
+
+double
+TileCoverageRasterizer::latAt(double y) const
+{
+    const double radius = m_rows / 2.0;
+
+    if(m_projection == GeoSceneTileDataset::Mercator)
+    {
+        return atan(sinh((radius - y) / radius * M_PI));
+    }
+
+    return (radius - y) / radius * M_PI / 2.0;
+}
+
+int
+TileCoverageRasterizer::clampedRow(double y) const
+{
+    return qBound(0, qFloor(y), m_rows - 1);
+}
+
+void
+TileCoverageRasterizer::traceSegment(const QPointF &from, const QPointF &to, QVector<QPoint> &cells) const
+{
+    int x = qFloor(tileX(from.x()));
+    int y = clampedRow(tileY(from.y()));
+    const int lastX = qFloor(tileX(to.x()));
+    const int lastY = clampedRow(tileY(to.y()));
+
+    const int stepX = lastX > x ? 1 : -1;
+    const int stepY = lastY > y ? 1 : -1;
+    const double dLon = to.x() - from.x();
+    const double dLat = to.y() - from.y();
+
+    cells.append(QPoint(x, y));
+
+    // Walk from tile border to tile border, always taking the one the segment crosses first.
+    // The segment is straight in lon/lat, so the row borders are crossed at their latitude.
+    for(int steps = qAbs(lastX - x) + qAbs(lastY - y); steps > 0; --steps)
+    {
+        const double tX = x != lastX ? (lonAt(stepX > 0 ? x + 1 : x) - from.x()) / dLon : 2.0;
+        const double tY = y != lastY ? (latAt(stepY > 0 ? y + 1 : y) - from.y()) / dLat : 2.0;
+
+        if(tX <= tY)
+        {
+            x += stepX;
+        }
+        else
+        {
+            y += stepY;
+        }
+
+        cells.append(QPoint(x, y));
+    }
+}
+
+void
+TileCoverageRasterizer::insertCells(TileCoverage &tiles, int level, const QVector<QPoint> &cells, TileStatus status) const
+{
+    if(cells.isEmpty())
+    {
+        return;
+    }
+
+    const int columns = m_levelZeroColumns << level;
+
+    QVector<quint64> codes;
+    codes.reserve(cells.size());
+    foreach(const QPoint &cell, cells)
+    {
+        // Cells beyond the date line wrap around.
+        int x = cell.x() % columns;
+        if(x < 0)
+        {
+            x += columns;
+        }
+
+        codes.append(TileCoverage::mortonCode(x, cell.y()));
+    }
+
+    std::sort(codes.begin(), codes.end());
+    codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+
+    // Sorted codes are appended, merging them in afterwards keeps inserting linear.
+    TileCoverage cellTiles;
+    foreach(quint64 code, codes)
+    {
+        int x, y;
+        TileCoverage::fromMortonCode(code, x, y);
+        cellTiles.insert(level, x, y, status);
+    }
+
+    tiles.unite(cellTiles);
+}
+
+void
+TileCoverageRasterizer::addLineString(const QPolygonF &lineString, TileCoverage &tiles, const std::atomic<bool> &cancel) const
+{
+    if(lineString.isEmpty())
+    {
+        return;
+    }
+
+    QVector<QPoint> cells;
+    cells.reserve(lineString.size());
+
+    traceSegment(lineString.first(), lineString.first(), cells);
+
+    for(int i = 1; i < lineString.size(); ++i)
+    {
+        if(i % CancelCheckInterval == 0 && cancel)
+        {
+            return;
+        }
+
+        const QPointF &from = lineString.at(i - 1);
+        const QPointF to(from.x() + wrapLongitude(lineString.at(i).x() - from.x()), lineString.at(i).y());
+
+        traceSegment(from, to, cells);
+    }
+
+    insertCells(tiles, m_level, cells, Partially);
+}
+
+void
+TileCoverageRasterizer::addPolygon(const QPolygonF &outerBoundary, const QVector<QPolygonF> &innerBoundaries, TileCoverage &tiles, const std::atomic<bool> &cancel) const
+{
+    if(outerBoundary.size() < 3)
+    {
+        return;
+    }
+
+    QVector<QPolygonF> rings;
+    rings.append(unwrapRing(outerBoundary));
+
+    // Holes are moved next to the outer boundary in case only one of them got unwrapped.
+    const double outerCenter = rings.first().boundingRect().center().x();
+    foreach(const QPolygonF &innerBoundary, innerBoundaries)
+    {
+        if(innerBoundary.size() < 3)
+        {
+            continue;
+        }
+
+        const QPolygonF ring = unwrapRing(innerBoundary);
+        const double offset = qRound((outerCenter - ring.boundingRect().center().x()) / (2 * M_PI)) * 2 * M_PI;
+        rings.append(ring.translated(offset, 0));
+    }
+
+    // Only the rows between the northernmost and southernmost vertex are looked at.
+    double minY = tileY(rings.first().first().y());
+    double maxY = minY;
+    foreach(const QPolygonF &ring, rings)
+    {
+        foreach(const QPointF &point, ring)
+        {
+            const double y = tileY(point.y());
+            minY = qMin(minY, y);
+            maxY = qMax(maxY, y);
+        }
+    }
+
+    const int firstRow = clampedRow(minY);
+    const int rowCount = clampedRow(maxY) - firstRow + 1;
+
+    QVector<QPoint> boundaryCells;
+    QVector<QVector<double> > crossings(rowCount);
+
+    int edgeCount = 0;
+    foreach(const QPolygonF &ring, rings)
+    {
+        for(int i = 0; i < ring.size(); ++i)
+        {
+            if(++edgeCount % CancelCheckInterval == 0 && cancel)
+            {
+                return;
+            }
+
+            const QPointF &from = ring.at(i);
+            const QPointF &to = ring.at((i + 1) % ring.size());
+
+            traceSegment(from, to, boundaryCells);
+
+            // The rows whose center line the edge crosses, half open so that a vertex on it counts once.
+            const double fromY = tileY(from.y());
+            const double toY = tileY(to.y());
+            const int firstEdgeRow = qMax(0, qFloor(qMin(fromY, toY) - 0.5) + 1);
+            const int lastEdgeRow = qMin(m_rows - 1, qFloor(qMax(fromY, toY) - 0.5));
+
+            for(int row = firstEdgeRow; row <= lastEdgeRow; ++row)
+            {
+                const double lat = latAt(row + 0.5);
+                const double lon = from.x() + (lat - from.y()) * (to.x() - from.x()) / (to.y() - from.y());
+                crossings[row - firstRow].append(tileX(lon));
+            }
+        }
+    }
+
+    QVector<QVector<Span> > boundarySpans(rowCount);
+
+    std::sort(boundaryCells.begin(), boundaryCells.end(), [](const QPoint &cell, const QPoint &otherCell) {
+        return cell.y() < otherCell.y() || (cell.y() == otherCell.y() && cell.x() < otherCell.x());
+    });
+
+    foreach(const QPoint &cell, boundaryCells)
+    {
+        QVector<Span> &spans = boundarySpans[cell.y() - firstRow];
+        if(!spans.isEmpty() && spans.last().last + 1 >= cell.x())
+        {
+            spans.last().last = qMax(spans.last().last, cell.x());
+        }
+        else
+        {
+            const Span span = { cell.x(), cell.x() };
+            spans.append(span);
+        }
+    }
+
+    // Tiles not crossed by a ring lie either completely inside or outside, their center decides.
+    QVector<LevelSpans> levelSpans(m_level + 1);
+    LevelSpans &fullSpans = levelSpans[m_level];
+    fullSpans.firstRow = firstRow;
+    fullSpans.rows.resize(rowCount);
+
+    for(int row = 0; row < rowCount; ++row)
+    {
+        QVector<double> &rowCrossings = crossings[row];
+        if(rowCrossings.isEmpty())
+        {
+            continue;
+        }
+
+        std::sort(rowCrossings.begin(), rowCrossings.end());
+
+        QVector<Span> insideSpans;
+        for(int i = 0; i + 1 < rowCrossings.size(); i += 2)
+        {
+            Span span = { qCeil(rowCrossings.at(i) - 0.5), qFloor(rowCrossings.at(i + 1) - 0.5) };
+            if(span.first > span.last)
+            {
+                continue;
+            }
+
+            if(!insideSpans.isEmpty() && insideSpans.last().last >= span.first)
+            {
+                insideSpans.last().last = qMax(insideSpans.last().last, span.last);
+            }
+            else
+            {
+                insideSpans.append(span);
+            }
+        }
+
+        fullSpans.rows[row] = subtractSpans(insideSpans, boundarySpans.at(row));
+    }
+
+    for(int level = m_level - 1; level >= 0; --level)
+    {
+        const LevelSpans &childSpans = levelSpans.at(level + 1);
+        LevelSpans &spans = levelSpans[level];
+        spans.firstRow = childSpans.firstRow / 2;
+        spans.rows.resize(childSpans.lastRow() / 2 - spans.firstRow + 1);
+
+        for(int row = spans.firstRow; row <= spans.lastRow(); ++row)
+        {
+            spans.rows[row - spans.firstRow] = intersectSpans(halveSpans(childSpans.at(2 * row)), halveSpans(childSpans.at(2 * row + 1)));
+        }
+    }
+
+    // Full tiles are kept at the coarsest level they are full at.
+    for(int level = 0; level <= m_level; ++level)
+    {
+        const LevelSpans &spans = levelSpans.at(level);
+
+        QVector<QPoint> cells;
+        for(int row = spans.firstRow; row <= spans.lastRow(); ++row)
+        {
+            const QVector<Span> rowSpans = level > 0 ? subtractSpans(spans.at(row), doubleSpans(levelSpans.at(level - 1).at(row / 2)))
+                                                     : spans.at(row);
+
+            foreach(const Span &span, rowSpans)
+            {
+                for(int x = span.first; x <= span.last; ++x)
+                {
+                    cells.append(QPoint(x, row));
+                }
+            }
+        }
+
+        insertCells(tiles, level, cells, Full);
+    }
+
+    insertCells(tiles, m_level, boundaryCells, Partially);
+}
+
+}
@@ -0,0 +1,88 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#ifndef MARBLE_TILECOVERAGERASTERIZER_H
+#define MARBLE_TILECOVERAGERASTERIZER_H
+
+#include <QtCore/QPoint>
+#include <QtCore/QVector>
+#include <QtGui/QPolygonF>
+
+#include <atomic>
+
+#include "TileCoverage.h"
+#include "geodata/scene/GeoSceneTileDataset.h"
+
+namespace Marble
+{
+
+/**
+ * Computes the tile coverage of line strings and polygons without clipping
+ * their geometry against every tile.
+ *
+ * Lines are traced segment by segment through the tile grid of the deepest
+ * level. Polygons are filled row by row; tiles crossed by a ring are
+ * partially covered, the remaining tiles inside are full and are merged into
+ * their parents where all four children are full. Segments are straight in
+ * longitude and latitude, like the segments clipped by the items, and take
+ * the short way across the date line.
+ *
+ * All coordinates are longitude/latitude pairs in radian.
+ */
+class TileCoverageRasterizer
+{
+public:
+    TileCoverageRasterizer(const GeoSceneTileDataset *tileDataset, int level);
+
+    void
+    addLineString(const QPolygonF &lineString, TileCoverage &tiles, const std::atomic<bool> &cancel) const;
+
+    void
+    addPolygon(const QPolygonF &outerBoundary, const QVector<QPolygonF> &innerBoundaries, TileCoverage &tiles, const std::atomic<bool> &cancel) const;
+
+    /**
+     * Returns @p ring with consecutive longitudes differing by at most pi, so a
+     * ring crossing the date line continues beyond it. Rings winding around a
+     * pole don't close that way and are returned as they are.
+     */
+    static QPolygonF
+    unwrapRing(const QPolygonF &ring);
+
+private:
+    double
+    tileX(double lon) const;
+
+    double
+    tileY(double lat) const;
+
+    double
+    lonAt(double x) const;
+
+    double
+    latAt(double y) const;
+
+    int
+    clampedRow(double y) const;
+
+    void
+    traceSegment(const QPointF &from, const QPointF &to, QVector<QPoint> &cells) const;
+
+    void
+    insertCells(TileCoverage &tiles, int level, const QVector<QPoint> &cells, TileStatus status) const;
+
+    const GeoSceneTileDataset::Projection m_projection;
+    const int m_levelZeroColumns;
+    const int m_levelZeroRows;
+    const int m_level;
+    const int m_columns;
+    const int m_rows;
+};
+
+}
+
+#endif // MARBLE_TILECOVERAGERASTERIZER_H
@@ -0,0 +1,135 @@
+#define QT_NO_DEBUG_OUTPUT
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#include "TileInvalidationQueue.h"
+
+#include <QtCore/QDebug>
+
+namespace
+{
+
+// about one frame, and short enough that live updates show up without noticeable delay
+const int DefaultInterval = 40;
+const int DefaultMaxTiles = 1024;
+
+}
+
+namespace Marble
+{
+
+TileInvalidationQueue::TileInvalidationQueue(QObject *parent)
+    :   QObject(parent),
+        m_maxTiles(DefaultMaxTiles)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setInterval(DefaultInterval);
+
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+TileInvalidationQueue::~TileInvalidationQueue()
+{
+}
+
+int
+TileInvalidationQueue::interval() const
+{
+    return m_timer.interval();
+}
+
+void
+TileInvalidationQueue::setInterval(int msec)
+{
+    m_timer.setInterval(msec);
+}
+
+void
+TileInvalidationQueue::setMaxTiles(int maxTiles)
+{
+    m_maxTiles = maxTiles;
+}
+
+bool
+TileInvalidationQueue::isEmpty() const
+{
+    return m_pending.isEmpty();
+}
+
+bool
+TileInvalidationQueue::touches(const TileId &tileId) const
+{
+    foreach(const QVector<TileCoverage> &changes, m_pending)
+    {
+        foreach(const TileCoverage &tiles, changes)
+        {
+            if(tiles.touches(tileId.tileLevel(), tileId.x(), tileId.y()))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void
+TileInvalidationQueue::clear()
+{
+    m_timer.stop();
+    m_pending.clear();
+}
+
+void
+TileInvalidationQueue::add(const LayeredTileCoverage &tiles)
+{
+    for(auto it = tiles.constBegin(); it != tiles.constEnd(); ++it)
+    {
+        if(!it.value().isEmpty())
+        {
+            m_pending[it.key()].append(it.value());
+        }
+    }
+
+    if(!m_pending.isEmpty() && !m_timer.isActive())
+    {
+        m_timer.start();
+    }
+}
+
+void
+TileInvalidationQueue::flush()
+{
+    m_timer.stop();
+
+    if(m_pending.isEmpty())
+    {
+        return;
+    }
+
+    LayeredTileCoverage tiles;
+    int changeCount = 0;
+    for(auto it = m_pending.constBegin(); it != m_pending.constEnd(); ++it)
+    {
+        TileCoverage zLevelTiles;
+        zLevelTiles.unite(it.value());
+        tiles.insert(it.key(), zLevelTiles.coarsened(m_maxTiles));
+
+        changeCount += it.value().size();
+    }
+
+    m_pending.clear();
+
+    qDebug() << "TileInvalidationQueue::flush" << changeCount << "changes in" << tiles.size() << "z levels";
+
+    emit expired(tiles);
+}
+
+}
+
+//#include "moc_TileInvalidationQueue.cpp"
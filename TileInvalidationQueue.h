@@ -0,0 +1,82 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#ifndef MARBLE_TILEINVALIDATIONQUEUE_H
+#define MARBLE_TILEINVALIDATIONQUEUE_H
+
+#include <QtCore/QMap>
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+
+#include "TileCoverage.h"
+#include "TileId.h"
+
+namespace Marble
+{
+
+/**
+ * Collects the tiles changed by scene updates and hands them on in batches.
+ *
+ * Changes arriving within one interval are merged per z level and coarsened
+ * to a bounded number of tiles, so a burst of updates expires the affected
+ * tiles once instead of once per update. The first change of a batch starts
+ * the interval; later ones don't extend it, so a steady stream of updates
+ * is still flushed at the interval.
+ */
+class TileInvalidationQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TileInvalidationQueue(QObject *parent = nullptr);
+    ~TileInvalidationQueue() override;
+
+    int
+    interval() const;
+
+    /// Sets the time in milliseconds changes are collected before they are flushed.
+    void
+    setInterval(int msec);
+
+    /// Sets the number of tiles per z level beyond which the batch is coarsened.
+    void
+    setMaxTiles(int maxTiles);
+
+    bool
+    isEmpty() const;
+
+    /// Returns whether a collected change touches @p tileId, i.e. the tile is not expired yet.
+    bool
+    touches(const TileId &tileId) const;
+
+    /// Drops the collected changes, e.g. when all tiles are dropped anyway.
+    void
+    clear();
+
+public slots:
+    void
+    add(const LayeredTileCoverage &tiles);
+
+    /// Emits the collected changes right away.
+    void
+    flush();
+
+signals:
+    void
+    expired(const LayeredTileCoverage &tiles);
+
+private:
+    QTimer m_timer;
+    int m_maxTiles;
+    QMap<int /* z level */, QVector<TileCoverage> > m_pending;
+};
+
+}
+
+#endif // MARBLE_TILEINVALIDATIONQUEUE_H
@@ -0,0 +1,404 @@
+#define QT_NO_DEBUG_OUTPUT
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#include "TileRenderScheduler.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+#include "VectorTileLoader.h"
+#include "geodata/data/GeoDataCoordinates.h"
+#include "geodata/scene/GeoSceneTileDataset.h"
+
+namespace
+{
+
+// A tile one level away from the displayed one weighs as much as a tile this many tiles away from the center.
+const int LevelDistancePenalty = 16;
+
+}
+
+namespace Marble
+{
+
+class TileRenderSchedulerPrivate
+{
+public:
+    struct PendingJob
+    {
+        RenderJob *job;
+        quint64 serial;
+    };
+
+    // Pending jobs are ordered by priority, jobs of equal priority in the order they were scheduled.
+    typedef QPair<int, quint64> PendingKey;
+
+    explicit TileRenderSchedulerPrivate(TileRenderScheduler *parent)
+        :   q(parent),
+            m_tileData(nullptr),
+            m_centerLongitude(0),
+            m_centerLatitude(0),
+            m_tileZoomLevel(0),
+            m_visibleTiles(1),
+            m_nextSerial(0)
+    {
+        m_threadPool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+    }
+
+    TileId
+    centerTileId(int tileLevel) const;
+
+    int
+    distance(const TileId &tileId) const;
+
+    int
+    priority(const RenderJob *job) const;
+
+    void
+    enqueue(const PendingJob &pendingJob);
+
+    bool
+    takeNext(PendingJob &pendingJob);
+
+    void
+    finish(const PendingJob &pendingJob);
+
+    void
+    cancelSerial(quint64 serial);
+
+    void
+    forgetSerial(quint64 serial);
+
+    TileRenderScheduler *const q;
+
+    QThreadPool m_threadPool;
+
+    // guarded by m_mutex, touched by the workers
+    QMutex m_mutex;
+    QMap<PendingKey, PendingJob> m_pending;
+    QHash<quint64, int> m_pendingPriorities;
+    mutable QHash<int, TileId> m_centerTileIds;
+    QHash<quint64, RenderJob*> m_running;
+    const GeoSceneTileDataset *m_tileData;
+    qreal m_centerLongitude;
+    qreal m_centerLatitude;
+    int m_tileZoomLevel;
+    int m_visibleTiles;
+
+    // GUI thread only
+    QHash<TileId, quint64> m_current;
+    QHash<quint64, QList<TileId> > m_serialTiles;
+    quint64 m_nextSerial;
+};
+
+class RenderDispatcher : public QRunnable
+{
+public:
+    explicit RenderDispatcher(TileRenderSchedulerPrivate *scheduler)
+        :   m_scheduler(scheduler)
+    {
+    }
+
+    void
+    run() override
+    {
+        // Every dispatcher takes whatever job is most urgent at the time it gets a thread.
+        TileRenderSchedulerPrivate::PendingJob pendingJob;
+        if(m_scheduler->takeNext(pendingJob))
+        {
+            pendingJob.job->run();
+            m_scheduler->finish(pendingJob);
+        }
+    }
+
+private:
+    TileRenderSchedulerPrivate *const m_scheduler;
+};
+
+TileId
+TileRenderSchedulerPrivate::centerTileId(int tileLevel) const
+{
+    auto it = m_centerTileIds.find(tileLevel);
+    if(it == m_centerTileIds.end())
+    {
+        it = m_centerTileIds.insert(tileLevel, TileId::fromCoordinates(m_tileData, GeoDataCoordinates(m_centerLongitude, m_centerLatitude), tileLevel));
+    }
+
+    return it.value();
+}
+
+int
+TileRenderSchedulerPrivate::distance(const TileId &tileId) const
+{
+    if(!m_tileData)
+    {
+        return 0;
+    }
+
+    const TileId centerTileId = this->centerTileId(tileId.tileLevel());
+    const int columns = m_tileData->levelZeroColumns() << tileId.tileLevel();
+
+    int dx = qAbs(tileId.x() - centerTileId.x());
+    dx = qMin(dx, columns - dx);
+    const int dy = qAbs(tileId.y() - centerTileId.y());
+
+    return qMax(dx, dy);
+}
+
+int
+TileRenderSchedulerPrivate::priority(const RenderJob *job) const
+{
+    // A batch job is as urgent as the first tile of its block.
+    const TileId tileId = job->tileIds().first();
+
+    return qAbs(tileId.tileLevel() - m_tileZoomLevel) * LevelDistancePenalty + distance(tileId);
+}
+
+void
+TileRenderSchedulerPrivate::enqueue(const PendingJob &pendingJob)
+{
+    // The priority only changes with the viewport, so it is computed here and in setViewport().
+    const int tempPriority = priority(pendingJob.job);
+
+    m_pending.insert(PendingKey(tempPriority, pendingJob.serial), pendingJob);
+    m_pendingPriorities.insert(pendingJob.serial, tempPriority);
+}
+
+bool
+TileRenderSchedulerPrivate::takeNext(PendingJob &pendingJob)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if(m_pending.isEmpty())
+    {
+        return false;
+    }
+
+    pendingJob = m_pending.take(m_pending.firstKey());
+    m_pendingPriorities.remove(pendingJob.serial);
+    m_running.insert(pendingJob.serial, pendingJob.job);
+
+    return true;
+}
+
+void
+TileRenderSchedulerPrivate::finish(const PendingJob &pendingJob)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_running.remove(pendingJob.serial);
+    }
+
+    if(!pendingJob.job->isCancelled())
+    {
+        foreach(const RenderJob::Result &result, pendingJob.job->results())
+        {
+            emit q->jobFinished(result.tileId, pendingJob.serial, result.sparseTile, result.tile, result.compressedTile, result.layers, result.pickBuffer);
+        }
+    }
+
+    delete pendingJob.job;
+}
+
+void
+TileRenderSchedulerPrivate::cancelSerial(quint64 serial)
+{
+    QMutexLocker locker(&m_mutex);
+
+    auto it = m_pendingPriorities.find(serial);
+    if(it != m_pendingPriorities.end())
+    {
+        delete m_pending.take(PendingKey(it.value(), serial)).job;
+        m_pendingPriorities.erase(it);
+        return;
+    }
+
+    RenderJob *job = m_running.value(serial, nullptr);
+    if(job)
+    {
+        job->cancel();
+    }
+}
+
+void
+TileRenderSchedulerPrivate::forgetSerial(quint64 serial)
+{
+    // Cancelling one tile of a job drops all of its tiles, they are requested again when needed.
+    foreach(const TileId &tileId, m_serialTiles.take(serial))
+    {
+        m_current.remove(tileId);
+    }
+}
+
+TileRenderScheduler::TileRenderScheduler(QObject *parent)
+    :   QObject(parent),
+        d(new TileRenderSchedulerPrivate(this))
+{
+    qRegisterMetaType<TileId>( "TileId" );
+    qRegisterMetaType<GeometryTileLayers>( "GeometryTileLayers" );
+    qRegisterMetaType<PickBuffer>( "PickBuffer" );
+    qRegisterMetaType<SparseTileImage>( "SparseTileImage" );
+    connect(this, SIGNAL(jobFinished(TileId, quint64, SparseTileImage, QImage, QByteArray, GeometryTileLayers, PickBuffer)), SLOT(handleJobFinished(TileId, quint64, SparseTileImage, QImage, QByteArray, GeometryTileLayers, PickBuffer)), Qt::QueuedConnection);
+}
+
+TileRenderScheduler::~TileRenderScheduler()
+{
+    cancelAll();
+    d->m_threadPool.waitForDone();
+
+    delete d;
+}
+
+void
+TileRenderScheduler::setMaxThreadCount(int maxThreadCount)
+{
+    d->m_threadPool.setMaxThreadCount(qMax(1, maxThreadCount));
+}
+
+void
+TileRenderScheduler::setViewport(const GeoSceneTileDataset *tileData, qreal centerLongitude, qreal centerLatitude, int tileZoomLevel, int visibleTiles)
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    d->m_tileData = tileData;
+    d->m_centerLongitude = centerLongitude;
+    d->m_centerLatitude = centerLatitude;
+    d->m_tileZoomLevel = tileZoomLevel;
+    d->m_visibleTiles = qMax(1, visibleTiles);
+    d->m_centerTileIds.clear();
+
+    // Running jobs are left alone, they are about to deliver anyway. The others are queued again by their new priority.
+    const QList<TileRenderSchedulerPrivate::PendingJob> pendingJobs = d->m_pending.values();
+    d->m_pending.clear();
+    d->m_pendingPriorities.clear();
+
+    foreach(const TileRenderSchedulerPrivate::PendingJob &pendingJob, pendingJobs)
+    {
+        const TileId tileId = pendingJob.job->tileIds().first();
+
+        if(tileId.tileLevel() > tileZoomLevel + 1 || d->distance(tileId) > 2 * d->m_visibleTiles)
+        {
+            qDebug() << "TileRenderScheduler::setViewport cancel" << tileId.tileLevel() << tileId.x() << tileId.y();
+
+            d->forgetSerial(pendingJob.serial);
+            delete pendingJob.job;
+        }
+        else
+        {
+            d->enqueue(pendingJob);
+        }
+    }
+}
+
+void
+TileRenderScheduler::schedule(RenderJob *job)
+{
+    const QList<TileId> tileIds = job->tileIds();
+    foreach(const TileId &tileId, tileIds)
+    {
+        cancel(tileId);
+    }
+
+    TileRenderSchedulerPrivate::PendingJob pendingJob;
+    pendingJob.job = job;
+    pendingJob.serial = ++d->m_nextSerial;
+
+    foreach(const TileId &tileId, tileIds)
+    {
+        d->m_current.insert(tileId, pendingJob.serial);
+    }
+    d->m_serialTiles.insert(pendingJob.serial, tileIds);
+
+    {
+        QMutexLocker locker(&d->m_mutex);
+        d->enqueue(pendingJob);
+    }
+
+    d->m_threadPool.start(new RenderDispatcher(d));
+}
+
+bool
+TileRenderScheduler::contains(const TileId &tileId) const
+{
+    return d->m_current.contains(tileId);
+}
+
+QList<TileId>
+TileRenderScheduler::tileIds() const
+{
+    return d->m_current.keys();
+}
+
+void
+TileRenderScheduler::cancel(const TileId &tileId)
+{
+    auto it = d->m_current.find(tileId);
+    if(it != d->m_current.end())
+    {
+        const quint64 serial = it.value();
+
+        d->cancelSerial(serial);
+        d->forgetSerial(serial);
+    }
+}
+
+void
+TileRenderScheduler::cancelAll()
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    foreach(const TileRenderSchedulerPrivate::PendingJob &pendingJob, d->m_pending)
+    {
+        delete pendingJob.job;
+    }
+    d->m_pending.clear();
+    d->m_pendingPriorities.clear();
+
+    foreach(RenderJob *job, d->m_running)
+    {
+        job->cancel();
+    }
+
+    d->m_current.clear();
+    d->m_serialTiles.clear();
+}
+
+void
+TileRenderScheduler::handleJobFinished(const TileId &tileId, quint64 serial, const SparseTileImage &sparseTile, const QImage &tile, const QByteArray &compressedTile, const GeometryTileLayers &layers, const PickBuffer &pickBuffer)
+{
+    // Results of jobs that were cancelled or superseded after they finished are dropped here.
+    auto it = d->m_current.find(tileId);
+    if(it == d->m_current.end() || it.value() != serial)
+    {
+        qDebug() << "TileRenderScheduler::handleJobFinished dropping stale tile" << tileId.tileLevel() << tileId.x() << tileId.y();
+        return;
+    }
+
+    d->m_current.erase(it);
+
+    auto itSerial = d->m_serialTiles.find(serial);
+    if(itSerial != d->m_serialTiles.end())
+    {
+        itSerial.value().removeOne(tileId);
+        if(itSerial.value().isEmpty())
+        {
+            d->m_serialTiles.erase(itSerial);
+        }
+    }
+
+    emit finished(tileId, sparseTile, tile, compressedTile, layers, pickBuffer);
+}
+
+}
@@ -0,0 +1,93 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#ifndef MARBLE_TILERENDERSCHEDULER_H
+#define MARBLE_TILERENDERSCHEDULER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtGui/QImage>
+
+#include "GeometryTileStore.h"
+#include "PickBuffer.h"
+#include "SparseTileImage.h"
+#include "TileId.h"
+
+namespace Marble
+{
+
+class GeoSceneTileDataset;
+class RenderJob;
+class TileRenderSchedulerPrivate;
+
+/**
+ * Runs geometry tile render jobs on a bounded worker pool.
+ *
+ * Pending jobs are not processed in FIFO order: whenever a worker becomes
+ * free it picks the job closest to the current viewport, preferring tiles at
+ * the displayed zoom level. Cancelling never blocks; a running job is flagged
+ * and its result is dropped.
+ */
+class TileRenderScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TileRenderScheduler(QObject *parent = nullptr);
+    ~TileRenderScheduler() override;
+
+    void
+    setMaxThreadCount(int maxThreadCount);
+
+    /**
+     * Updates the viewport the priorities are computed against. Pending jobs
+     * for tiles far away from it are cancelled.
+     */
+    void
+    setViewport(const GeoSceneTileDataset *tileData, qreal centerLongitude, qreal centerLatitude, int tileZoomLevel, int visibleTiles);
+
+    /**
+     * Queues @p job, taking ownership of it. Jobs already scheduled for any
+     * of its tiles are cancelled.
+     */
+    void
+    schedule(RenderJob *job);
+
+    bool
+    contains(const TileId &tileId) const;
+
+    QList<TileId>
+    tileIds() const;
+
+    void
+    cancel(const TileId &tileId);
+
+    void
+    cancelAll();
+
+signals:
+    void
+    finished(const TileId &tileId, const SparseTileImage &sparseTile, const QImage &tile, const QByteArray &compressedTile, const GeometryTileLayers &layers, const PickBuffer &pickBuffer);
+
+    void
+    jobFinished(const TileId &tileId, quint64 serial, const SparseTileImage &sparseTile, const QImage &tile, const QByteArray &compressedTile, const GeometryTileLayers &layers, const PickBuffer &pickBuffer);
+
+private slots:
+    void
+    handleJobFinished(const TileId &tileId, quint64 serial, const SparseTileImage &sparseTile, const QImage &tile, const QByteArray &compressedTile, const GeometryTileLayers &layers, const PickBuffer &pickBuffer);
+
+private:
+    friend class TileRenderSchedulerPrivate;
+
+    TileRenderSchedulerPrivate *d;
+};
+
+}
+
+#endif // MARBLE_TILERENDERSCHEDULER_H
@@ -31,6 +31,23 @@
 
 using namespace Marble;
 
+namespace
+{
+
+// The part of a possibly lower level tile that covers stackedId.
+QRect tilePart( const StackedTile *tile, const TileId &stackedId )
+{
+    const int deltaLevel = stackedId.tileLevel() - tile->id().tileLevel();
+    const int restTileX = stackedId.x() % ( 1 << deltaLevel );
+    const int restTileY = stackedId.y() % ( 1 << deltaLevel );
+    const int partWidth = tile->size().width() >> deltaLevel;
+    const int partHeight = tile->size().height() >> deltaLevel;
+
+    return QRect( restTileX * partWidth, restTileY * partHeight, partWidth, partHeight );
+}
+
+}
+
 TileScalingTextureMapper::TileScalingTextureMapper( StackedTileLoader *tileLoader, QObject *parent )
     : QObject( parent ),
       TextureMapperInterface(),
@@ -116,6 +133,10 @@ void TileScalingTextureMapper::mapTexture( GeoPainter *painter, const ViewportPa
         m_cache.clear();
     }
 
+    // The cache counts pixmaps, with small tiles a fixed count would not even hold the visible ones.
+    const int visibleTileCount = ( maxTileX - minTileX + 1 ) * ( maxTileY - minTileY + 1 );
+    m_cache.setMaxCost( qMax( 100, 2 * visibleTileCount ) );
+
     if ( texColorizer || m_radius != radius ) {
         QPainter imagePainter( &m_canvasImage );
         imagePainter.setRenderHint( QPainter::SmoothPixmapTransform, highQuality );
@@ -132,15 +153,14 @@ void TileScalingTextureMapper::mapTexture( GeoPainter *painter, const ViewportPa
 
                 const StackedTile *const tile = m_tileLoader->loadTile( stackedId );
 
+                if ( tile->isSparse() ) {
+                    tile->sparseImage().draw( &imagePainter, rect, tilePart( tile, stackedId ) );
+                    continue;
+                }
+
                 const QImage *const toScale = tile->resultImage();
-                const int deltaLevel = stackedId.tileLevel() - tile->id().tileLevel();
-                const int restTileX = stackedId.x() % ( 1 << deltaLevel );
-                const int restTileY = stackedId.y() % ( 1 << deltaLevel );
-                const int partWidth = toScale->width() >> deltaLevel;
-                const int partHeight = toScale->height() >> deltaLevel;
-                const int startX = restTileX * partWidth;
-                const int startY = restTileY * partHeight;
-                const QImage part = toScale->copy( startX, startY, partWidth, partHeight ).scaled( toScale->size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+                const QRect partRect = tilePart( tile, stackedId );
+                const QImage part = toScale->copy( partRect ).scaled( toScale->size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
 
                 imagePainter.drawImage( rect, part );
             }
@@ -170,16 +190,13 @@ void TileScalingTextureMapper::mapTexture( GeoPainter *painter, const ViewportPa
 
                 const QPixmap *const im_cached = m_cache[cacheId];
                 const QPixmap *im = im_cached;
-                if ( im == nullptr ) {
+                if ( im == nullptr && tile->isSparse() ) {
+                    // sparse tiles are scaled block by block, they are never expanded
+                    im = new QPixmap( QPixmap::fromImage( tile->sparseImage().scaled( tilePart( tile, stackedId ), size ) ) );
+                }
+                else if ( im == nullptr ) {
                     const QImage *const toScale = tile->resultImage();
-                    const int deltaLevel = stackedId.tileLevel() - tile->id().tileLevel();
-                    const int restTileX = stackedId.x() % ( 1 << deltaLevel );
-                    const int restTileY = stackedId.y() % ( 1 << deltaLevel );
-                    const int partWidth = toScale->width() >> deltaLevel;
-                    const int partHeight = toScale->height() >> deltaLevel;
-                    const int startX = restTileX * partWidth;
-                    const int startY = restTileY * partHeight;
-                    const QImage part = toScale->copy( startX, startY, partWidth, partHeight ).scaled( toScale->size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+                    const QImage part = toScale->copy( tilePart( tile, stackedId ) ).scaled( toScale->size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
 
                     im = new QPixmap( QPixmap::fromImage( part.scaled( size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation ) ) );
                 }
@@ -34,6 +34,7 @@
 #include <QtConcurrent/QtConcurrentRun>
 
 #include <QtGui/QImage>
+#include <QtGui/QPainter>
 #include <QtGui/QGuiApplication>
 #include <QtGui/QOpenGLPaintDevice>
 #include <QtGui/QOpenGLFramebufferObjectFormat>
@@ -57,33 +58,201 @@
 #include "GeoPainter.h"
 #include "ViewportParams.h"
 #include "graphicsview/GeoGraphicsItem.h"
+#include "geodata/data/GeoDataFeature.h"
+#include "geodata/data/GeoDataLineStyle.h"
+#include "geodata/data/GeoDataMultiPoint.h"
+#include "geodata/data/GeoDataPlacemark.h"
+#include "geodata/data/GeoDataPoint.h"
+#include "geodata/data/GeoDataPolyStyle.h"
+#include "geodata/data/GeoDataStyle.h"
+#include "geodata/parser/GeoDataTypes.h"
 
 Q_DECLARE_METATYPE( Marble::DownloadUsage )
 
 static qint64 MaxTileBackingStoreSize = 30 * 1024 * 1024;
+static qint64 DefaultBatchMemoryBudget = 128 * 1024 * 1024;
+
+// Drafts treat this many pixels as one, which drops most vertices of dense geometries.
+static qreal DraftResolutionScale = 8.0;
+
+// Pick buffers have a fraction of the tile resolution, picking doesn't need single pixels.
+static int PickBufferScale = 4;
 
 namespace
 {
 
 
-QImage
-getEmptyImage(const QSize &size, double pixelRatio)
+Marble::SparseTileImage
+getEmptyTile(const QSize &size, double pixelRatio)
+{
+    return Marble::SparseTileImage::uniform(size * pixelRatio, 0, pixelRatio);
+}
+
+// Averages four premultiplied ARGB32 pixels channel-wise. Red/blue and alpha/green are summed
+// in two 16 bit lanes each, so a single 32 bit add handles two channels without overflow.
+inline quint32
+averagePixels(quint32 a, quint32 b, quint32 c, quint32 d)
+{
+    const quint32 mask = 0x00ff00ff;
+    const quint32 rounding = 0x00020002;
+
+    const quint32 rb = (a & mask) + (b & mask) + (c & mask) + (d & mask) + rounding;
+    const quint32 ag = ((a >> 8) & mask) + ((b >> 8) & mask) + ((c >> 8) & mask) + ((d >> 8) & mask) + rounding;
+
+    return ((rb >> 2) & mask) | (((ag >> 2) & mask) << 8);
+}
+
+// Writes @p source scaled down by two into @p target at @p offset.
+void
+downsampleInto(const QImage &source, QImage &target, const QPoint &offset)
+{
+    const int width = qMin(source.width() / 2, target.width() - offset.x());
+    const int height = qMin(source.height() / 2, target.height() - offset.y());
+
+    for(int y = 0; y < height; ++y)
+    {
+        const quint32 *upper = reinterpret_cast<const quint32*>(source.constScanLine(2 * y));
+        const quint32 *lower = reinterpret_cast<const quint32*>(source.constScanLine(2 * y + 1));
+        quint32 *out = reinterpret_cast<quint32*>(target.scanLine(offset.y() + y)) + offset.x();
+
+        for(int x = 0; x < width; ++x)
+        {
+            out[x] = averagePixels(upper[2 * x], upper[2 * x + 1], lower[2 * x], lower[2 * x + 1]);
+        }
+    }
+}
+
+qreal
+devicePixelRatio()
+{
+    qreal pixelRatio = 1.0;
+
+    if ( qApp )
+        pixelRatio = qApp->devicePixelRatio();
+
+    return pixelRatio;
+}
+
+void
+tileCenter(const Marble::GeoSceneTileDataset *tileData, const Marble::TileId &tileId, qreal &lon, qreal &lat)
+{
+    qreal count = ( 1 << tileId.tileLevel() ) * tileData->levelZeroColumns() / 2.0;
+    lon   = ( tileId.x() - count + 0.5) / count * M_PI;
+
+    count = ( 1 << tileId.tileLevel() ) * tileData->levelZeroRows() / 2.0;
+    lat = 0;
+    switch ( tileData->projection() ) {
+    case Marble::GeoSceneTileDataset::Equirectangular:
+        lat = count - tileId.y() - 0.5 / count * M_PI / 2.0;
+        break;
+    case Marble::GeoSceneTileDataset::Mercator:
+        lat = atan( sinh( ( count - tileId.y() - 0.5 ) / count * M_PI ) );
+        break;
+    }
+}
+
+int
+tileRadius(const Marble::GeoSceneTileDataset *tileData, int tileLevel)
+{
+    // choose the smaller dimension for selecting the tile level, leading to higher-resolution results
+    const int levelZeroWidth = tileData->tileSize().width() * tileData->levelZeroColumns();
+    const int levelZeroHight = tileData->tileSize().height() * tileData->levelZeroRows();
+    const int levelZeroMinDimension = qMin( levelZeroWidth, levelZeroHight );
+
+    double tileLevelF = tileLevel;
+    double linearLevel = qExp(tileLevelF * qLn( 2.0 ) );
+
+    if ( linearLevel < 1.0 )
+        linearLevel = 1.0; // Dirty fix for invalid entry linearLevel
+
+    qreal radius =  (static_cast<double>( levelZeroMinDimension ) * linearLevel) /4.0 ;
+
+    qDebug() << "Radius" << radius;
+
+    return qRound(radius);
+}
+
+Marble::Projection
+tileProjection(const Marble::GeoSceneTileDataset *tileData)
+{
+    if(tileData->projection() == Marble::GeoSceneTileDataset::Equirectangular)
+    {
+        return Marble::Projection::Equirectangular;
+    }
+
+    return Marble::Projection::Mercator;
+}
+
+// Only items the hit test considers get into pick buffers.
+bool
+isPickable(const Marble::GeoGraphicsItemPtr &item)
 {
-    static QMutex mutex;
-    QMutexLocker locker(&mutex);
+    const Marble::GeoDataFeature *feature = item->feature();
+
+    return feature->nodeType() == Marble::GeoDataTypes::GeoDataPlacemarkType &&
+           feature->isVisible() &&
+           item->style() &&
+           feature->hightlighStyle();
+}
 
-    static QHash<int, QHash<int, QHash<double, QImage> > > imageCache;
+// Returns @p style painting everything in @p color, with solid lines widened by @p radius pixels on
+// each side. Line widths are given in the pixels of a tile rendered at @p tileRadius, scaled down by @p scale.
+Marble::GeoDataStyle::ConstPtr
+pickStyle(const Marble::GeoDataStyle::ConstPtr &style, QRgb color, int tileRadius, int scale, int radius)
+{
+    Marble::GeoDataStyle::Ptr result(new Marble::GeoDataStyle(*style));
 
-    if(!imageCache.contains(size.width()) || !imageCache[size.width()].contains(size.height()) || !imageCache[size.width()][size.height()].contains(pixelRatio))
+    Marble::GeoDataLineStyle &lineStyle = result->lineStyle();
+    double width = lineStyle.width();
+    if(lineStyle.physicalWidth() != 0.0)
     {
-        QImage image = QImage( size * pixelRatio , QImage::Format_ARGB32_Premultiplied);
-        image.fill(Qt::transparent);
-        image.setDevicePixelRatio( pixelRatio );
+        width = qMax(width, double(tileRadius) / Marble::EARTH_RADIUS * lineStyle.physicalWidth());
+    }
+
+    lineStyle.setColor(QColor::fromRgb(color));
+    lineStyle.setColorMode(Marble::GeoDataColorStyle::Normal);
+    lineStyle.setPhysicalWidth(0.0);
+    lineStyle.setWidth(qMax(width, 1.0) / scale + 2.0 * radius / scale);
+    lineStyle.setPenStyle(Qt::SolidLine);
+    lineStyle.setBackground(false);
+
+    Marble::GeoDataPolyStyle &polyStyle = result->polyStyle();
+    polyStyle.setColor(QColor::fromRgb(color));
+    polyStyle.setColorMode(Marble::GeoDataColorStyle::Normal);
+    polyStyle.setBrushStyle(Qt::SolidPattern);
+    polyStyle.setTexturePath(QString());
+    polyStyle.setOutline(true);
+
+    return result;
+}
 
-        imageCache[size.width()][size.height()].insert(pixelRatio, image);
+// Points aren't drawn into tiles, their surroundings are marked instead.
+void
+renderPickPoints(Marble::GeoPainter &painter, const Marble::ViewportParams &viewport, const Marble::GeoDataGeometry *geometry, QRgb color, int radius)
+{
+    QVector<Marble::GeoDataCoordinates> points;
+    if(geometry->nodeType() == Marble::GeoDataTypes::GeoDataPointType)
+    {
+        points.append(static_cast<const Marble::GeoDataPoint*>(geometry)->coordinates());
+    }
+    else if(geometry->nodeType() == Marble::GeoDataTypes::GeoDataMultiPointType)
+    {
+        const Marble::GeoDataMultiPoint *multiPoint = static_cast<const Marble::GeoDataMultiPoint*>(geometry);
+        for(int i = 0; i < multiPoint->size(); ++i)
+        {
+            points.append(multiPoint->at(i));
+        }
     }
 
-    return imageCache[size.width()][size.height()][pixelRatio];
+    foreach(const Marble::GeoDataCoordinates &point, points)
+    {
+        qreal x;
+        qreal y;
+        if(viewport.screenCoordinates(point, x, y))
+        {
+            painter.fillRect(QRectF(x - radius, y - radius, 2 * radius + 1, 2 * radius + 1), QColor::fromRgb(color));
+        }
+    }
 }
 
 }
@@ -93,10 +262,12 @@ namespace Marble
 class GeometryTile : public Tile
 {
  public:
-    GeometryTile(Marble::TileId const & tileId, QImage const & image )
+    GeometryTile(Marble::TileId const & tileId, SparseTileImage const & image, VectorTileLoader::TileQuality quality = VectorTileLoader::FullQuality, PickBuffer const & pickBuffer = PickBuffer() )
         :   Tile(tileId),
             aImage(image),
-            aIsExpired(false),
+            aPickBuffer(pickBuffer),
+            aQuality(quality),
+            aIsExpired(quality == VectorTileLoader::DraftQuality),
             aIsUsed(false)
     {
 
@@ -105,16 +276,28 @@ class GeometryTile : public Tile
     
     ~GeometryTile() override;
 
-    const QImage &
+    const SparseTileImage &
     image() const
     {
         return aImage;
     }
 
+    const PickBuffer &
+    pickBuffer() const
+    {
+        return aPickBuffer;
+    }
+
     int
     byteCount() const
     {
-        return aImage.byteCount();
+        return aImage.byteCount() + aPickBuffer.byteCount();
+    }
+
+    VectorTileLoader::TileQuality
+    quality() const
+    {
+        return aQuality;
     }
 
     bool
@@ -143,7 +326,9 @@ class GeometryTile : public Tile
 
 
  private:
-    QImage const aImage;
+    SparseTileImage const aImage;
+    PickBuffer const aPickBuffer;
+    VectorTileLoader::TileQuality const aQuality;
     bool aIsExpired;
     bool aIsUsed;
 };
@@ -152,7 +337,7 @@ GeometryTile::~GeometryTile()
 = default;
 
 
-RenderJob::RenderJob(Projection projection, qreal centerLongitude, qreal centerLatitude, int radius,  const QSize &size, QList< GeoGraphicsItemPtr > items , const TileId &tileId, QString tileDir)
+RenderJob::RenderJob(Projection projection, qreal centerLongitude, qreal centerLatitude, int radius,  const QSize &size, QList< GeoGraphicsItemPtr > items , const TileId &tileId, GeometryTileStore::Compression compression, const QMap<int, QImage> &cachedLayers)
     :   aCancel(false),
         aProjection(projection),
         aCenterLongitude(centerLongitude),
@@ -161,7 +346,11 @@ RenderJob::RenderJob(Projection projection, qreal centerLongitude, qreal centerL
         aSize(size),
         aItems(std::move(items)),
         aTileId(tileId),
-        aTileDir(std::move(tileDir))
+        aCompression(compression),
+        aCachedLayers(cachedLayers),
+        aIsDraft(false),
+        aPickRadius(0),
+        aPickSceneVersion(0)
 {
 }
 
@@ -175,33 +364,134 @@ void RenderJob::run()
     QTime timer;
     timer.start();
 
-    qDebug() << "VectorTileLoader::RenderJob::run" << aItems.size();
+    qDebug() << "VectorTileLoader::RenderJob::run" << aItems.size() << aCachedLayers.size();
     qreal pixelRatio = 1.0;
 
     if ( qApp )
         pixelRatio = qApp->devicePixelRatio();
 
-    MapQuality mapQuality = MapQuality::HighQuality;
-    const double ScaleFactor = 1; //(mapQuality == MapQuality::HighQuality || mapQuality == MapQuality::PrintQuality) ? 1.5 : 1;
+    // Everything painted before an opaque item filling the whole tile is hidden by it.
+    QList<GeoGraphicsItemPtr> items = aItems;
+    QColor fillColor;
+    bool filled = false;
+    for(int i = aItems.size() - 1; i >= 0 && !aFullItems.isEmpty(); --i)
+    {
+        const GeoGraphicsItemPtr &item = aItems.at(i);
+        if(aFullItems.contains(item.data()) && item->opaqueFillColor(item->style(), fillColor))
+        {
+            items = aItems.mid(i);
+            filled = true;
+            break;
+        }
+    }
 
-    ViewportParams viewport(aProjection, aCenterLongitude, aCenterLatitude, qFloor(aRadius), aSize);
+    // The items arrive in ascending z order, grouping them keeps that order within each sublayer.
+    QMap<int, QList<GeoGraphicsItemPtr> > layerItems;
+    foreach( const GeoGraphicsItemPtr& item, items )
+    {
+        layerItems[item->feature()->zLevel()].append(item);
+    }
+
+    QMap<int, bool> zLevels;
+    foreach(int zLevel, layerItems.keys() + aCachedLayers.keys())
+    {
+        zLevels.insert(zLevel, aCachedLayers.contains(zLevel));
+    }
+
+    const bool keepLayers = zLevels.size() > 1 && !aIsDraft;
+
+    // A uniform tile is kept as its colour only, no pixels are painted or stored for it.
+    if(filled && items.size() == 1 && aCachedLayers.isEmpty())
+    {
+        if(!aCancel)
+        {
+            aSparseTile = SparseTileImage::uniform(aSize * pixelRatio, qPremultiply(fillColor.rgba()), pixelRatio);
+        }
+
+        renderPickBuffer();
 
-    QImage pm = QImage( aSize * pixelRatio  * ScaleFactor, QImage::Format_ARGB32_Premultiplied);
+        qDebug() << "VectorTileLoader::RenderJob::run filled" << timer.elapsed();
+        return;
+    }
+
+    QImage pm = QImage( aSize * pixelRatio, QImage::Format_ARGB32_Premultiplied);
     pm.fill(Qt::transparent);
     pm.setDevicePixelRatio( pixelRatio );
 
-    GeoPainter tempGeoPainter(&pm, &viewport, MapQuality::HighQuality);
-//    tempGeoPainter.setClipRect(QRect(QPoint(0,0), pm.size()+QSize(1,1)));
-    tempGeoPainter.scale(ScaleFactor, ScaleFactor);
-
     qDebug() << "VectorTileLoader::RenderJob::run before render" << timer.elapsed();
 
-    foreach( const GeoGraphicsItemPtr& item, aItems )
+    if(!keepLayers && aCachedLayers.isEmpty())
     {
-        if(aCancel)
+        if(!renderItems(pm, items))
         {
             return;
         }
+    }
+    else
+    {
+        QPainter compositor(&pm);
+
+        auto it = zLevels.constBegin();
+        auto itEnd = zLevels.constEnd();
+        for(; it != itEnd; ++it)
+        {
+            if(it.value())
+            {
+                compositor.drawImage(QPoint(0, 0), aCachedLayers.value(it.key()));
+                continue;
+            }
+
+            QImage layer = QImage( aSize * pixelRatio, QImage::Format_ARGB32_Premultiplied);
+            layer.fill(Qt::transparent);
+            layer.setDevicePixelRatio( pixelRatio );
+
+            if(!renderItems(layer, layerItems.value(it.key())))
+            {
+                return;
+            }
+
+            compositor.drawImage(QPoint(0, 0), layer);
+
+            if(keepLayers)
+            {
+                aLayers[it.key()].image = layer;
+            }
+        }
+    }
+
+    qDebug() << "VectorTileLoader::RenderJob::run after render" << timer.elapsed();
+
+    aTile = pm;
+
+    packTile();
+    compressTile();
+    renderPickBuffer();
+
+    qDebug() << "VectorTileLoader::RenderJob::run finished" << timer.elapsed();
+}
+
+bool RenderJob::renderItems(QImage &image, const QList<GeoGraphicsItemPtr> &items)
+{
+    MapQuality mapQuality = aIsDraft ? MapQuality::LowQuality : MapQuality::HighQuality;
+
+    ViewportParams viewport(aProjection, aCenterLongitude, aCenterLatitude, qFloor(aRadius), aSize);
+
+    // Lets the projections and image renderers stop in the middle of an item once the job is cancelled.
+    viewport.setCancelFlag(&aCancel);
+
+    if(aIsDraft)
+    {
+        viewport.setResolutionScale(DraftResolutionScale);
+    }
+
+    GeoPainter tempGeoPainter(&image, &viewport, MapQuality::HighQuality);
+
+    foreach( const GeoGraphicsItemPtr& item, items )
+    {
+        if(aCancel)
+        {
+            return false;
+        }
 
         MapQuality tempMapQuality = mapQuality;
         if((tempMapQuality == MapQuality::HighQuality || tempMapQuality == MapQuality::PrintQuality) && item->style() && !item->style()->useAntialising())
@@ -209,445 +499,1010 @@ void RenderJob::run()
             tempMapQuality = MapQuality::LowQuality;
         }
 
+        QColor fillColor;
+        if(aFullItems.contains(item.data()) && item->opaqueFillColor(item->style(), fillColor))
+        {
+            tempGeoPainter.fillRect(QRect(QPoint(0, 0), aSize), fillColor);
+            continue;
+        }
+
         tempGeoPainter.setMapQuality(tempMapQuality);
 
-        item->renderGeometry(&tempGeoPainter, &viewport, item->style() );
+        item->renderTileGeometry(&tempGeoPainter, &viewport, item->style(), aTileId );
     }
 
+    return !aCancel;
+}
 
-    qDebug() << "VectorTileLoader::RenderJob::run after render" << timer.elapsed();
+void RenderJob::renderPickBuffer()
+{
+    if(aPickItems.isEmpty() || aIsDraft || aCancel)
+    {
+        return;
+    }
+
+    // Every item is painted in its own color without antialiasing, so each pixel holds the id of the topmost item.
+    const QSize size = aSize / PickBufferScale;
+    ViewportParams viewport(aProjection, aCenterLongitude, aCenterLatitude, qFloor(aRadius) / PickBufferScale, size);
+    viewport.setCancelFlag(&aCancel);
+
+    QImage ids(size, QImage::Format_RGB32);
+    ids.fill(PickBuffer::idColor(0));
 
-    if(qFuzzyCompare(ScaleFactor, 1.0))
+    QVector<QWeakPointer<GeoGraphicsItem> > items;
+    items.reserve(aPickItems.size());
+
+    GeoPainter painter(&ids, &viewport, MapQuality::LowQuality);
+    foreach(const GeoGraphicsItemPtr &item, aPickItems)
     {
-        aTile = pm;
+        if(aCancel)
+        {
+            return;
+        }
+
+        if(!isPickable(item))
+        {
+            continue;
+        }
+
+        items.append(item.toWeakRef());
+        const QRgb color = PickBuffer::idColor(items.size());
+
+        QColor fillColor;
+        if(aFullItems.contains(item.data()) && item->opaqueFillColor(item->style(), fillColor))
+        {
+            painter.fillRect(QRect(QPoint(0, 0), size), QColor::fromRgb(color));
+            continue;
+        }
+
+        const GeoDataGeometry *geometry = static_cast<const GeoDataPlacemark*>(item->feature())->geometry();
+        if(geometry && (geometry->nodeType() == GeoDataTypes::GeoDataPointType || geometry->nodeType() == GeoDataTypes::GeoDataMultiPointType))
+        {
+            renderPickPoints(painter, viewport, geometry, color, qMax(1, qCeil(double(aPickRadius) / PickBufferScale)));
+            continue;
+        }
+
+        painter.setMapQuality(MapQuality::LowQuality);
+        item->renderTileGeometry(&painter, &viewport, pickStyle(item->style(), color, aRadius, PickBufferScale, aPickRadius), aTileId);
     }
-    else
+
+    painter.end();
+
+    if(!aCancel)
     {
-        aTile = pm.scaled(aSize * pixelRatio, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        aPickBuffer = PickBuffer(ids, items, aSize, aPickSceneVersion);
     }
+}
 
-    if(QDir(aTileDir).exists())
+void RenderJob::packTile()
+{
+    if(!aCancel)
     {
-        bool ok = aTile.save(aTileDir + QString("/tile_%1_%2_%3.png").arg(aTileId.tileLevel()).arg(aTileId.x()).arg(aTileId.y()), "PNG");
-        qDebug() << "VectorTileLoader::RenderJob::run file saved" << ok << aTileDir << aTileDir + QString("/tile_%1_%2_%3.png").arg(aTileId.tileLevel()).arg(aTileId.x()).arg(aTileId.y());
+        aSparseTile = SparseTileImage::fromImage(aTile);
     }
+}
 
+void RenderJob::compressTile()
+{
+    if(aCompression != GeometryTileStore::NoCompression && !aCancel && !aIsDraft)
+    {
+        aCompressedTile = GeometryTileStore::compress(aTile);
 
-    qDebug() << "VectorTileLoader::RenderJob::run finished" << timer.elapsed();
+        for(auto it = aLayers.begin(); it != aLayers.end(); ++it)
+        {
+            it.value().compressedBits = GeometryTileStore::compress(it.value().image);
+        }
+    }
 }
 
+QList<TileId> RenderJob::tileIds() const
+{
+    return QList<TileId>() << aTileId;
+}
 
-VectorTileLoader::VectorTileLoader(GeoGraphicsScene *scene)
-    :   m_scene(scene),
-        m_cacheSize(0),
-        dir(new QTemporaryDir()),
-        mutex(new QMutex(QMutex::Recursive))
+QVector<RenderJob::Result> RenderJob::results() const
 {
-    qRegisterMetaType<TileId>( "TileId" );
-    connect(this, SIGNAL(startRenderTile(GeoSceneTileDataset  const *, TileId)), SLOT(renderTile(GeoSceneTileDataset const *, TileId)), Qt::QueuedConnection);
+    Result result;
+    result.tileId = aTileId;
+    result.sparseTile = aSparseTile;
+    result.tile = aTile;
+    result.compressedTile = aCompressedTile;
+    result.layers = aLayers;
+    result.pickBuffer = aPickBuffer;
+
+    return QVector<Result>() << result;
 }
 
-VectorTileLoader::~VectorTileLoader()
+DownsampleJob::DownsampleJob(const QSize &size, const QVector<SparseTileImage> &childTiles, const TileId &tileId, GeometryTileStore::Compression compression)
+    :   RenderJob(Projection::Mercator, 0, 0, 0, size, QList< GeoGraphicsItemPtr >(), tileId, compression),
+        aChildTiles(childTiles)
 {
-    qDeleteAll( m_tilesOnDisplay );
-    qDeleteAll( m_tileCache );
-    delete mutex;
-    delete dir;
 }
 
-// If the tile image file is locally available:
-//     - if not expired: create ImageTile, set state to "uptodate", return it => done
-//     - if expired: create GeometryTile, state is set to Expired by default, trigger dl,
-QImage
-VectorTileLoader::loadTileImage( GeoSceneTextureTileDataset const *textureLayer, TileId const & tileId, DownloadUsage const usage )
+void DownsampleJob::run()
 {
-    QMutexLocker locker(mutex);
+    QTime timer;
+    timer.start();
 
-    TileStatus status = tileStatus( textureLayer, tileId );
-    if ( status != Missing ) {
-        // check if an update should be triggered
+    qreal pixelRatio = 1.0;
 
-        if ( status == Available )
+    if ( qApp )
+        pixelRatio = qApp->devicePixelRatio();
+
+    QImage pm = QImage( aSize * pixelRatio, QImage::Format_ARGB32_Premultiplied);
+    pm.fill(Qt::transparent);
+
+    const int halfWidth = pm.width() / 2;
+    const int halfHeight = pm.height() / 2;
+
+    for(int i = 0; i < aChildTiles.size() && i < 4; ++i)
+    {
+        if(aCancel)
         {
-            mDebug() << Q_FUNC_INFO << tileId << "StateUptodate";
+            return;
         }
-        else
-        {
-            Q_ASSERT( status == Expired );
-            mDebug() << Q_FUNC_INFO << tileId << "StateExpired";
 
-            if(!tileRenderJobMap.contains(tileId))
-            {
-                triggerCreate( textureLayer, tileId, usage );
-            }
+        // empty children are passed as null images
+        const SparseTileImage &sparseChild = aChildTiles.at(i);
+        if(sparseChild.isNull() || (sparseChild.isUniform() && sparseChild.uniformColor() == 0))
+        {
+            continue;
         }
 
-        GeometryTile * stackedTile = m_tilesOnDisplay.value( tileId, nullptr );
-        if ( stackedTile )
+        QImage child = sparseChild.toImage();
+
+        if(child.format() != QImage::Format_ARGB32_Premultiplied)
         {
-            stackedTile->setUsed( true );
-            return stackedTile->image();
+            child = child.convertToFormat(QImage::Format_ARGB32_Premultiplied);
         }
 
-        stackedTile = m_tileCache.take( tileId );
-        if(!stackedTile && m_emptyTiles.contains(tileId))
-        {
-            qreal pixelRatio = 1.0;
+        downsampleInto(child, pm, QPoint((i % 2) * halfWidth, (i / 2) * halfHeight));
+    }
 
-            if ( qApp )
-                pixelRatio = qApp->devicePixelRatio();
+    pm.setDevicePixelRatio( pixelRatio );
+    aTile = pm;
 
-            stackedTile = new GeometryTile(tileId, getEmptyImage(textureLayer->tileSize(), pixelRatio));
-        }
+    packTile();
+    compressTile();
 
-        if ( stackedTile ) {
-            stackedTile->setUsed( true );
-            m_cacheSize -= stackedTile->byteCount();
-            m_cacheTiles.removeOne(tileId);
-            m_tilesOnDisplay[ tileId ] = stackedTile;
-            return stackedTile->image();
-        }
+    qDebug() << "VectorTileLoader::DownsampleJob::run finished" << timer.elapsed();
+}
 
-        QString tileFileName = dir->path() + QString("/tile_%1_%2_%3.png").arg(tileId.tileLevel()).arg(tileId.x()).arg(tileId.y());
-        if(QFileInfo::exists(tileFileName))
-        {
-            QFile file;
-            QImage image = QImage(tileFileName, "PNG");
-            if(!image.isNull() && image.size() == textureLayer->tileSize())
-            {
-                image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+BatchRenderJob::BatchRenderJob(Projection projection, qreal centerLongitude, qreal centerLatitude, int radius, const QSize &tileSize, int blockSize, QList< GeoGraphicsItemPtr > items, const TileId &blockTileId, const QList<TileId> &tileIds, GeometryTileStore::Compression compression)
+    :   RenderJob(projection, centerLongitude, centerLatitude, radius, tileSize * blockSize, std::move(items), blockTileId, compression),
+        aTileSize(tileSize),
+        aBlockSize(blockSize),
+        aTileIds(tileIds)
+{
+}
+
+void BatchRenderJob::run()
+{
+    QTime timer;
+    timer.start();
+
+    qDebug() << "VectorTileLoader::BatchRenderJob::run" << aItems.size() << aBlockSize << aTileIds.size();
+
+    const qreal pixelRatio = devicePixelRatio();
+
+    QImage pm = QImage( aSize * pixelRatio, QImage::Format_ARGB32_Premultiplied);
+    pm.fill(Qt::transparent);
+    pm.setDevicePixelRatio( pixelRatio );
+
+    if(!renderItems(pm, aItems))
+    {
+        return;
+    }
+
+    qDebug() << "VectorTileLoader::BatchRenderJob::run after render" << timer.elapsed();
+
+    const QSize tileSize = aTileSize * pixelRatio;
+    const int originX = aTileId.x() * aBlockSize;
+    const int originY = aTileId.y() * aBlockSize;
+
+    foreach(const TileId &tileId, aTileIds)
+    {
+        if(aCancel)
+        {
+            return;
+        }
+
+        Result result;
+        result.tileId = tileId;
+        result.tile = pm.copy(QRect(QPoint((tileId.x() - originX) * tileSize.width(), (tileId.y() - originY) * tileSize.height()), tileSize));
+        result.tile.setDevicePixelRatio( pixelRatio );
+        result.sparseTile = SparseTileImage::fromImage(result.tile);
+
+        if(aCompression != GeometryTileStore::NoCompression && !aIsDraft)
+        {
+            result.compressedTile = GeometryTileStore::compress(result.tile);
+        }
+
+        aResults.append(result);
+    }
+
+    qDebug() << "VectorTileLoader::BatchRenderJob::run finished" << timer.elapsed();
+}
+
+QList<TileId> BatchRenderJob::tileIds() const
+{
+    return aTileIds;
+}
+
+QVector<RenderJob::Result> BatchRenderJob::results() const
+{
+    return aResults;
+}
+
+
+VectorTileLoader::VectorTileLoader(GeoGraphicsScene *scene)
+    :   m_scene(scene),
+        m_cacheSize(0),
+        m_pyramidMode(DownsamplePyramid),
+        m_batchMemoryBudget(DefaultBatchMemoryBudget),
+        m_progressiveRendering(true),
+        m_timeToFirstPixel(-1),
+        m_pickBufferRadius(-1),
+        mutex(new QMutex(QMutex::Recursive))
+{
+    qRegisterMetaType<TileId>( "TileId" );
+    connect(this, SIGNAL(startRenderTile(GeoSceneTileDataset  const *, TileId)), SLOT(renderTile(GeoSceneTileDataset const *, TileId)), Qt::QueuedConnection);
+    connect(&m_renderScheduler, SIGNAL(finished(const TileId &, const SparseTileImage &, const QImage &, const QByteArray &, const GeometryTileLayers &, const PickBuffer &)), this, SLOT(handleFinished(const TileId &, const SparseTileImage &, const QImage &, const QByteArray &, const GeometryTileLayers &, const PickBuffer &)));
+}
+
+VectorTileLoader::~VectorTileLoader()
+{
+    qDeleteAll( m_tilesOnDisplay );
+    qDeleteAll( m_tileCache );
+    delete mutex;
+}
+
+// If the tile image file is locally available:
+//     - if not expired: create ImageTile, set state to "uptodate", return it => done
+//     - if expired: create GeometryTile, state is set to Expired by default, trigger dl,
+QImage
+VectorTileLoader::loadTileImage( GeoSceneTextureTileDataset const *textureLayer, TileId const & tileId, DownloadUsage const usage )
+{
+    return loadSparseTileImage( textureLayer, tileId, usage ).toImage();
+}
+
+SparseTileImage
+VectorTileLoader::loadSparseTileImage( GeoSceneTextureTileDataset const *textureLayer, TileId const & tileId, DownloadUsage const usage )
+{
+    QMutexLocker locker(mutex);
+
+    TileStatus status = tileStatus( textureLayer, tileId );
+    if ( status != Missing ) {
+        // check if an update should be triggered
+
+        if ( status == Available )
+        {
+            mDebug() << Q_FUNC_INFO << tileId << "StateUptodate";
+        }
+        else
+        {
+            Q_ASSERT( status == Expired );
+            mDebug() << Q_FUNC_INFO << tileId << "StateExpired";
+
+            if(!m_renderScheduler.contains(tileId))
+            {
+                triggerCreate( textureLayer, tileId, usage );
+            }
+        }
+
+        GeometryTile * stackedTile = m_tilesOnDisplay.value( tileId, nullptr );
+        if ( stackedTile )
+        {
+            stackedTile->setUsed( true );
+            return stackedTile->image();
+        }
+
+        stackedTile = m_tileCache.take( tileId );
+        if(!stackedTile && m_emptyTiles.contains(tileId))
+        {
+            stackedTile = new GeometryTile(tileId, getEmptyTile(textureLayer->tileSize(), devicePixelRatio()));
+        }
+
+        if ( stackedTile ) {
+            stackedTile->setUsed( true );
+            m_cacheSize -= stackedTile->byteCount();
+            m_cacheTiles.removeOne(tileId);
+            m_tilesOnDisplay[ tileId ] = stackedTile;
+            return stackedTile->image();
+        }
+
+        // Stored tiles live in the mapped segments, wrapping them densely costs no heap memory.
+        const SparseTileImage image = m_tileStore.loadSparse(tileId);
+        if(!image.isNull())
+        {
+            auto stackedTile = new GeometryTile(tileId, image);
+
+            stackedTile->setUsed(true);
+            m_tilesOnDisplay[ tileId ] = stackedTile;
+            return stackedTile->image();
+        }
+    }
+
+    if(!m_renderScheduler.contains(tileId))
+    {
+        triggerCreate( textureLayer, tileId, usage );
+    }
+
+    QImage replacementTile = scaledLowerLevelTile( textureLayer, tileId );
+    if(!replacementTile.isNull())
+    {
+        return SparseTileImage(replacementTile);
+    }
+
+    return getEmptyTile(textureLayer->tileSize(), 1.0);
+
+}
+
+// This method triggers a download of the given tile (without checking
+// expiration). It is called by upper layer (StackedTileLoader) when the tile
+// that should be reloaded is currently loaded in memory.
+//
+// post condition
+//     - download is triggered
+void VectorTileLoader::createTile(GeoSceneTileDataset const *tileData, TileId const &tileId, DownloadUsage usage )
+{
+    QMutexLocker locker(mutex);
+
+    triggerCreate( tileData, tileId, usage );
+}
+
+
+VectorTileLoader::TileStatus VectorTileLoader::tileStatus( GeoSceneTileDataset const *tileData, const TileId &tileId )
+{
+    QMutexLocker locker(mutex);
+
+    if(!m_tilesOnDisplay.contains(tileId) && !m_tileCache.contains(tileId) && !m_emptyTiles.contains(tileId))
+    {
+        if(m_tileStore.contains(tileId))
+        {
+            return Available;
+        }
+
+        return Missing;
+    }
+
+    if(m_emptyTiles.contains(tileId))
+    {
+        return Available;
+    }
+
+    GeometryTile * stackedTile = m_tilesOnDisplay.value( tileId, nullptr );
+    if ( !stackedTile )
+    {
+        stackedTile = m_tileCache.value( tileId );
+    }
+
+    if(stackedTile && stackedTile->isExpired())
+    {
+        return Expired;
+    }
+
+    return Available;
+}
+
+void VectorTileLoader::clear()
+{
+    QMutexLocker locker(mutex);
+
+    m_renderScheduler.cancelAll();
+
+    qDeleteAll(m_tilesOnDisplay);
+    m_tilesOnDisplay.clear();
+
+    qDeleteAll(m_tileCache);
+    m_tileCache.clear();
+    m_cacheTiles.clear();
+    m_emptyTiles.clear();
+    m_draftRenders.clear();
+
+    m_cacheSize = 0;
+
+    m_tileStore.clear();
+}
+
+void VectorTileLoader::resetTilehash()
+{
+    QMutexLocker locker(mutex);
+
+    QHash<TileId, GeometryTile*>::const_iterator it = m_tilesOnDisplay.constBegin();
+    QHash<TileId, GeometryTile*>::const_iterator const end = m_tilesOnDisplay.constEnd();
+    for (; it != end; ++it )
+    {
+        it.value()->setUsed( false );
+    }
+}
+
+void VectorTileLoader::setTilesUsed(const QList<TileId> &tiles)
+{
+    QMutexLocker locker(mutex);
+
+    foreach(const TileId &tileId, tiles)
+    {
+        GeometryTile * stackedTile = m_tilesOnDisplay.value( tileId, nullptr );
+        if ( stackedTile )
+        {
+            stackedTile->setUsed( true );
+        }
+
+        stackedTile = m_tileCache.take( tileId);
+        if ( stackedTile )
+        {
+            stackedTile->setUsed( true );
+            m_cacheSize -= stackedTile->byteCount();
+            m_cacheTiles.removeOne(tileId);
+
+            m_tilesOnDisplay[ tileId ] = stackedTile;
+        }
+    }
+}
+
+void VectorTileLoader::cleanupTilehash()
+{
+    QMutexLocker locker(mutex);
+
+    // Make sure that tiles which haven't been used during the last
+    // rendering of the map at all get removed from the tile hash.
+
+    QHashIterator<TileId, GeometryTile*> it( m_tilesOnDisplay );
+    while ( it.hasNext() )
+    {
+        it.next();
+        if ( !it.value()->used() )
+        {
+            // If insert call result is false then the cache is too small to store the tile
+            // but the item will get deleted nevertheless and the pointer we have
+            // doesn't get set to zero (so don't delete it in this case or it will crash!)
+            m_tileCache.insert( it.key(), it.value() );
+            m_cacheSize += it.value()->byteCount();
+            m_cacheTiles.enqueue(it.key());
+
+            m_tilesOnDisplay.remove( it.key() );
+        }
+    }
+}
+
+VectorTileLoader::PyramidMode VectorTileLoader::pyramidMode() const
+{
+    return m_pyramidMode;
+}
+
+void VectorTileLoader::setPyramidMode(PyramidMode mode)
+{
+    QMutexLocker locker(mutex);
+
+    m_pyramidMode = mode;
+}
+
+void VectorTileLoader::setViewport(const GeoSceneTileDataset *tileData, qreal centerLongitude, qreal centerLatitude, int tileZoomLevel, int visibleTiles)
+{
+    QMutexLocker locker(mutex);
+
+    m_renderScheduler.setViewport(tileData, centerLongitude, centerLatitude, tileZoomLevel, visibleTiles);
+}
+
+qint64 VectorTileLoader::batchMemoryBudget() const
+{
+    return m_batchMemoryBudget;
+}
+
+void VectorTileLoader::setBatchMemoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(mutex);
+
+    m_batchMemoryBudget = bytes;
+}
+
+bool VectorTileLoader::progressiveRendering() const
+{
+    return m_progressiveRendering;
+}
+
+void VectorTileLoader::setProgressiveRendering(bool progressive)
+{
+    QMutexLocker locker(mutex);
+
+    m_progressiveRendering = progressive;
+}
+
+VectorTileLoader::TileQuality VectorTileLoader::tileQuality(const TileId &tileId) const
+{
+    QMutexLocker locker(mutex);
+
+    GeometryTile * geometryTile = m_tilesOnDisplay.value( tileId, nullptr );
+    if ( !geometryTile )
+    {
+        geometryTile = m_tileCache.value( tileId, nullptr );
+    }
+
+    if ( geometryTile )
+    {
+        return geometryTile->quality();
+    }
+
+    return FullQuality;
+}
+
+qint64 VectorTileLoader::timeToFirstPixel() const
+{
+    return m_timeToFirstPixel;
+}
+
+int VectorTileLoader::pickBufferRadius() const
+{
+    return m_pickBufferRadius;
+}
+
+void VectorTileLoader::setPickBufferRadius(int radius)
+{
+    QMutexLocker locker(mutex);
+
+    m_pickBufferRadius = radius;
+}
+
+PickBuffer VectorTileLoader::pickBuffer(const TileId &tileId) const
+{
+    QMutexLocker locker(mutex);
+
+    GeometryTile * geometryTile = m_tilesOnDisplay.value( tileId, nullptr );
+    if ( !geometryTile )
+    {
+        geometryTile = m_tileCache.value( tileId, nullptr );
+    }
+
+    if ( !geometryTile || geometryTile->isExpired() )
+    {
+        return PickBuffer();
+    }
+
+    return geometryTile->pickBuffer();
+}
+
+void VectorTileLoader::handleFinished(const TileId &tileId, const SparseTileImage &sparseTile, const QImage &tile, const QByteArray &compressedTile, const GeometryTileLayers &layers, const PickBuffer &pickBuffer)
+{
+    QMutexLocker locker(mutex);
+
+    qDebug() << "VectorTileLoader::handleFinished";
+
+    if(m_firstPixelTimer.isValid())
+    {
+        m_timeToFirstPixel = m_firstPixelTimer.elapsed();
+        m_firstPixelTimer.invalidate();
+    }
+
+    // Empty tiles are published directly and are never drafts, whatever was scheduled for them before.
+    const GeoSceneTileDataset *draftData = m_draftRenders.take(tileId);
+    const bool isDraft = draftData && !m_emptyTiles.contains(tileId);
+
+    if(m_tileCache.contains(tileId))
+    {
+        GeometryTile *geometryTile= m_tileCache.value(tileId);
+        m_cacheSize -= geometryTile->byteCount();
+        m_tileCache.remove(tileId);
+        m_cacheTiles.removeOne(tileId);
+
+        delete geometryTile;
+    }
+
+    if(m_tilesOnDisplay.contains(tileId))
+    {
+        delete m_tilesOnDisplay.value(tileId);
+        m_tilesOnDisplay.remove(tileId);
+    }
+
+    if(m_emptyTiles.contains(tileId))
+    {
+        m_tileStore.remove(tileId);
+    }
+    else if(!isDraft)
+    {
+        if(sparseTile.isUniform())
+        {
+            m_tileStore.insertUniform(tileId, sparseTile.size(), sparseTile.uniformColor(), sparseTile.devicePixelRatio());
+        }
+        else
+        {
+            m_tileStore.insert(tileId, tile, compressedTile);
+        }
+
+        auto it = layers.constBegin();
+        auto itEnd = layers.constEnd();
+        for(; it != itEnd; ++it)
+        {
+            m_tileStore.insert(tileId, it.value().image, it.value().compressedBits, it.key());
+        }
+    }
+
+    // A draft is kept expired, so that the tile is requested again should its full pass get cancelled.
+    GeometryTile *geometryTile = new GeometryTile(tileId, sparseTile, isDraft ? DraftQuality : FullQuality, pickBuffer);
+
+    while(m_cacheSize+geometryTile->byteCount() > MaxTileBackingStoreSize && !m_tileCache.isEmpty())
+    {
+        TileId tileId = m_cacheTiles.dequeue();
+
+        int tempByteCount = m_tileCache[tileId]->byteCount();
+
+        delete m_tileCache[tileId];
+        m_tileCache.remove(tileId);
+        m_cacheSize -= tempByteCount;
+    }
+
+
+    m_cacheSize += geometryTile->byteCount();
+    m_tileCache.insert(tileId, geometryTile);
+    m_cacheTiles.enqueue(tileId);
+
+    emit sparseTileCompleted(tileId, sparseTile);
+
+    if(isDraft)
+    {
+        renderTile(draftData, tileId);
+    }
+}
+
+void VectorTileLoader::renderTile(const GeoSceneTileDataset *tileData, const TileId &tileId)
+{
+    QMutexLocker locker(mutex);
+
+    if(m_renderScheduler.contains(tileId) || m_pendingRenders.contains(tileId))
+    {
+        return;
+    }
 
-                auto stackedTile = new GeometryTile(tileId, image);
+    qDebug() << "VectorTileLoader::renderTile" << tileId.tileLevel() << tileId.x() << tileId.y();
 
-                stackedTile->setUsed(true);
-                m_tilesOnDisplay[ tileId ] = stackedTile;
-                return stackedTile->image();
-            }
-        }
+    if(!m_firstPixelTimer.isValid() && m_pendingRenders.isEmpty() && m_renderScheduler.tileIds().isEmpty())
+    {
+        m_firstPixelTimer.start();
     }
 
-    if(!tileRenderJobMap.contains(tileId))
+    if(batchSize(tileData) < 2)
     {
-        triggerCreate( textureLayer, tileId, usage );
+        renderSingleTile(tileData, tileId);
+        return;
     }
 
-    QImage replacementTile = scaledLowerLevelTile( textureLayer, tileId );
-    if(!replacementTile.isNull())
+    // The requests of one repaint arrive back to back, collect them so that adjacent tiles can be rendered together.
+    if(m_pendingRenders.isEmpty())
     {
-        return replacementTile;
+        QMetaObject::invokeMethod(this, "flushPendingRenders", Qt::QueuedConnection);
     }
 
-    QSize tileSize = textureLayer->tileSize();
-    QImage emptyImage = QImage( tileSize, QImage::Format_ARGB32_Premultiplied );
-    emptyImage.fill(Qt::transparent );
-
-    return emptyImage;
-
+    m_pendingRenders.insert(tileId, tileData);
 }
 
-// This method triggers a download of the given tile (without checking
-// expiration). It is called by upper layer (StackedTileLoader) when the tile
-// that should be reloaded is currently loaded in memory.
-//
-// post condition
-//     - download is triggered
-void VectorTileLoader::createTile(GeoSceneTileDataset const *tileData, TileId const &tileId, DownloadUsage usage )
+void VectorTileLoader::flushPendingRenders()
 {
     QMutexLocker locker(mutex);
 
-    triggerCreate( tileData, tileId, usage );
-}
+    QHash<TileId, const GeoSceneTileDataset*> pending;
+    pending.swap(m_pendingRenders);
 
+    // Downsampling a tile is cheaper than rendering it as part of a block.
+    if(m_pyramidMode == DownsamplePyramid)
+    {
+        QMutableHashIterator<TileId, const GeoSceneTileDataset*> it(pending);
+        while(it.hasNext())
+        {
+            it.next();
 
-VectorTileLoader::TileStatus VectorTileLoader::tileStatus( GeoSceneTileDataset const *tileData, const TileId &tileId )
-{
-    QMutexLocker locker(mutex);
+            if(scheduleDownsample(it.value(), it.key()))
+            {
+                it.remove();
+            }
+        }
+    }
 
-    if(!m_tilesOnDisplay.contains(tileId) && !m_tileCache.contains(tileId) && !m_emptyTiles.contains(tileId))
+    foreach(const TileId &tileId, pending.keys())
     {
-        if(QFileInfo::exists(dir->path() + QString("/tile_%1_%2_%3.png").arg(tileId.tileLevel()).arg(tileId.x()).arg(tileId.y())))
+        if(!pending.contains(tileId))
         {
-            return Available;
+            continue;
         }
 
-        return Missing;
+        for(int blockSize = batchSize(pending.value(tileId)); blockSize > 1; blockSize /= 2)
+        {
+            if(scheduleBatch(tileId, blockSize, pending))
+            {
+                break;
+            }
+        }
     }
 
-    if(m_emptyTiles.contains(tileId))
+    auto it = pending.constBegin();
+    auto itEnd = pending.constEnd();
+    for(; it != itEnd; ++it)
     {
-        return Available;
+        renderSingleTile(it.value(), it.key());
     }
+}
 
-    GeometryTile * stackedTile = m_tilesOnDisplay.value( tileId, nullptr );
-    if ( !stackedTile )
+void VectorTileLoader::renderSingleTile(const GeoSceneTileDataset *tileData, const TileId &tileId)
+{
+    if(m_pyramidMode == DownsamplePyramid && scheduleDownsample(tileData, tileId))
     {
-        stackedTile = m_tileCache.value( tileId );
+        return;
     }
 
-    if(stackedTile && stackedTile->isExpired())
-    {
-        return Expired;
-    }
+    qreal lon = 0;
+    qreal lat = 0;
+    tileCenter(tileData, tileId, lon, lat);
 
-    return Available;
-}
+    // Scene changes are published on this thread, so the version matches the items.
+    const quint64 sceneVersion = m_scene->version();
 
-void VectorTileLoader::clear()
-{
-    QMutexLocker locker(mutex);
+    QSet<const GeoGraphicsItem*> fullItems;
+    QList< GeoGraphicsItemPtr > items = m_scene->items(tileData, tileId, false, &fullItems);
+    const QList< GeoGraphicsItemPtr > allItems = items;
 
-    qDeleteAll(tileRenderJobMap);
-    tileRenderJobMap.clear();
+    // Sublayers which survived the last expiry do not need to be rendered again.
+    QMap<int, QImage> cachedLayers;
+    foreach(int zLevel, m_tileStore.layers(tileId))
+    {
+        QList< GeoGraphicsItemPtr > remainingItems;
+        foreach(const GeoGraphicsItemPtr &item, items)
+        {
+            if(item->feature()->zLevel() != zLevel)
+            {
+                remainingItems.append(item);
+            }
+        }
 
-    qDeleteAll(m_tilesOnDisplay);
-    m_tilesOnDisplay.clear();
+        if(remainingItems.size() == items.size())
+        {
+            m_tileStore.remove(tileId, zLevel);
+            continue;
+        }
 
-    qDeleteAll(m_tileCache);
-    m_tileCache.clear();
-    m_cacheTiles.clear();
-    m_emptyTiles.clear();
+        cachedLayers.insert(zLevel, m_tileStore.load(tileId, zLevel));
+        items = remainingItems;
+    }
 
-    m_cacheSize = 0;
+    if(items.isEmpty() && cachedLayers.isEmpty())
+    {
+        m_emptyTiles.insert(tileId);
 
-    delete dir;
-    dir = new QTemporaryDir();
-}
+        handleFinished(tileId, getEmptyTile(tileData->tileSize(), devicePixelRatio()), QImage(), QByteArray(), GeometryTileLayers(),
+                       m_pickBufferRadius >= 0 ? PickBuffer::empty(tileData->tileSize(), sceneVersion) : PickBuffer());
+    }
+    else
+    {
+        RenderJob *job = new RenderJob(tileProjection(tileData), lon, lat, tileRadius(tileData, tileId.tileLevel()), tileData->tileSize(), items, tileId, m_tileStore.compression(), cachedLayers);
+        job->setDraft(cachedLayers.isEmpty() && needsDraft(tileId));
+        job->setFullItems(fullItems);
 
-void VectorTileLoader::resetTilehash()
-{
-    QMutexLocker locker(mutex);
+        if(m_pickBufferRadius >= 0)
+        {
+            // The cached sublayers are only composited, the pick buffer needs their items as well.
+            job->setPickItems(allItems, m_pickBufferRadius, sceneVersion);
+        }
 
-    QHash<TileId, GeometryTile*>::const_iterator it = m_tilesOnDisplay.constBegin();
-    QHash<TileId, GeometryTile*>::const_iterator const end = m_tilesOnDisplay.constEnd();
-    for (; it != end; ++it )
-    {
-        it.value()->setUsed( false );
+        scheduleJob(job, tileData);
     }
 }
 
-void VectorTileLoader::setTilesUsed(const QList<TileId> &tiles)
+bool VectorTileLoader::needsDraft(const TileId &tileId) const
 {
-    QMutexLocker locker(mutex);
+    // Tiles with anything to show in the meantime go straight to the full pass.
+    return m_progressiveRendering && !m_tilesOnDisplay.contains(tileId) && !m_tileCache.contains(tileId) && !m_tileStore.contains(tileId);
+}
 
-    foreach(const TileId &tileId, tiles)
+void VectorTileLoader::scheduleJob(RenderJob *job, const GeoSceneTileDataset *tileData)
+{
+    foreach(const TileId &tileId, job->tileIds())
     {
-        GeometryTile * stackedTile = m_tilesOnDisplay.value( tileId, nullptr );
-        if ( stackedTile )
+        if(job->isDraft())
         {
-            stackedTile->setUsed( true );
+            m_draftRenders.insert(tileId, tileData);
         }
-
-        stackedTile = m_tileCache.take( tileId);
-        if ( stackedTile )
+        else
         {
-            stackedTile->setUsed( true );
-            m_cacheSize -= stackedTile->byteCount();
-            m_cacheTiles.removeOne(tileId);
-
-            m_tilesOnDisplay[ tileId ] = stackedTile;
+            m_draftRenders.remove(tileId);
         }
     }
+
+    m_renderScheduler.schedule(job);
 }
 
-void VectorTileLoader::cleanupTilehash()
+int VectorTileLoader::batchSize(const GeoSceneTileDataset *tileData) const
 {
-    QMutexLocker locker(mutex);
-
-    // Make sure that tiles which haven't been used during the last
-    // rendering of the map at all get removed from the tile hash.
+    // A block needs its canvas and the tiles sliced from it at the same time.
+    const QSize tileSize = tileData->tileSize() * devicePixelRatio();
+    const qint64 tileBytes = qint64(tileSize.width()) * tileSize.height() * 4;
 
-    QHashIterator<TileId, GeometryTile*> it( m_tilesOnDisplay );
-    while ( it.hasNext() )
+    int blockSize = 1;
+    while(2 * tileBytes * (2 * blockSize) * (2 * blockSize) <= m_batchMemoryBudget)
     {
-        it.next();
-        if ( !it.value()->used() )
-        {
-            // If insert call result is false then the cache is too small to store the tile
-            // but the item will get deleted nevertheless and the pointer we have
-            // doesn't get set to zero (so don't delete it in this case or it will crash!)
-            m_tileCache.insert( it.key(), it.value() );
-            m_cacheSize += it.value()->byteCount();
-            m_cacheTiles.enqueue(it.key());
-
-            m_tilesOnDisplay.remove( it.key() );
-        }
+        blockSize *= 2;
     }
+
+    return blockSize;
 }
 
-void VectorTileLoader::handleFinished(const TileId &tileId, const QImage &tile)
+bool VectorTileLoader::scheduleBatch(const TileId &tileId, int blockSize, QHash<TileId, const GeoSceneTileDataset*> &pending)
 {
-    QMutexLocker locker(mutex);
+    const GeoSceneTileDataset *tileData = pending.value(tileId);
 
-    qDebug() << "VectorTileLoader::handleFinished";
-    if(m_tileCache.contains(tileId))
+    int blockLevels = 0;
+    while((1 << blockLevels) < blockSize)
     {
-        GeometryTile *geometryTile= m_tileCache.value(tileId);
-        m_cacheSize -= geometryTile->byteCount();
-        m_tileCache.remove(tileId);
-        m_cacheTiles.removeOne(tileId);
-
-        delete geometryTile;
+        ++blockLevels;
     }
 
-    if(m_tilesOnDisplay.contains(tileId))
+    if(tileId.tileLevel() < blockLevels)
     {
-        delete m_tilesOnDisplay.value(tileId);
-        m_tilesOnDisplay.remove(tileId);
+        return false;
     }
 
-    if(tileRenderJobMap.contains(tileId))
-    {
-        bool isCancelled = tileRenderJobMap[tileId]->isCancelled();
-        tileRenderJobMap[tileId]->deleteLater();
-        tileRenderJobMap.remove(tileId);
+    const int originX = tileId.x() / blockSize * blockSize;
+    const int originY = tileId.y() / blockSize * blockSize;
 
-        if(isCancelled)
+    // Only whole blocks of requested tiles without stored sublayers are worth a shared canvas.
+    QList<TileId> blockTiles;
+    for(int y = originY; y < originY + blockSize; ++y)
+    {
+        for(int x = originX; x < originX + blockSize; ++x)
         {
-            qWarning() << "tile render job was cancelled" << tileId;
-            return;
+            const TileId blockTile(tileId.mapThemeIdHash(), tileId.tileLevel(), x, y);
+
+            if(pending.value(blockTile, nullptr) != tileData || m_renderScheduler.contains(blockTile) || !m_tileStore.layers(blockTile).isEmpty())
+            {
+                return false;
+            }
+
+            blockTiles.append(blockTile);
         }
     }
-    else
-    {
-        qDebug() << "Not in tile render job map" << tileId;
-    }
 
-    GeometryTile *geometryTile = new GeometryTile(tileId, tile);
+    qDebug() << "VectorTileLoader::scheduleBatch" << tileId.tileLevel() << originX << originY << blockSize;
 
-    while(m_cacheSize+geometryTile->byteCount() > MaxTileBackingStoreSize && !m_tileCache.isEmpty())
+    QList<TileId> tileIds;
+    foreach(const TileId &blockTile, blockTiles)
     {
-        TileId tileId = m_cacheTiles.dequeue();
+        pending.remove(blockTile);
 
-        int tempByteCount = m_tileCache[tileId]->byteCount();
+        if(m_scene->items(tileData, blockTile).isEmpty())
+        {
+            m_emptyTiles.insert(blockTile);
 
-        delete m_tileCache[tileId];
-        m_tileCache.remove(tileId);
-        m_cacheSize -= tempByteCount;
+            handleFinished(blockTile, getEmptyTile(tileData->tileSize(), devicePixelRatio()));
+        }
+        else
+        {
+            tileIds.append(blockTile);
+        }
     }
 
+    if(tileIds.isEmpty())
+    {
+        return true;
+    }
 
-    m_cacheSize += geometryTile->byteCount();
-    m_tileCache.insert(tileId, geometryTile);
-    m_cacheTiles.enqueue(tileId);
+    // The block covers exactly the ancestor tile blockLevels levels up, rendered at the radius of the block's level.
+    const TileId blockTileId(tileId.mapThemeIdHash(), tileId.tileLevel() - blockLevels, originX / blockSize, originY / blockSize);
 
-    emit tileCompleted(tileId, tile);
-}
+    qreal lon = 0;
+    qreal lat = 0;
+    tileCenter(tileData, blockTileId, lon, lat);
 
-void VectorTileLoader::renderTile(const GeoSceneTileDataset *tileData, const TileId &tileId)
-{
-    QMutexLocker locker(mutex);
+    RenderJob *job = new BatchRenderJob(tileProjection(tileData), lon, lat, tileRadius(tileData, tileId.tileLevel()), tileData->tileSize(), blockSize,
+                                        m_scene->items(tileData, blockTileId), blockTileId, tileIds, m_tileStore.compression());
 
-    if(tileRenderJobMap.contains(tileId))
+    bool draft = true;
+    foreach(const TileId &blockTile, tileIds)
     {
-        return;
+        draft = draft && needsDraft(blockTile);
     }
+    job->setDraft(draft);
 
-    qDebug() << "VectorTileLoader::renderTile" << tileId.tileLevel() << tileId.x() << tileId.y();
+    scheduleJob(job, tileData);
 
-    qreal count = ( 1 << tileId.tileLevel() ) * tileData->levelZeroColumns() / 2.0;
-    qreal lon   = ( tileId.x() - count + 0.5) / count * M_PI;
+    return true;
+}
 
-    count = ( 1 << tileId.tileLevel() ) * tileData->levelZeroRows() / 2.0;
-    double lat = 0;
-    switch ( tileData->projection() ) {
-    case GeoSceneTileDataset::Equirectangular:
-        lat = count - tileId.y() - 0.5 / count * M_PI / 2.0;
-        break;
-    case GeoSceneTileDataset::Mercator:
-        lat = atan( sinh( ( count - tileId.y() - 0.5 ) / count * M_PI ) );
-        break;
+SparseTileImage
+VectorTileLoader::availableTileImage(const TileId &tileId) const
+{
+    GeometryTile * geometryTile = m_tilesOnDisplay.value( tileId, nullptr );
+    if ( !geometryTile )
+    {
+        geometryTile = m_tileCache.value( tileId, nullptr );
     }
 
-    QList< GeoGraphicsItemPtr > items = m_scene->items(tileData, tileId);
-
-    if(items.isEmpty())
+    if ( geometryTile )
     {
-        qreal pixelRatio = 1.0;
+        return geometryTile->image();
+    }
 
-        if ( qApp )
-            pixelRatio = qApp->devicePixelRatio();
-        QImage emptyImage = getEmptyImage(tileData->tileSize(), pixelRatio);
+    return m_tileStore.loadSparse(tileId);
+}
 
-        m_emptyTiles.insert(tileId);
+bool
+VectorTileLoader::scheduleDownsample(const GeoSceneTileDataset *tileData, const TileId &tileId)
+{
+    QVector<SparseTileImage> childTiles;
+    bool allEmpty = true;
 
-        handleFinished(tileId, emptyImage);
-    }
-    else
+    for(int i = 0; i < 4; ++i)
     {
-        Projection projection = Projection::Mercator;
-        if(tileData->projection() == GeoSceneTileDataset::Equirectangular)
+        const TileId childId(tileId.mapThemeIdHash(), tileId.tileLevel() + 1, 2 * tileId.x() + i % 2, 2 * tileId.y() + i / 2);
+
+        if(tileStatus(tileData, childId) != Available)
         {
-            projection = Projection::Equirectangular;
+            return false;
         }
 
-        // choose the smaller dimension for selecting the tile level, leading to higher-resolution results
-        const int levelZeroWidth = tileData->tileSize().width() * tileData->levelZeroColumns();
-        const int levelZeroHight = tileData->tileSize().height() * tileData->levelZeroRows();
-        const int levelZeroMinDimension = qMin( levelZeroWidth, levelZeroHight );
-
-        double tileLevelF = tileId.tileLevel();
-        double linearLevel = qExp(tileLevelF * qLn( 2.0 ) );
-
-        if ( linearLevel < 1.0 )
-            linearLevel = 1.0; // Dirty fix for invalid entry linearLevel
+        if(m_emptyTiles.contains(childId))
+        {
+            childTiles.append(SparseTileImage());
+            continue;
+        }
 
-        qreal radius =  (static_cast<double>( levelZeroMinDimension ) * linearLevel) /4.0 ;
+        const SparseTileImage childTile = availableTileImage(childId);
+        if(childTile.isNull())
+        {
+            return false;
+        }
 
-        qDebug() << "Radius" << radius;
+        childTiles.append(childTile);
+        allEmpty = false;
+    }
 
+    qDebug() << "VectorTileLoader::scheduleDownsample" << tileId.tileLevel() << tileId.x() << tileId.y() << allEmpty;
 
-        TileRenderJob *job = new TileRenderJob(projection, lon, lat, qRound(radius), tileData->tileSize(), items, tileId, dir->path(), this);
-        tileRenderJobMap.insert(tileId, job);
+    if(allEmpty)
+    {
+        m_emptyTiles.insert(tileId);
 
-        connect(job, SIGNAL(finished(const TileId &, const QImage &)), this, SLOT(handleFinished(const TileId &, const QImage &)));
-        job->run();
+        handleFinished(tileId, getEmptyTile(tileData->tileSize(), devicePixelRatio()));
+    }
+    else
+    {
+        scheduleJob(new DownsampleJob(tileData->tileSize(), childTiles, tileId, m_tileStore.compression()), tileData);
     }
 
+    return true;
 }
 
+// The coverage is kept in the tile layout of the scene, the same one the tiles are rendered in.
 bool
-checkTileId(const TileId& tileId, const GeoSceneTileDataset *tileData, TileMap tileMap)
+checkTileId(const TileId& tileId, const TileCoverage &tiles)
 {
-    GeoDataLatLonBox box = tileId.toLatLonBox(tileData);
-    qreal north, south, east, west;
-    box.boundaries( north, south, east, west );
+    return tiles.touches(tileId.tileLevel(), tileId.x(), tileId.y());
+}
 
-    auto itZLevel = tileMap.begin();
-    auto itZLevelEnd = tileMap.end();
+QList<int>
+expiredLayers(const TileId& tileId, const LayeredTileCoverage &tileMap)
+{
+    QList<int> zLevels;
 
-    for(; itZLevel != itZLevelEnd; ++itZLevel)
+    auto it = tileMap.constBegin();
+    auto itEnd = tileMap.constEnd();
+    for(; it != itEnd; ++it)
     {
-        int tempTileLevel = itZLevel.key();
-        TileId topLeftKey = TileId::fromCoordinates(tileData, GeoDataCoordinates(west, north, 0), tempTileLevel );
-        TileId bottomRightKey = TileId::fromCoordinates(tileData, GeoDataCoordinates(east, south, 0), tempTileLevel );
-
-        QRect rect(topLeftKey.x(), topLeftKey.y(), bottomRightKey.x() - topLeftKey.x() + 1, bottomRightKey.y() - topLeftKey.y() + 1);
-
-        const auto & hash = itZLevel.value();
-
-        auto itX = hash.lowerBound(rect.left());
-        auto itEnd = hash.constEnd();
-
-        for(; itX != itEnd && itX.key() <= rect.right(); ++itX)
+        if(checkTileId(tileId, it.value()))
         {
-            if(itX.key() < rect.left())
-            {
-                continue;
-            }
-
-
-            auto itY = itX.value().lowerBound(rect.top());
-            auto itYEnd = itX.value().constEnd();
+            zLevels.append(it.key());
+        }
+    }
 
-            for(; itY != itYEnd && itY.key() <= rect.bottom(); ++itY)
-            {
-                if(itY.key() < rect.top())
-                {
-                    continue;
-                }
+    return zLevels;
+}
 
-                return true;
-            }
+bool
+checkTileId(const TileId& tileId, const LayeredTileCoverage &tileMap)
+{
+    auto it = tileMap.constBegin();
+    auto itEnd = tileMap.constEnd();
+    for(; it != itEnd; ++it)
+    {
+        if(checkTileId(tileId, it.value()))
+        {
+            return true;
         }
     }
 
@@ -655,22 +1510,17 @@ checkTileId(const TileId& tileId, const GeoSceneTileDataset *tileData, TileMap t
 }
 
 void
-VectorTileLoader::setTileExpired(const GeoSceneTileDataset *tileData, TileMap tileMap)
+VectorTileLoader::setTileExpired(const GeoSceneTileDataset *tileData, const LayeredTileCoverage &tileMap)
 {
     QMutexLocker locker(mutex);
 
-    QMutableMapIterator<TileId, TileRenderJob*> iRenderJob(tileRenderJobMap);
-    while (iRenderJob.hasNext())
+    foreach(const TileId &tileId, m_renderScheduler.tileIds())
     {
-        iRenderJob.next();
-        TileId tileId = iRenderJob.key();
-
-        bool found = checkTileId(tileId, tileData, tileMap);
+        bool found = checkTileId(tileId, tileMap);
 
         if(found)
         {
-            delete iRenderJob.value();
-            iRenderJob.remove();
+            m_renderScheduler.cancel(tileId);
         }
     }
 
@@ -681,7 +1531,7 @@ VectorTileLoader::setTileExpired(const GeoSceneTileDataset *tileData, TileMap ti
 
         TileId tileId = iTileCache.key();
 
-        bool found = checkTileId(tileId, tileData, tileMap);
+        bool found = checkTileId(tileId, tileMap);
 
         if(found)
         {
@@ -700,7 +1550,7 @@ VectorTileLoader::setTileExpired(const GeoSceneTileDataset *tileData, TileMap ti
 
         TileId tileId = iTileEmptyCache.value();
 
-        bool found = checkTileId(tileId, tileData, tileMap);
+        bool found = checkTileId(tileId, tileMap);
 
         if(found)
         {
@@ -708,22 +1558,21 @@ VectorTileLoader::setTileExpired(const GeoSceneTileDataset *tileData, TileMap ti
         }
     }
 
-    foreach(const QString &fileName, QDir(dir->path()).entryList(QStringList("tile_*"), QDir::Files | QDir::NoSymLinks))
+    // Only the composited tile and the sublayers of the changed z levels are dropped,
+    // the other sublayers are composited again when the tile is rendered.
+    foreach(const TileId &tileId, m_tileStore.tileIds())
     {
-        QStringList values = fileName.split("_");
-        if(values.size() != 4)
-        {
-            continue;
-        }
-
-        TileId tileId(0, values[1].toInt(), values[2].toInt(), values[3].remove(".png").toInt());
-        bool found = checkTileId(tileId, tileData, tileMap);
+        const QList<int> zLevels = expiredLayers(tileId, tileMap);
 
-        if(found)
+        if(!zLevels.isEmpty())
         {
-            QFile::remove(dir->path() + "/" + fileName);
-        }
+            m_tileStore.remove(tileId, GeometryTileStore::CompositeLayer);
 
+            foreach(int zLevel, zLevels)
+            {
+                m_tileStore.remove(tileId, zLevel);
+            }
+        }
     }
 
     QHashIterator<TileId, GeometryTile*> iTilesOnDisplay(m_tilesOnDisplay);
@@ -732,7 +1581,7 @@ VectorTileLoader::setTileExpired(const GeoSceneTileDataset *tileData, TileMap ti
         iTilesOnDisplay.next();
         TileId tileId = iTilesOnDisplay.key();
 
-        bool found = checkTileId(tileId, tileData, tileMap);
+        bool found = checkTileId(tileId, tileMap);
 
         if(found)
         {
@@ -741,9 +1590,6 @@ VectorTileLoader::setTileExpired(const GeoSceneTileDataset *tileData, TileMap ti
             triggerCreate(tileData, tileId, DownloadUsage::DownloadBulk);
         }
     }
-
-
-
 }
 
 void VectorTileLoader::triggerCreate( GeoSceneTileDataset const *tileData, TileId const &id, DownloadUsage const usage )
@@ -754,49 +1600,6 @@ void VectorTileLoader::triggerCreate( GeoSceneTileDataset const *tileData, TileI
 
 }
 
-TileRenderJob::TileRenderJob(Projection projection, qreal centerLongitude, qreal centerLatitude, int radius, const QSize &size, QList<GeoGraphicsItemPtr> items, const TileId &tileId, const QString &tileDir, QObject *parent)
-    :   QObject(parent),
-        job(new RenderJob(projection, centerLongitude, centerLatitude, radius, size, items, tileId, tileDir))
-{
-    qDebug() << "TileRenderJob::TileRenderJob" << job << this;
-
-    connect(&watcher, SIGNAL(finished()), this, SLOT(handleFinished()));
-}
-
-TileRenderJob::~TileRenderJob()
-{
-    qDebug() << "TileRenderJob::~TileRenderJob" << job << job->isCancelled() << watcher.isCanceled() << watcher.isFinished() << watcher.isRunning() << watcher.isStarted() << this;
-
-    disconnect(&watcher, SIGNAL(finished()), this, SLOT(handleFinished()));
-
-    job->cancel();
-    watcher.cancel();
-    watcher.waitForFinished();
-
-    delete job;
-
-    qDebug() << "TileRenderJob::~TileRenderJob finished" << job << this;
-}
-
-void TileRenderJob::run()
-{
-    qDebug() << "TileRenderJob::run" << job << this;
-
-    QFuture<void> future = QtConcurrent::run(job, &RenderJob::run);
-    watcher.setFuture(future);
-}
-
-void TileRenderJob::handleFinished()
-{
-    qDebug() << "TileRenderJob::TileRenderJob::handleFinished" << job << job->tileId() << job->isCancelled();
-    if(!job->isCancelled())
-    {
-        emit finished(job->tileId(), job->tile());
-    }
-
-}
-
-
 } // namespace
 
 
@@ -2,13 +2,17 @@
 #define VECTORTILELOADER_H
 
 #include "AbstractTileLoader.h"
+#include "GeometryTileStore.h"
+#include "PickBuffer.h"
+#include "TileRenderScheduler.h"
 #include "graphicsview/GeoGraphicsItem.h"
 #include <QtCore/QCache>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QMap>
+#include <QtCore/QVector>
 #include <QtGui/QPixmap>
-#include <QtCore/QFutureWatcher>
-#include <QtCore/QTemporaryDir>
 #include <QtCore/QQueue>
+#include <QtCore/QSet>
 #include <atomic>
 
 class QByteArray;
@@ -30,11 +34,26 @@ typedef QSharedPointer<GeometryTile> GeometryTilePtr;
 class RenderJob
 {
 public:
-    RenderJob(Projection projection, qreal centerLongitude, qreal centerLatitude, int radius,  const QSize &size , QList<GeoGraphicsItemPtr> items, const TileId &tileId, QString tileDir);
-
-    ~RenderJob();
-
-    void
+    /// A tile delivered by a job.
+    struct Result
+    {
+        TileId tileId;
+        SparseTileImage sparseTile;
+        QImage tile;
+        QByteArray compressedTile;
+        GeometryTileLayers layers;
+        PickBuffer pickBuffer;
+    };
+
+    /**
+     * Renders @p items into a tile. Z levels in @p cachedLayers are not rendered
+     * again but composited from the given images.
+     */
+    RenderJob(Projection projection, qreal centerLongitude, qreal centerLatitude, int radius,  const QSize &size , QList<GeoGraphicsItemPtr> items, const TileId &tileId, GeometryTileStore::Compression compression, const QMap<int, QImage> &cachedLayers = QMap<int, QImage>());
+
+    virtual ~RenderJob();
+
+    virtual void
     run();
 
     const QImage&
@@ -44,12 +63,92 @@ public:
     }
 
 
+    const QByteArray&
+    compressedTile() const
+    {
+        return aCompressedTile;
+    }
+
+    /**
+     * The tile in the representation kept in memory, see SparseTileImage.
+     */
+    const SparseTileImage&
+    sparseTile() const
+    {
+        return aSparseTile;
+    }
+
+    /**
+     * The z level sublayers rendered by this job. They are only kept if the
+     * tile consists of more than one z level.
+     */
+    const GeometryTileLayers&
+    layers() const
+    {
+        return aLayers;
+    }
+
     const TileId&
     tileId() const
     {
         return aTileId;
     }
 
+    /**
+     * A draft job renders with coarse vertex decimation and without
+     * antialiasing. Its tiles are neither compressed nor split into sublayers,
+     * they only bridge the time until the full quality tile arrives.
+     */
+    void
+    setDraft(bool draft)
+    {
+        aIsDraft = draft;
+    }
+
+    bool
+    isDraft() const
+    {
+        return aIsDraft;
+    }
+
+    /**
+     * The items covering the whole tile. Opaque ones are painted as a plain
+     * fill and hide all items painted before them.
+     */
+    void
+    setFullItems(const QSet<const GeoGraphicsItem*> &items)
+    {
+        aFullItems = items;
+    }
+
+    /**
+     * Renders a pick buffer of @p items next to the tile, the items widened
+     * by @p radius pixels. @p sceneVersion is the scene version the items
+     * were taken at. Drafts get none.
+     */
+    void
+    setPickItems(const QList<GeoGraphicsItemPtr> &items, int radius, quint64 sceneVersion)
+    {
+        aPickItems = items;
+        aPickRadius = radius;
+        aPickSceneVersion = sceneVersion;
+    }
+
+    const PickBuffer &
+    pickBuffer() const
+    {
+        return aPickBuffer;
+    }
+
+    /**
+     * The tiles this job delivers, by default just tileId().
+     */
+    virtual QList<TileId>
+    tileIds() const;
+
+    virtual QVector<Result>
+    results() const;
+
     void
     cancel()
     {
@@ -61,8 +160,19 @@ public:
     {
         return aCancel;
     }
-private:
-    friend class TileRenderJob;
+
+protected:
+    bool
+    renderItems(QImage &image, const QList<GeoGraphicsItemPtr> &items);
+
+    void
+    compressTile();
+
+    void
+    packTile();
+
+    void
+    renderPickBuffer();
 
     std::atomic<bool> aCancel;
     const Projection aProjection;
@@ -72,45 +182,66 @@ private:
     const QSize aSize;
     const QList< GeoGraphicsItemPtr > aItems;
     const TileId aTileId;
-    const QString aTileDir;
+    const GeometryTileStore::Compression aCompression;
+    const QMap<int, QImage> aCachedLayers;
+    bool aIsDraft;
+    QSet<const GeoGraphicsItem*> aFullItems;
+    QList<GeoGraphicsItemPtr> aPickItems;
+    int aPickRadius;
+    quint64 aPickSceneVersion;
 
     QImage aTile;
+    SparseTileImage aSparseTile;
+    QByteArray aCompressedTile;
+    GeometryTileLayers aLayers;
+    PickBuffer aPickBuffer;
 
 };
 
-class TileRenderJob  : public QObject
+/**
+ * Builds a tile from its four children with a 2x2 box filter instead of
+ * rendering its items again. The children are expected in the order
+ * top left, top right, bottom left, bottom right.
+ */
+class DownsampleJob : public RenderJob
 {
-    Q_OBJECT
-
 public:
-    TileRenderJob(Projection projection, qreal centerLongitude, qreal centerLatitude, int radius,  const QSize &size, QList< GeoGraphicsItemPtr > items , const TileId &tileId, const QString &tileDir, QObject *parent);
-
-    
-    ~TileRenderJob() override;
+    DownsampleJob(const QSize &size, const QVector<SparseTileImage> &childTiles, const TileId &tileId, GeometryTileStore::Compression compression);
 
     void
-    run();
+    run() override;
 
-    bool
-    isCancelled() const
-    {
-        return job->isCancelled();
-    }
+private:
+    const QVector<SparseTileImage> aChildTiles;
+};
 
-public slots:
-    void
-    handleFinished();
+/**
+ * Renders an aligned block of blockSize x blockSize tiles of one level in a
+ * single pass and slices the canvas into tiles afterwards, so that items
+ * shared by the tiles are projected and clipped only once. @p blockTileId is
+ * the ancestor tile covering the block, only the tiles in @p tileIds are
+ * delivered.
+ */
+class BatchRenderJob : public RenderJob
+{
+public:
+    BatchRenderJob(Projection projection, qreal centerLongitude, qreal centerLatitude, int radius, const QSize &tileSize, int blockSize, QList<GeoGraphicsItemPtr> items, const TileId &blockTileId, const QList<TileId> &tileIds, GeometryTileStore::Compression compression);
 
-signals:
     void
-    finished(const TileId &tile, const QImage &image);
+    run() override;
 
-private:
-    friend class VectorTileLoader;
+    QList<TileId>
+    tileIds() const override;
 
-    QFutureWatcher<void> watcher;
-    RenderJob *job;
+    QVector<Result>
+    results() const override;
 
+private:
+    const QSize aTileSize;
+    const int aBlockSize;
+    const QList<TileId> aTileIds;
+
+    QVector<Result> aResults;
 };
 
 class GeometryTile;
@@ -119,12 +250,27 @@ class VectorTileLoader: public AbstractTileLoader
 {
     Q_OBJECT
 public:
+    enum PyramidMode
+    {
+        RenderPyramid,      ///< every level is rendered from the scene items
+        DownsamplePyramid   ///< tiles whose children are all available are downsampled from them
+    };
+
+    enum TileQuality
+    {
+        DraftQuality,       ///< a quick preview, replaced as soon as the full pass is done
+        FullQuality
+    };
+
     explicit VectorTileLoader(GeoGraphicsScene *scene );
     ~VectorTileLoader() override;
 
     QImage
     loadTileImage( GeoSceneTextureTileDataset const *textureData, TileId const & tileId, DownloadUsage const ) override;
 
+    SparseTileImage
+    loadSparseTileImage( GeoSceneTextureTileDataset const *textureData, TileId const & tileId, DownloadUsage const ) override;
+
     void
     createTile( GeoSceneTileDataset const *tileData, TileId const &, DownloadUsage ) override;
 
@@ -143,20 +289,93 @@ public:
     void
     cleanupTilehash();
 
+    PyramidMode
+    pyramidMode() const;
+
+    void
+    setPyramidMode(PyramidMode mode);
+
+    void
+    setViewport(const GeoSceneTileDataset *tileData, qreal centerLongitude, qreal centerLatitude, int tileZoomLevel, int visibleTiles);
+
+    qint64
+    batchMemoryBudget() const;
+
+    /**
+     * Limits the memory a batch render may use for its canvas and the tiles
+     * sliced from it. The block size is the largest power of two that fits,
+     * a budget below two tiles disables batching.
+     */
+    void
+    setBatchMemoryBudget(qint64 bytes);
+
+    bool
+    progressiveRendering() const;
+
+    /**
+     * Renders tiles with nothing to show yet in two passes: a draft is
+     * published first and replaced by the full quality tile later.
+     */
+    void
+    setProgressiveRendering(bool progressive);
+
+    /**
+     * The quality of the tile kept in memory, tiles which are not in memory
+     * are reported as FullQuality.
+     */
+    TileQuality
+    tileQuality(const TileId &tileId) const;
+
+    /**
+     * The time in milliseconds from the first render request after the loader
+     * was idle until the first tile was published, -1 if nothing was rendered yet.
+     */
+    qint64
+    timeToFirstPixel() const;
+
+    int
+    pickBufferRadius() const;
+
+    /**
+     * Renders a pick buffer next to every full quality tile, in which the
+     * pickable items are widened by @p radius pixels. A negative radius, the
+     * default, renders none.
+     */
+    void
+    setPickBufferRadius(int radius);
+
+    /**
+     * The pick buffer of the tile in memory, null if the tile has none or
+     * is expired.
+     */
+    PickBuffer
+    pickBuffer(const TileId &tileId) const;
+
 public slots:
+    /**
+     * Takes over a finished tile. @p sparseTile is kept in memory, @p tile and
+     * its sublayers only go to the tile store.
+     */
     void
-    handleFinished(const TileId &tileId, const QImage &tile);
+    handleFinished(const TileId &tileId, const SparseTileImage &sparseTile, const QImage &tile = QImage(), const QByteArray &compressedTile = QByteArray(), const GeometryTileLayers &layers = GeometryTileLayers(), const PickBuffer &pickBuffer = PickBuffer());
 
     void
     renderTile( GeoSceneTileDataset const *tileData, TileId const &);
 
     void
-    setTileExpired(const GeoSceneTileDataset *tileData, TileMap tileMap);
+    setTileExpired(const GeoSceneTileDataset *tileData, const LayeredTileCoverage &tileMap);
 
 signals:
     void
     startRenderTile( GeoSceneTileDataset const *tileData, TileId const &);
 
+    void
+    sparseTileCompleted(const TileId &tileId, const SparseTileImage &tileImage);
+
+private slots:
+    void
+    flushPendingRenders();
+
 private:
     void
     triggerCreate( GeoSceneTileDataset const *tileData, TileId const &, DownloadUsage const );
@@ -164,16 +383,45 @@ private:
     void
     addTile(const TileId &tileId, const QImage &tile);
 
+    SparseTileImage
+    availableTileImage(const TileId &tileId) const;
+
+    bool
+    scheduleDownsample(const GeoSceneTileDataset *tileData, const TileId &tileId);
+
+    void
+    renderSingleTile(const GeoSceneTileDataset *tileData, const TileId &tileId);
+
+    int
+    batchSize(const GeoSceneTileDataset *tileData) const;
+
+    bool
+    scheduleBatch(const TileId &tileId, int blockSize, QHash<TileId, const GeoSceneTileDataset*> &pending);
+
+    bool
+    needsDraft(const TileId &tileId) const;
+
+    void
+    scheduleJob(RenderJob *job, const GeoSceneTileDataset *tileData);
+
     GeoGraphicsScene *m_scene;
     QHash<TileId, GeometryTile*>  m_tilesOnDisplay;
     QHash<TileId, GeometryTile*>  m_tileCache;
     QQueue<TileId> m_cacheTiles;
     QSet<TileId> m_emptyTiles;
     qint64 m_cacheSize;
-
-    QMap<TileId, TileRenderJob*> tileRenderJobMap;
-
-    QTemporaryDir *dir;
+    PyramidMode m_pyramidMode;
+    qint64 m_batchMemoryBudget;
+    QHash<TileId, const GeoSceneTileDataset*> m_pendingRenders;
+    bool m_progressiveRendering;
+    QHash<TileId, const GeoSceneTileDataset*> m_draftRenders;
+    QElapsedTimer m_firstPixelTimer;
+    qint64 m_timeToFirstPixel;
+    int m_pickBufferRadius;
+
+    TileRenderScheduler m_renderScheduler;
+
+    GeometryTileStore m_tileStore;
     QMutex *mutex;
 };
 
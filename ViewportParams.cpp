@@ -55,6 +55,7 @@ public:
     matrix               m_planetAxisMatrix;
     int                  m_radius;       // Zoom level (pixels / globe radius)
     qreal                m_angularResolution;
+    qreal                m_resolutionScale;
 
     QSize                m_size;         // width, height
 
@@ -72,6 +73,8 @@ public:
     static const VerticalPerspectiveProjection   s_verticalPerspectiveProjection;
 
     GeoDataCoordinates   m_focusPoint;
+
+    const std::atomic<bool> *m_cancelFlag;
 };
 
 const SphericalProjection  ViewportParamsPrivate::s_sphericalProjection;
@@ -95,9 +98,11 @@ ViewportParamsPrivate::ViewportParamsPrivate( Projection projection,
       m_planetAxisMatrix(),
       m_radius( radius ),
       m_angularResolution( 4 / fabs( (qreal)( m_radius ) ) ),
+      m_resolutionScale( 1.0 ),
       m_size(std::move( size )),
       m_dirtyBox( true ),
-      m_viewLatLonAltBox()
+      m_viewLatLonAltBox(),
+      m_cancelFlag( 0 )
 {
 }
 
@@ -228,7 +233,20 @@ void ViewportParams::setRadius(int newRadius)
         d->m_dirtyBox = true;
 
         d->m_radius = newRadius;
-        d->m_angularResolution = 4 / fabs( (qreal)(d->m_radius) );
+        d->m_angularResolution = d->m_resolutionScale * 4 / fabs( (qreal)(d->m_radius) );
+    }
+}
+
+qreal ViewportParams::resolutionScale() const
+{
+    return d->m_resolutionScale;
+}
+
+void ViewportParams::setResolutionScale( qreal scale )
+{
+    if ( scale > 0 ) {
+        d->m_resolutionScale = scale;
+        d->m_angularResolution = d->m_resolutionScale * 4 / fabs( (qreal)(d->m_radius) );
     }
 }
 
@@ -465,4 +483,14 @@ void ViewportParams::resetFocusPoint()
     d->m_focusPoint = GeoDataCoordinates();
 }
 
+void ViewportParams::setCancelFlag( const std::atomic<bool> *cancelFlag )
+{
+    d->m_cancelFlag = cancelFlag;
+}
+
+bool ViewportParams::isCancelled() const
+{
+    return d->m_cancelFlag && d->m_cancelFlag->load( std::memory_order_relaxed );
+}
+
 }
@@ -22,6 +22,8 @@
 #include <QSize>
 #include <QtGui/QPainterPath>
 
+#include <atomic>
+
 #include "geodata/data/GeoDataLatLonAltBox.h"
 
 #include "Quaternion.h"
@@ -95,6 +97,15 @@ class MARBLE_EXPORT ViewportParams
      */
     void setRadius(int radius);
 
+    qreal resolutionScale() const;
+
+    /**
+     * @brief Coarsen the angular resolution used to filter out details
+     * @param scale Factor applied to angularResolution(), values above 1 drop
+     * more vertices and small features. Non-positive values are ignored.
+     */
+    void setResolutionScale( qreal scale );
+
     void centerOn( qreal lon, qreal lat );
 
     Quaternion planetAxis() const;
@@ -212,6 +223,21 @@ class MARBLE_EXPORT ViewportParams
       */
     void resetFocusPoint();
 
+    /**
+      * @brief Lets long running projections and renderers give up early.
+      * @param cancelFlag Flag owned by the caller, which has to outlive the
+      * viewport. Once it is set, isCancelled() returns true. Pass 0 to detach.
+      */
+    void setCancelFlag( const std::atomic<bool> *cancelFlag );
+
+    bool isCancelled() const;
+
+    /**
+      * Loops over vertices or pixels check isCancelled() once per this many
+      * iterations, checking every single one would cost more than it saves.
+      */
+    static const int CancelCheckInterval = 256;
+
  private:
     Q_DISABLE_COPY( ViewportParams )
     ViewportParamsPrivate * const d;
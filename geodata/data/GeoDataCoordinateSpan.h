@@ -0,0 +1,79 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#ifndef MARBLE_GEODATACOORDINATESPAN_H
+#define MARBLE_GEODATACOORDINATESPAN_H
+
+#include "geodata/data/GeoDataCoordinates.h"
+
+namespace Marble
+{
+
+/**
+ * A view on the nodes of a line string, taken without copying them.
+ *
+ * Nodes stored as points are seen through strided arrays of longitudes,
+ * latitudes and, for 3D points, altitudes, in degree. Node i is found at
+ * index i * stride of each array. Nodes stored as GeoDataCoordinates have
+ * no such arrays, the span points at the coordinates instead.
+ *
+ * The span stays valid until the line string is changed or destroyed.
+ */
+struct GeoDataCoordinateSpan
+{
+    GeoDataCoordinateSpan()
+        :   lon(nullptr),
+            lat(nullptr),
+            alt(nullptr),
+            coordinates(nullptr),
+            size(0),
+            stride(0),
+            unit(GeoDataCoordinates::Degree)
+    {
+    }
+
+    bool
+    hasArrays() const
+    {
+        return lon != nullptr;
+    }
+
+    double
+    lonAt(int i) const
+    {
+        return lon[i * stride];
+    }
+
+    double
+    latAt(int i) const
+    {
+        return lat[i * stride];
+    }
+
+    /// Returns 0 for nodes without altitude.
+    double
+    altAt(int i) const
+    {
+        return alt ? alt[i * stride] : 0.0;
+    }
+
+    const double *lon;
+    const double *lat;
+    const double *alt;
+    const GeoDataCoordinates *coordinates;
+
+    int size;
+    int stride;
+
+    // the unit of the arrays
+    GeoDataCoordinates::Unit unit;
+};
+
+}
+
+#endif // MARBLE_GEODATACOORDINATESPAN_H
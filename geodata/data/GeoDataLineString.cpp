@@ -22,6 +22,8 @@
 #include <QDataStream>
 #include <QtGui/QPolygonF>
 
+#include <type_traits>
+
 namespace Marble
 {
 GeoDataLineString::GeoDataLineString(const QVector<GeoDataCoordinates> &points, TessellationFlags f, const QVector<double> &messure, const QVector<double> &messureInfo)
@@ -294,6 +296,45 @@ GeoDataLineString::getLonLat(int pos, double &lon, double &lat, GeoDataCoordinat
     p()->getLonLat(pos, lon, lat, unit);
 }
 
+GeoDataCoordinateSpan
+GeoDataLineString::coordinateSpan() const
+{
+    const GeoDataLineStringPrivate *d = p();
+
+    GeoDataCoordinateSpan span;
+    span.size = d->size();
+
+    switch(d->type())
+    {
+    case GeoDataLineStringPrivate::LineStringCoordinates:
+        span.coordinates = static_cast<const GeoDataLineStringCoordinatesPrivate*>(d)->m_points.constData();
+        span.unit = GeoDataCoordinates::Radian;
+        break;
+
+    case GeoDataLineStringPrivate::LineStringPoints:
+        // QPointF only lays out doubles where qreal is double, elsewhere the nodes are read one by one.
+        if(std::is_same<qreal, double>::value && sizeof(QPointF) == 2 * sizeof(double))
+        {
+            span.lon = reinterpret_cast<const double*>(static_cast<const GeoDataLineStringPointsPrivate*>(d)->m_points.constData());
+            span.lat = span.lon + 1;
+            span.stride = 2;
+        }
+        break;
+
+    case GeoDataLineStringPrivate::LineStringPoints3d:
+        if(sizeof(QwtPoint3D) == 3 * sizeof(double))
+        {
+            span.lon = reinterpret_cast<const double*>(static_cast<const GeoDataLineStringPoints3DPrivate*>(d)->m_points.constData());
+            span.lat = span.lon + 1;
+            span.alt = span.lon + 2;
+            span.stride = 3;
+        }
+        break;
+    }
+
+    return span;
+}
+
 GeoDataCoordinates 
 GeoDataLineString::at( int pos ) const
 {
@@ -511,31 +552,70 @@ QVector<QPointF> GeoDataLineString::rawData() const
 {
     const GeoDataLineStringPrivate* d = p();
 
-    QVector<QPointF> data;
-    if(d->type() == GeoDataLineStringPrivate::LineStringCoordinates)
+    // Points are handed out implicitly shared, other nodes have to be converted.
+    if(d->type() == GeoDataLineStringPrivate::LineStringPoints)
     {
-        QVector<GeoDataCoordinates>::const_iterator end = static_cast<const GeoDataLineStringCoordinatesPrivate*>(d)->m_points.constEnd();
-        for( QVector<GeoDataCoordinates>::const_iterator itCoords = static_cast<const GeoDataLineStringCoordinatesPrivate*>(d)->m_points.constBegin(); itCoords != end; ++itCoords )
-        {
-            double lon, lat;
-            itCoords->geoCoordinates( lon, lat, Marble::GeoDataCoordinates::Degree );
-            data << QPointF(lon, lat);
-        }
+        return static_cast<const GeoDataLineStringPointsPrivate*>(d)->m_points;
     }
-    else if(d->type() == GeoDataLineStringPrivate::LineStringPoints)
+
+    QVector<QPointF> data(d->size());
+    QPointF *points = data.data();
+    forEachLonLat(GeoDataCoordinates::Degree, [points](int i, double lon, double lat)
+    {
+        points[i] = QPointF(lon, lat);
+    });
+
+    return data;
+}
+
+QVector<int> GeoDataLineString::segmentsIntersecting(const QRectF &box) const
+{
+    // Below this many nodes scanning them is about as fast as querying an index.
+    static const int SegmentIndexMinSize = 256;
+
+    const GeoDataLineStringPrivate *d = p();
+    const int count = d->size();
+
+    QVector<int> segments;
+    if(count < 2)
     {
-        data = static_cast<const GeoDataLineStringPointsPrivate*>(d)->m_points;
+        return segments;
     }
-    else if(d->type() == GeoDataLineStringPrivate::LineStringPoints3d)
+
+    if(count < SegmentIndexMinSize)
     {
-        QVector<QwtPoint3D>::const_iterator end = static_cast<const GeoDataLineStringPoints3DPrivate*>(d)->m_points.constEnd();
-        for( QVector<QwtPoint3D>::const_iterator itCoords = static_cast<const GeoDataLineStringPoints3DPrivate*>(d)->m_points.constBegin(); itCoords != end; ++itCoords )
+        double lon1 = 0.0;
+        double lat1 = 0.0;
+
+        forEachLonLat(GeoDataCoordinates::Radian, [&](int i, double lon2, double lat2)
         {
-            data << QPointF(itCoords->x(), itCoords->y());
+            if(i > 0 &&
+               qMax(lon1, lon2) >= box.left() && qMin(lon1, lon2) <= box.right() &&
+               qMax(lat1, lat2) >= box.top() && qMin(lat1, lat2) <= box.bottom())
+            {
+                segments.append(i - 1);
+            }
+
+            lon1 = lon2;
+            lat1 = lat2;
+        });
+
+        return segments;
+    }
+
+    QSharedPointer<const GeoDataSegmentIndex> segmentIndex;
+    {
+        QMutexLocker locker(&d->m_segmentIndexMutex);
+        if(!d->m_segmentIndex)
+        {
+            d->m_segmentIndex = QSharedPointer<const GeoDataSegmentIndex>(new GeoDataSegmentIndex(*this));
         }
+
+        segmentIndex = d->m_segmentIndex;
     }
 
-    return data;
+    segmentIndex->query(box, segments);
+    return segments;
 }
 
 bool GeoDataLineString::hasMessure() const
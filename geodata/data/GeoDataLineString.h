@@ -16,12 +16,14 @@
 #include <QFlags>
 #include <QVector>
 #include <QMetaType>
+#include <QRectF>
 
 #include "MarbleGlobal.h"
 
 #include "geodata/geodata_export.h"
 #include "geodata/data/GeoDataGeometry.h"
 #include "geodata/data/GeoDataCoordinates.h"
+#include "geodata/data/GeoDataCoordinateSpan.h"
 #include "geodata/data/GeoDataLatLonAltBox.h"
 #include <qwt_point_3d.h>
 
@@ -198,6 +200,22 @@ class GEODATA_EXPORT GeoDataLineString : public GeoDataGeometry
     void
     getLonLat(int pos, double &lon, double &lat, GeoDataCoordinates::Unit unit) const;
 
+    /**
+     * Returns a view on the nodes in their storage, for loops over all
+     * nodes that should not pay a virtual call per node.
+     */
+    GeoDataCoordinateSpan
+    coordinateSpan() const;
+
+    /**
+     * Calls @p visitor with the index, longitude and latitude in @p unit of
+     * every node, in order. The loop runs over the coordinate span and falls
+     * back to getLonLat() only where the storage can't be viewed as arrays.
+     */
+    template<typename Visitor>
+    void
+    forEachLonLat(GeoDataCoordinates::Unit unit, Visitor visitor) const;
+
 /*!
     \brief Returns a reference to the coordinates of a node at a given position.
     This method does not detach the returned coordinate object from the line string.
@@ -218,6 +236,15 @@ class GEODATA_EXPORT GeoDataLineString : public GeoDataGeometry
     QVector<QPointF>
     rawData() const;
 
+    /**
+     * Returns the segments whose bounding box in longitude and latitude
+     * radian intersects @p box, in ascending order. Segment i joins the nodes
+     * i and i + 1. Large line strings build a segment index on the first
+     * call, so later ones don't look at every node.
+     */
+    QVector<int>
+    segmentsIntersecting(const QRectF &box) const;
+
     bool
     hasMessure() const;
 
@@ -232,6 +259,39 @@ class GEODATA_EXPORT GeoDataLineString : public GeoDataGeometry
     const GeoDataLineStringPrivate *p() const;
 };
 
+template<typename Visitor>
+inline void
+GeoDataLineString::forEachLonLat(GeoDataCoordinates::Unit unit, Visitor visitor) const
+{
+    const GeoDataCoordinateSpan span = coordinateSpan();
+
+    if(span.hasArrays())
+    {
+        // like getLonLat(), stored degrees are only converted for radian
+        const double factor = (span.unit != unit && unit == GeoDataCoordinates::Radian) ? DEG2RAD : 1.0;
+        for(int i = 0; i < span.size; ++i)
+        {
+            visitor(i, span.lonAt(i) * factor, span.latAt(i) * factor);
+        }
+    }
+    else if(span.coordinates)
+    {
+        for(int i = 0; i < span.size; ++i)
+        {
+            visitor(i, double(span.coordinates[i].longitude(unit)), double(span.coordinates[i].latitude(unit)));
+        }
+    }
+    else
+    {
+        for(int i = 0; i < span.size; ++i)
+        {
+            double lon, lat;
+            getLonLat(i, lon, lat, unit);
+            visitor(i, lon, lat);
+        }
+    }
+}
+
 }
 
 Q_DECLARE_METATYPE( Marble::GeoDataLineString )
@@ -12,12 +12,14 @@
 #define MARBLE_GEODATALINESTRINGPRIVATE_H
 
 #include "geodata/data/GeoDataGeometry_p.h"
+#include "geodata/data/GeoDataSegmentIndex.h"
 
 #include "geodata/parser/GeoDataTypes.h"
 #include <qwt_point_3d.h>
 #include <QtCore/QHash>
 #include <QtCore/QMutex>
 #include <QtCore/QPointF>
+#include <QtCore/QSharedPointer>
 namespace Marble
 {
 
@@ -62,6 +64,10 @@ class GeoDataLineStringPrivate : public GeoDataGeometryPrivate
         m_level = other.m_level;
         m_messure = other.m_messure;
         m_messureInfo = other.m_messureInfo;
+
+        // The nodes are copied unchanged, so the copy can share the index.
+        QMutexLocker locker(&other.m_segmentIndexMutex);
+        m_segmentIndex = other.m_segmentIndex;
         return *this;
     }
 
@@ -139,6 +145,10 @@ class GeoDataLineStringPrivate : public GeoDataGeometryPrivate
 
     mutable qreal  m_previousResolution;
     mutable qreal  m_level;
+
+    // built on the first segment query of a large line string, guarded by the mutex
+    mutable QMutex m_segmentIndexMutex;
+    mutable QSharedPointer<const GeoDataSegmentIndex> m_segmentIndex;
 };
 
 class GeoDataLineStringCoordinatesPrivate : public GeoDataLineStringPrivate
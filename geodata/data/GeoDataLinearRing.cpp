@@ -100,31 +100,31 @@ bool GeoDataLinearRing::contains( const GeoDataCoordinates &coordinates ) const
 
     int const points = size();
     bool inside = false; // also true for points = 0
-    int j = points - 1;
-
-    for ( int i=0; i<points; ++i )
-    {
-        double lon1;
-        double lat1;
-
-        getLonLat(i, lon1, lat1, GeoDataCoordinates::Radian);
+    if ( points == 0 ) {
+        return inside;
+    }
 
-        double lon2;
-        double lat2;
+    const double lon = coordinates.longitude();
+    const double lat = coordinates.latitude();
 
-        getLonLat(j, lon2, lat2, GeoDataCoordinates::Radian);
+    double lon2;
+    double lat2;
+    getLonLat(points - 1, lon2, lat2, GeoDataCoordinates::Radian);
 
-        if ( ( lon1 < coordinates.longitude() && lon2 >= coordinates.longitude() ) ||
-             ( lon2 < coordinates.longitude() && lon1 >= coordinates.longitude() ) )
+    forEachLonLat(GeoDataCoordinates::Radian, [&](int, double lon1, double lat1)
+    {
+        if ( ( lon1 < lon && lon2 >= lon ) ||
+             ( lon2 < lon && lon1 >= lon ) )
         {
-            if ( lat1 + ( coordinates.longitude() - lon1) / ( lon2 - lon1) * ( lat2-lat1 ) < coordinates.latitude() )
+            if ( lat1 + ( lon - lon1) / ( lon2 - lon1) * ( lat2-lat1 ) < lat )
             {
                 inside = !inside;
             }
         }
 
-        j = i;
-    }
+        lon2 = lon1;
+        lat2 = lat1;
+    });
 
     return inside;
 }
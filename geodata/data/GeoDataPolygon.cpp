@@ -161,6 +161,25 @@ void GeoDataPolygon::appendInnerBoundary( const GeoDataLinearRing& boundary )
 
 bool GeoDataPolygon::contains( const GeoDataCoordinates &coordinates ) const
 {
+    // Below these sizes testing the rings one by one is about as fast as preparing the polygon.
+    static const int PreparedMinSize = 256;
+    static const int PreparedMinRings = 16;
+
+    const GeoDataPolygonPrivate *d = p();
+    if ( d->outer.size() >= PreparedMinSize || d->inner.size() >= PreparedMinRings ) {
+        QSharedPointer<const GeoDataPreparedPolygon> prepared;
+        {
+            QMutexLocker locker(&d->m_preparedMutex);
+            if ( !d->m_prepared || !d->m_prepared->isPreparedFor( *this ) ) {
+                d->m_prepared = QSharedPointer<const GeoDataPreparedPolygon>(new GeoDataPreparedPolygon(*this));
+            }
+
+            prepared = d->m_prepared;
+        }
+
+        return prepared->contains( coordinates );
+    }
+
     if ( !outerBoundary().contains( coordinates ) ) {
         // Not inside the polygon at all
         return false;
@@ -12,8 +12,11 @@
 #define MARBLE_GEODATAPOLYGONPRIVATE_H
 
 #include "geodata/data/GeoDataGeometry_p.h"
+#include "geodata/data/GeoDataPreparedPolygon.h"
 
 #include "geodata/parser/GeoDataTypes.h"
+#include <QtCore/QMutex>
+#include <QtCore/QSharedPointer>
 
 namespace Marble
 {
@@ -32,6 +35,20 @@ class GeoDataPolygonPrivate : public GeoDataGeometryPrivate
     {
     }
 
+    GeoDataPolygonPrivate& operator=( const GeoDataPolygonPrivate &other )
+    {
+        GeoDataGeometryPrivate::operator=( other );
+        outer = other.outer;
+        inner = other.inner;
+        m_dirtyBox = other.m_dirtyBox;
+        m_tessellationFlags = other.m_tessellationFlags;
+
+        // The rings are copied unchanged, so the copy can share the prepared polygon.
+        QMutexLocker locker(&other.m_preparedMutex);
+        m_prepared = other.m_prepared;
+        return *this;
+    }
+
     GeoDataGeometryPrivate* copy() override
     { 
          GeoDataPolygonPrivate* copy = new  GeoDataPolygonPrivate;
@@ -55,6 +72,11 @@ class GeoDataPolygonPrivate : public GeoDataGeometryPrivate
                                             // GeoDataPoints since the LatLonAltBox has 
                                             // been calculated. Saves performance. 
     TessellationFlags           m_tessellationFlags;
+
+    // built on the first containment test of a large polygon and again once
+    // the rings were replaced, guarded by the mutex
+    mutable QMutex m_preparedMutex;
+    mutable QSharedPointer<const GeoDataPreparedPolygon> m_prepared;
 };
 
 } // namespace Marble
@@ -0,0 +1,226 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#include "geodata/data/GeoDataPreparedPolygon.h"
+
+#include <QtCore/QVarLengthArray>
+#include <QtCore/QVector>
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <boost/geometry.hpp>
+#include <boost/geometry/geometries/box.hpp>
+#include <boost/geometry/geometries/point.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+#include "geodata/data/GeoDataLatLonAltBox.h"
+#include "geodata/data/GeoDataLinearRing.h"
+#include "geodata/data/GeoDataPolygon.h"
+
+namespace
+{
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+typedef bg::model::point<double, 2, bg::cs::cartesian> Point;
+typedef bg::model::box<Point> Box;
+typedef std::pair<Box, int> Value;
+typedef bgi::rtree<Value, bgi::rstar<16> > Tree;
+
+struct Edge
+{
+    double lon1;
+    double lat1;
+    double lon2;
+    double lat2;
+
+    // 0 for the outer boundary, i + 1 for inner boundary i
+    int ring;
+};
+
+void
+appendEdges(const Marble::GeoDataLinearRing &ring, int ringIndex, std::vector<Edge> &edges, std::vector<Value> &values)
+{
+    const int size = ring.size();
+    if(size == 0)
+    {
+        return;
+    }
+
+    // the closing edge runs from the last node back to the first
+    double lon1, lat1;
+    ring.getLonLat(size - 1, lon1, lat1, Marble::GeoDataCoordinates::Radian);
+
+    ring.forEachLonLat(Marble::GeoDataCoordinates::Radian, [&](int, double lon2, double lat2)
+    {
+        // node first, as the ring test interpolates from it
+        const Edge edge = { lon2, lat2, lon1, lat1, ringIndex };
+        values.push_back(Value(Box(Point(qMin(lon1, lon2), qMin(lat1, lat2)), Point(qMax(lon1, lon2), qMax(lat1, lat2))), int(edges.size())));
+        edges.push_back(edge);
+
+        lon1 = lon2;
+        lat1 = lat2;
+    });
+}
+
+bool
+sameNodes(const Marble::GeoDataLinearRing &ring, const Marble::GeoDataLinearRing &otherRing)
+{
+    const Marble::GeoDataCoordinateSpan span = ring.coordinateSpan();
+    const Marble::GeoDataCoordinateSpan otherSpan = otherRing.coordinateSpan();
+    if(span.size != otherSpan.size)
+    {
+        return false;
+    }
+
+    if(span.hasArrays() || span.coordinates)
+    {
+        return span.lon == otherSpan.lon && span.coordinates == otherSpan.coordinates && span.stride == otherSpan.stride;
+    }
+
+    // nodes not laid out as arrays are compared one by one
+    return ring == otherRing;
+}
+
+}
+
+namespace Marble
+{
+
+class GeoDataPreparedPolygonPrivate
+{
+public:
+    Tree m_tree;
+    std::vector<Edge> m_edges;
+
+    // the boxes the rings check first, kept so the result matches the rings
+    QVector<GeoDataLatLonAltBox> m_ringBoxes;
+
+    // Holding the rings keeps their nodes from being freed and replaced by others at the same address.
+    GeoDataLinearRing m_outer;
+    QVector<GeoDataLinearRing> m_inner;
+};
+
+GeoDataPreparedPolygon::GeoDataPreparedPolygon(const GeoDataPolygon &polygon)
+    :   d(new GeoDataPreparedPolygonPrivate)
+{
+    const QVector<GeoDataLinearRing> &innerBoundaries = polygon.innerBoundaries();
+
+    int size = polygon.outerBoundary().size();
+    foreach(const GeoDataLinearRing &ring, innerBoundaries)
+    {
+        size += ring.size();
+    }
+
+    std::vector<Value> values;
+    values.reserve(size);
+    d->m_edges.reserve(size);
+    d->m_ringBoxes.reserve(innerBoundaries.size() + 1);
+
+    appendEdges(polygon.outerBoundary(), 0, d->m_edges, values);
+    d->m_ringBoxes.append(polygon.outerBoundary().latLonAltBox());
+
+    for(int i = 0; i < innerBoundaries.size(); ++i)
+    {
+        appendEdges(innerBoundaries[i], i + 1, d->m_edges, values);
+        d->m_ringBoxes.append(innerBoundaries[i].latLonAltBox());
+    }
+
+    // The range constructor packs the tree in one pass.
+    Tree(values.begin(), values.end()).swap(d->m_tree);
+
+    d->m_outer = polygon.outerBoundary();
+    d->m_inner = innerBoundaries;
+}
+
+GeoDataPreparedPolygon::~GeoDataPreparedPolygon()
+{
+    delete d;
+}
+
+bool
+GeoDataPreparedPolygon::contains(const GeoDataCoordinates &coordinates) const
+{
+    const double lon = coordinates.longitude();
+    const double lat = coordinates.latitude();
+
+    // Only edges spanning the longitude somewhere below the point can be crossed.
+    std::vector<Value> values;
+    d->m_tree.query(bgi::intersects(Box(Point(lon, std::numeric_limits<double>::lowest()), Point(lon, lat))), std::back_inserter(values));
+
+    QVarLengthArray<int, 64> crossings;
+    for(const Value &value : values)
+    {
+        // the same test as GeoDataLinearRing::contains()
+        const Edge &edge = d->m_edges[value.second];
+        if((edge.lon1 < lon && edge.lon2 >= lon) ||
+           (edge.lon2 < lon && edge.lon1 >= lon))
+        {
+            if(edge.lat1 + (lon - edge.lon1) / (edge.lon2 - edge.lon1) * (edge.lat2 - edge.lat1) < lat)
+            {
+                crossings.append(edge.ring);
+            }
+        }
+    }
+
+    std::sort(crossings.begin(), crossings.end());
+
+    // A ring contains the point if it is crossed an odd number of times.
+    bool insideOuter = false;
+    for(int i = 0; i < crossings.size(); )
+    {
+        const int ring = crossings[i];
+        int j = i + 1;
+        while(j < crossings.size() && crossings[j] == ring)
+        {
+            ++j;
+        }
+
+        if((j - i) % 2 == 1 && d->m_ringBoxes[ring].contains(coordinates))
+        {
+            if(ring != 0)
+            {
+                // Inside the polygon, but in one of its holes
+                return false;
+            }
+
+            insideOuter = true;
+        }
+
+        i = j;
+    }
+
+    return insideOuter;
+}
+
+bool
+GeoDataPreparedPolygon::isPreparedFor(const GeoDataPolygon &polygon) const
+{
+    const QVector<GeoDataLinearRing> &innerBoundaries = polygon.innerBoundaries();
+    if(innerBoundaries.size() != d->m_inner.size() || !sameNodes(polygon.outerBoundary(), d->m_outer))
+    {
+        return false;
+    }
+
+    for(int i = 0; i < innerBoundaries.size(); ++i)
+    {
+        if(!sameNodes(innerBoundaries[i], d->m_inner[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,55 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#ifndef MARBLE_GEODATAPREPAREDPOLYGON_H
+#define MARBLE_GEODATAPREPAREDPOLYGON_H
+
+#include <QtCore/QtGlobal>
+
+namespace Marble
+{
+
+class GeoDataCoordinates;
+class GeoDataPolygon;
+class GeoDataPreparedPolygonPrivate;
+
+/**
+ * A polygon prepared for repeated containment tests.
+ *
+ * The edges of the outer and all inner boundaries are kept in one packed
+ * R-tree, in longitude and latitude radian. A test only visits the edges
+ * crossing the meridian below the point instead of every node of every
+ * ring, and gives the same answer as the crossing test of the rings.
+ *
+ * The prepared polygon keeps the rings it was built from. Rings share their
+ * nodes until they are changed, so whether a polygon still has the same
+ * rings is told by where their nodes are kept, without comparing them.
+ */
+class GeoDataPreparedPolygon
+{
+public:
+    explicit GeoDataPreparedPolygon(const GeoDataPolygon &polygon);
+    ~GeoDataPreparedPolygon();
+
+    /// Returns whether @p coordinates lie inside the outer boundary but in none of the holes.
+    bool
+    contains(const GeoDataCoordinates &coordinates) const;
+
+    /// Returns whether the rings of @p polygon are still the ones this was prepared from.
+    bool
+    isPreparedFor(const GeoDataPolygon &polygon) const;
+
+private:
+    Q_DISABLE_COPY(GeoDataPreparedPolygon)
+
+    GeoDataPreparedPolygonPrivate *const d;
+};
+
+}
+
+#endif // MARBLE_GEODATAPREPAREDPOLYGON_H
@@ -0,0 +1,96 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#include "geodata/data/GeoDataSegmentIndex.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include <boost/geometry.hpp>
+#include <boost/geometry/geometries/box.hpp>
+#include <boost/geometry/geometries/point.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+#include "geodata/data/GeoDataLineString.h"
+
+namespace
+{
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+typedef bg::model::point<double, 2, bg::cs::cartesian> Point;
+typedef bg::model::box<Point> Box;
+typedef std::pair<Box, int> Value;
+typedef bgi::rtree<Value, bgi::rstar<16> > Tree;
+
+}
+
+namespace Marble
+{
+
+class GeoDataSegmentIndexPrivate
+{
+public:
+    Tree m_tree;
+};
+
+GeoDataSegmentIndex::GeoDataSegmentIndex(const GeoDataLineString &lineString)
+    :   d(new GeoDataSegmentIndexPrivate)
+{
+    const int size = lineString.size();
+    if(size < 2)
+    {
+        return;
+    }
+
+    std::vector<Value> values;
+    values.reserve(size - 1);
+
+    double lon1 = 0.0;
+    double lat1 = 0.0;
+
+    lineString.forEachLonLat(GeoDataCoordinates::Radian, [&](int i, double lon2, double lat2)
+    {
+        if(i > 0)
+        {
+            values.push_back(Value(Box(Point(qMin(lon1, lon2), qMin(lat1, lat2)), Point(qMax(lon1, lon2), qMax(lat1, lat2))), i - 1));
+        }
+
+        lon1 = lon2;
+        lat1 = lat2;
+    });
+
+    // The range constructor packs the tree in one pass.
+    Tree(values.begin(), values.end()).swap(d->m_tree);
+}
+
+GeoDataSegmentIndex::~GeoDataSegmentIndex()
+{
+    delete d;
+}
+
+void
+GeoDataSegmentIndex::query(const QRectF &box, QVector<int> &segments) const
+{
+    std::vector<Value> values;
+    d->m_tree.query(bgi::intersects(Box(Point(box.left(), box.top()), Point(box.right(), box.bottom()))), std::back_inserter(values));
+
+    const int first = segments.size();
+    segments.reserve(first + int(values.size()));
+    for(const Value &value : values)
+    {
+        segments.append(value.second);
+    }
+
+    std::sort(segments.begin() + first, segments.end());
+}
+
+}
@@ -0,0 +1,49 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#ifndef MARBLE_GEODATASEGMENTINDEX_H
+#define MARBLE_GEODATASEGMENTINDEX_H
+
+#include <QtCore/QRectF>
+#include <QtCore/QVector>
+
+namespace Marble
+{
+
+class GeoDataLineString;
+class GeoDataSegmentIndexPrivate;
+
+/**
+ * A packed R-tree over the bounding boxes of the segments of a line string,
+ * in longitude and latitude radian. Segment i joins the nodes i and i + 1.
+ *
+ * Segments are taken as straight in longitude and latitude, a segment
+ * crossing the date line spans all longitudes in between.
+ */
+class GeoDataSegmentIndex
+{
+public:
+    explicit GeoDataSegmentIndex(const GeoDataLineString &lineString);
+    ~GeoDataSegmentIndex();
+
+    /**
+     * Appends the segments whose bounding box intersects @p box to @p segments,
+     * in ascending order. The box holds longitudes along x and latitudes along y.
+     */
+    void
+    query(const QRectF &box, QVector<int> &segments) const;
+
+private:
+    Q_DISABLE_COPY(GeoDataSegmentIndex)
+
+    GeoDataSegmentIndexPrivate *const d;
+};
+
+}
+
+#endif // MARBLE_GEODATASEGMENTINDEX_H
@@ -117,7 +117,7 @@ GeoGroundGraphicsItem::latLonAltBox() const
 namespace
 {
 
-void getTilesImpl(GeoSceneTextureTileDataset *tileDataset, const TileId &tileId, int zoomLevel, const GeoDataLatLonAltBox &m_latLonAltBox, TileMap &tiles, std::atomic<bool> &cancel)
+void getTilesImpl(GeoSceneTextureTileDataset *tileDataset, const TileId &tileId, int zoomLevel, const GeoDataLatLonAltBox &m_latLonAltBox, TileCoverage &tiles, std::atomic<bool> &cancel)
 {
     double north;
     double south;
@@ -163,7 +163,7 @@ void getTilesImpl(GeoSceneTextureTileDataset *tileDataset, const TileId &tileId,
 
     if(boost::geometry::within(box, box2))
     {
-        tiles[tileId.tileLevel()][tileId.x()][tileId.y()] = Marble::TileStatus::Full;
+        tiles.insert(tileId.tileLevel(), tileId.x(), tileId.y(), Marble::TileStatus::Full);
     }
     else if(boost::geometry::within(box2, box) || boost::geometry::intersects(box2, box))
     {
@@ -181,14 +181,14 @@ void getTilesImpl(GeoSceneTextureTileDataset *tileDataset, const TileId &tileId,
         }
         else
         {
-            tiles[tileId.tileLevel()][tileId.x()][tileId.y()] = Marble::TileStatus::Partially;
+            tiles.insert(tileId.tileLevel(), tileId.x(), tileId.y(), Marble::TileStatus::Partially);
         }
     }
 }
 
 }
 
-void GeoGroundGraphicsItem::getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileMap &tiles, std::atomic<bool> &cancel)
+void GeoGroundGraphicsItem::getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &cancel)
 {
     getTilesImpl(tileDataset, tile, zoomLevel, m_latLonAltBox, tiles, cancel);
 }
@@ -21,6 +21,8 @@
 #include "geodata/data/GeoDataIconStyle.h"
 #include "geodata/data/GeoDataSpectroStyle.h"
 #include "GeoPainter.h"
+#include "TileCoverageRasterizer.h"
+#include "TileCoverageValidation.h"
 #include "ViewportParams.h"
 #include "geodata/data/GeoDataStyle.h"
 #include <QtCore/QDebug>
@@ -55,15 +57,29 @@ namespace Marble
 
 static const double m_labelAreaMargin = 10.0;
 
+// Clipped fragments extend this fraction of a tile beyond it, so strokes don't end at the tile border.
+static const double m_fragmentMargin = 1.0 / 32.0;
+
+// Fragments of at most this many points are not split further once the coverage is known.
+static const int m_smallFragmentSize = 64;
+
+static std::atomic<qint64> s_fragmentCacheBudget( 64 * 1024 * 1024 );
+static std::atomic<qint64> s_fragmentCacheSize( 0 );
+
 GeoLineStringGraphicsItem::GeoLineStringGraphicsItem( const GeoDataFeature *feature,
                                                       const GeoDataLineString* lineString )
         : GeoGraphicsItem( feature ),
-          m_lineString( lineString )
+          m_lineString( lineString ),
+          m_fragmentBytes( 0 ),
+          m_tileDataset( nullptr ),
+          m_tileZoomLevel( -1 ),
+          m_fragmentsBuilt( false )
 {
 }
 
 GeoLineStringGraphicsItem::~GeoLineStringGraphicsItem()
 {
+    clearFragments();
 }
 
 
@@ -71,6 +87,130 @@ GeoLineStringGraphicsItem::~GeoLineStringGraphicsItem()
 void GeoLineStringGraphicsItem::setLineString( const GeoDataLineString* lineString )
 {
     m_lineString = lineString;
+    clearFragments();
+}
+
+void GeoLineStringGraphicsItem::setFragmentCacheBudget(qint64 bytes)
+{
+    s_fragmentCacheBudget = bytes;
+}
+
+void GeoLineStringGraphicsItem::clearFragments()
+{
+    QMutexLocker locker(&m_fragmentMutex);
+
+    s_fragmentCacheSize -= m_fragmentBytes;
+    m_fragmentBytes = 0;
+    m_fragments.clear();
+    m_fragmentsBuilt = false;
+}
+
+void GeoLineStringGraphicsItem::setTileLayout(const GeoSceneTextureTileDataset *tileDataset, int zoomLevel)
+{
+    clearFragments();
+
+    m_tileDataset = tileDataset;
+    m_tileZoomLevel = zoomLevel;
+}
+
+void GeoLineStringGraphicsItem::buildFragments()
+{
+    QMutexLocker locker(&m_fragmentMutex);
+    if(m_fragmentsBuilt)
+    {
+        return;
+    }
+
+    // Measured line strings are drawn segment by segment and can't use fragments.
+    if(m_tileDataset && s_fragmentCacheBudget > 0 && !m_lineString->hasMessure())
+    {
+        const int count = m_lineString->size();
+
+        QPolygonF tempPolygon(count);
+        m_lineString->forEachLonLat(GeoDataCoordinates::Unit::Radian, [&tempPolygon](int i, double lon, double lat)
+        {
+            tempPolygon[i] = QPointF(lon, lat);
+        });
+
+        std::atomic<bool> cancel( false );
+        FragmentHash fragments;
+        getTilesImpl(m_tileDataset, QVector<QPolygonF>() << tempPolygon, TileId(0, 0, 0, 0), m_tileZoomLevel, nullptr, cancel, &fragments, count / 2);
+
+        qint64 bytes = 0;
+        for(auto it = fragments.begin(); it != fragments.end(); ++it)
+        {
+            for(auto itFragment = it.value().begin(); itFragment != it.value().end(); ++itFragment)
+            {
+                for(auto itPoint = itFragment->begin(); itPoint != itFragment->end(); ++itPoint)
+                {
+                    *itPoint *= RAD2DEG;
+                }
+
+                itFragment->squeeze();
+                bytes += itFragment->size() * sizeof(QPointF);
+            }
+        }
+
+        if(!fragments.isEmpty() && s_fragmentCacheSize.fetch_add(bytes) + bytes <= s_fragmentCacheBudget)
+        {
+            m_fragments = fragments;
+            m_fragmentBytes = bytes;
+        }
+        else if(!fragments.isEmpty())
+        {
+            s_fragmentCacheSize -= bytes;
+        }
+    }
+
+    m_fragmentsBuilt = true;
+}
+
+const QVector<QPolygonF> *
+GeoLineStringGraphicsItem::tileFragments(const TileId &tileId)
+{
+    // Clipping all tiles takes a while for long line strings, so it is left to the first tile rendered.
+    if(!m_fragmentsBuilt)
+    {
+        buildFragments();
+    }
+
+    if(m_fragments.isEmpty())
+    {
+        return nullptr;
+    }
+
+    // The fragment of any ancestor covers the tile as well, it is just larger.
+    for(int level = tileId.tileLevel(); level >= 0; --level)
+    {
+        const int shift = tileId.tileLevel() - level;
+        auto it = m_fragments.constFind(TileId(0, level, tileId.x() >> shift, tileId.y() >> shift));
+        if(it != m_fragments.constEnd())
+        {
+            return &it.value();
+        }
+    }
+
+    return nullptr;
+}
+
+QVector<QPolygonF>
+GeoLineStringGraphicsItem::getFragmentPolygons(const ViewportParams *viewport, const QVector<QPolygonF> &fragments) const
+{
+    QVector<QPolygonF> polygons;
+
+    foreach(const QPolygonF &fragment, fragments)
+    {
+        if(viewport->isCancelled())
+        {
+            return QVector<QPolygonF>();
+        }
+
+        QVector<QPolygonF> tempPolygons;
+        viewport->screenCoordinates( GeoDataLineString(fragment, m_lineString->tessellationFlags()), tempPolygons );
+        polygons << tempPolygons;
+    }
+
+    return polygons;
 }
 
 const GeoDataLatLonAltBox& GeoLineStringGraphicsItem::latLonAltBox() const
@@ -98,6 +238,16 @@ getColor(const Marble::ColorMapPtr &colorMap, const QVector<QRgb> &colorTable, c
 
 
 void GeoLineStringGraphicsItem::renderGeometry(GeoPainter *painter, const ViewportParams *viewport, GeoDataStyle::ConstPtr style)
+{
+    renderLineString(painter, viewport, style, nullptr);
+}
+
+void GeoLineStringGraphicsItem::renderTileGeometry(GeoPainter *painter, const ViewportParams *viewport, GeoDataStyle::ConstPtr style, const TileId &tileId)
+{
+    renderLineString(painter, viewport, style, tileFragments(tileId));
+}
+
+void GeoLineStringGraphicsItem::renderLineString(GeoPainter *painter, const ViewportParams *viewport, GeoDataStyle::ConstPtr style, const QVector<QPolygonF> *fragments)
 {
     // Immediately leave this method now if:
     // - the object is not visible in the viewport or if
@@ -119,7 +269,7 @@ void GeoLineStringGraphicsItem::renderGeometry(GeoPainter *painter, const Viewpo
     {
         painter->setPen( QPen() );
 
-        QVector<QPolygonF> polygons = getPolygonsImpl(viewport, m_lineString);
+        QVector<QPolygonF> polygons = fragments ? getFragmentPolygons(viewport, *fragments) : getPolygonsImpl(viewport, m_lineString);
         foreach( const QPolygonF &itPolygon, polygons )
         {
             painter->drawPolyline( itPolygon );
@@ -179,6 +329,8 @@ void GeoLineStringGraphicsItem::renderGeometry(GeoPainter *painter, const Viewpo
             int to = m_lineString->size();
             for ( int i = 0; i < to; i++ )
             {
+                if ( i % ViewportParams::CancelCheckInterval == 0 && viewport->isCancelled() )
+                    break;
 
                 double lon1;
                 double lat1;
@@ -286,7 +438,7 @@ void GeoLineStringGraphicsItem::renderGeometry(GeoPainter *painter, const Viewpo
             if ( currentPen.color() != style->lineStyle().paintedColor() )
                 currentPen.setColor( style->lineStyle().paintedColor() );
 
-            QVector<QPolygonF> polygons = getPolygonsImpl(viewport, m_lineString);
+            QVector<QPolygonF> polygons = fragments ? getFragmentPolygons(viewport, *fragments) : getPolygonsImpl(viewport, m_lineString);
         //    qWarning() << "GeoLineStringGraphicsItem::renderGeometry get polygons" << timer.nsecsElapsed();
 
             foreach( const QPolygonF &polygon, polygons )
@@ -468,21 +620,31 @@ GeoLineStringGraphicsItem::getSize(GeoDataStyle::ConstPtr style, double radius,
     return size;
 }
 
-void GeoLineStringGraphicsItem::getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tileId, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel)
+void GeoLineStringGraphicsItem::getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tileId, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel)
 {
     int count = m_lineString->size();
 
     QPolygonF tempPolygon(count);
-    for(int i = 0; i < count; ++i)
+    m_lineString->forEachLonLat(GeoDataCoordinates::Unit::Radian, [&tempPolygon](int i, double lon, double lat)
     {
-        double lon;
-        double lat;
-        m_lineString->getLonLat(i, lon, lat, GeoDataCoordinates::Unit::Radian);
-
         tempPolygon[i] = QPointF(lon, lat);
+    });
+
+    setTileLayout(tileDataset, zoomLevel);
+
+    TileCoverage lineTiles;
+    TileCoverageRasterizer(tileDataset, zoomLevel).addLineString(tempPolygon, lineTiles, aCancel);
+
+    Q_UNUSED(tileId);
+
+#ifdef VALIDATE_TILE_COVERAGE
+    if(!TileCoverageValidation::compareLineStrings(tileDataset, zoomLevel, QVector<QPolygonF>() << tempPolygon, lineTiles, aCancel))
+    {
+        qWarning() << "Rasterized line string coverage differs from the clipped one";
     }
+#endif
 
-    getTilesImpl(tileDataset, QVector<QPolygonF>() << tempPolygon, tileId, zoomLevel, tiles, aCancel);
+    tiles.unite(lineTiles);
 }
 
 namespace
@@ -695,6 +857,11 @@ getGeoPolygons(const ViewportParams *viewport, const GeoDataLineString *lineStri
 
     for (auto const& l : output)
     {
+        if(viewport->isCancelled())
+        {
+            return QVector<QPolygonF>();
+        }
+
         QVector<QPolygonF> tempPolygons;
         viewport->screenCoordinates( GeoDataLineString(l, lineString->tessellationFlags()), tempPolygons );
         polygons << tempPolygons;
@@ -714,6 +881,11 @@ GeoLineStringGraphicsItem::getPolygonsImpl(const ViewportParams *viewport, const
     QVector<QPolygonF> polygons;
     int size = lineString->size();
 
+    if(viewport->isCancelled())
+    {
+        return polygons;
+    }
+
     if(viewport->viewLatLonAltBox().united(lineString->latLonAltBox()) == viewport->viewLatLonAltBox() || size <= 1)
     {
         viewport->screenCoordinates( *lineString, polygons);
@@ -980,9 +1152,9 @@ QPointF GeoLineStringGraphicsItem::interpolateLabelPoint(const QPointF& previous
     return QPointF( -1.0, -1.0 );
 }
 
-void GeoLineStringGraphicsItem::getTilesImpl(GeoSceneTextureTileDataset *tileDataset, const QVector<QPolygonF> &tempPolygon, const TileId &tileId, int zoomLevel, TileMap & tiles, std::atomic<bool> &aCancel)
+void GeoLineStringGraphicsItem::getTilesImpl(const GeoSceneTextureTileDataset *tileDataset, const QVector<QPolygonF> &tempPolygon, const TileId &tileId, int zoomLevel, TileCoverage *tiles, std::atomic<bool> &aCancel, FragmentHash *fragments, int maxFragmentSize)
 {
-    if(aCancel)
+    if(aCancel || (!tiles && !fragments))
     {
         return;
     }
@@ -991,20 +1163,27 @@ void GeoLineStringGraphicsItem::getTilesImpl(GeoSceneTextureTileDataset *tileDat
 
     double lonLeft   = ( tileId.x() - radius ) / radius * M_PI;
     double lonRight  = ( tileId.x() - radius + 1 ) / radius * M_PI;
+    const double lonMargin = ( lonRight - lonLeft ) * m_fragmentMargin;
 
     radius = ( 1 << tileId.tileLevel() ) * tileDataset->levelZeroRows() / 2.0;
 
     double latBottom = 0;
     double latTop = 0;
+    double latMarginBottom = 0;
+    double latMarginTop = 0;
 
     switch ( tileDataset->projection() ) {
     case GeoSceneTileDataset::Equirectangular:
         latTop = (radius - tileId.y() - 1) / radius * M_PI / 2.0;
         latBottom = (radius - tileId.y()) / radius * M_PI / 2.0;
+        latMarginTop = (radius - tileId.y() - 1 - m_fragmentMargin) / radius * M_PI / 2.0;
+        latMarginBottom = (radius - tileId.y() + m_fragmentMargin) / radius * M_PI / 2.0;
         break;
     case GeoSceneTileDataset::Mercator:
         latTop = atan( sinh( ( radius - tileId.y() - 1) / radius * M_PI ) );
         latBottom = atan( sinh( ( radius - tileId.y()) / radius * M_PI ) );
+        latMarginTop = atan( sinh( ( radius - tileId.y() - 1 - m_fragmentMargin) / radius * M_PI ) );
+        latMarginBottom = atan( sinh( ( radius - tileId.y() + m_fragmentMargin) / radius * M_PI ) );
         break;
     }
 
@@ -1016,19 +1195,52 @@ void GeoLineStringGraphicsItem::getTilesImpl(GeoSceneTextureTileDataset *tileDat
                                                    lonRight,
                                                    latBottom);
 
+    // Clipping against the slightly larger box gives fragments that can be drawn into the
+    // tile directly, and the children's boxes including their margins still lie within it.
+    box_type marginBox = boost::geometry::make<box_type>(lonLeft - lonMargin,
+                                                         latMarginTop,
+                                                         lonRight + lonMargin,
+                                                         latMarginBottom);
+
     QVector<QPolygonF> output;
+    bool intersectsTile = false;
     foreach(const QPolygonF &line, tempPolygon)
     {
         QVector<QPolygonF> tempOutput;
-        bool intersect = boost::geometry::intersection(line, box, tempOutput);
+        bool intersect = boost::geometry::intersection(line, marginBox, tempOutput);
         if(intersect)
         {
+            foreach(const QPolygonF &fragment, tempOutput)
+            {
+                intersectsTile = intersectsTile || boost::geometry::intersects(fragment, box);
+            }
+
             output << tempOutput;
         }
     }
 
-    if(!output.isEmpty())
+    if(!output.isEmpty() && intersectsTile)
     {
+        if(fragments)
+        {
+            int fragmentSize = 0;
+            foreach(const QPolygonF &fragment, output)
+            {
+                fragmentSize += fragment.size();
+            }
+
+            if(fragmentSize <= maxFragmentSize)
+            {
+                fragments->insert(TileId(0, tileId.tileLevel(), tileId.x(), tileId.y()), output);
+
+                // Descendants find this fragment as well.
+                if(!tiles && fragmentSize <= m_smallFragmentSize)
+                {
+                    return;
+                }
+            }
+        }
+
         if (tileId.tileLevel()< zoomLevel)
         {
             TileId tile1(tileId.mapThemeIdHash(), tileId.tileLevel()+1, tileId.x()*2, tileId.y()*2);
@@ -1036,14 +1248,17 @@ void GeoLineStringGraphicsItem::getTilesImpl(GeoSceneTextureTileDataset *tileDat
             TileId tile3(tileId.mapThemeIdHash(), tileId.tileLevel()+1, tileId.x()*2, (tileId.y()*2)+1);
             TileId tile4(tileId.mapThemeIdHash(), tileId.tileLevel()+1, (tileId.x()*2) + 1, (tileId.y()*2)+1);
 
-            getTilesImpl(tileDataset, output, tile1, zoomLevel, tiles, aCancel);
-            getTilesImpl(tileDataset, output, tile2, zoomLevel, tiles, aCancel);
-            getTilesImpl(tileDataset, output, tile3, zoomLevel, tiles, aCancel);
-            getTilesImpl(tileDataset, output, tile4, zoomLevel, tiles, aCancel);
+            getTilesImpl(tileDataset, output, tile1, zoomLevel, tiles, aCancel, fragments, maxFragmentSize);
+            getTilesImpl(tileDataset, output, tile2, zoomLevel, tiles, aCancel, fragments, maxFragmentSize);
+            getTilesImpl(tileDataset, output, tile3, zoomLevel, tiles, aCancel, fragments, maxFragmentSize);
+            getTilesImpl(tileDataset, output, tile4, zoomLevel, tiles, aCancel, fragments, maxFragmentSize);
         }
         else
         {
-            tiles[tileId.tileLevel()][tileId.x()][tileId.y()] = Marble::TileStatus::Partially;
+            if(tiles)
+            {
+                tiles->insert(tileId.tileLevel(), tileId.x(), tileId.y(), Marble::TileStatus::Partially);
+            }
         }
     }
 }
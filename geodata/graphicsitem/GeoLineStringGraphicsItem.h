@@ -14,6 +14,10 @@
 #include "graphicsview/GeoGraphicsItem.h"
 #include "MarbleGlobal.h"
 
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtGui/QPolygonF>
+
 namespace Marble
 {
 
@@ -39,6 +43,10 @@ public:
     renderGeometry( GeoPainter* painter, const ViewportParams *viewport, GeoDataStyle::ConstPtr style ) override;
 
     
+    void
+    renderTileGeometry( GeoPainter* painter, const ViewportParams *viewport, GeoDataStyle::ConstPtr style, const TileId &tileId ) override;
+
+    
     void
     renderLabels( GeoPainter* painter, const ViewportParams *viewport, GeoDataStyle::ConstPtr style, GeoLabelPlaceHandler &placeHandler  ) override;
 
@@ -48,14 +56,44 @@ public:
 
     
     void
-    getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel) override;
+    getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel) override;
+
+    void
+    setTileLayout(const GeoSceneTextureTileDataset *tileDataset, int zoomLevel) override;
+
+    /**
+     * Sets the memory shared by all line strings for keeping the fragments
+     * clipped when a line string is first rendered into tiles. A budget of
+     * 0 disables the fragment cache.
+     */
+    static
+    void
+    setFragmentCacheBudget(qint64 bytes);
 
 protected:
     const GeoDataLineString *m_lineString;
 
 private:
+    typedef QHash<TileId, QVector<QPolygonF> > FragmentHash;
+
+    void
+    renderLineString( GeoPainter* painter, const ViewportParams *viewport, GeoDataStyle::ConstPtr style, const QVector<QPolygonF> *fragments );
+
+    const QVector<QPolygonF> *
+    tileFragments(const TileId &tileId);
+
+    void
+    buildFragments();
+
+    QVector<QPolygonF>
+    getFragmentPolygons(const ViewportParams *viewport, const QVector<QPolygonF> &fragments) const;
+
+    void
+    clearFragments();
+
     friend class GraticulePlugin;
     friend class GeoMultiLineStringGraphicsItem;
+    friend class TileCoverageValidation;
 
     static
     bool drawPolylineLabel(GeoPainter* painter, const QVector<QPolygonF> &polygons, const ViewportParams *viewport, const QString& labelText, LabelPositionFlags labelPositionFlags, const QColor& labelColor, const QFont& labelFont, int labelStyles, GeoLabelPlaceHandler &placeHandler, const GeoDataFeature* feature);
@@ -78,11 +116,20 @@ private:
 
     static
     void
-    getTilesImpl(GeoSceneTextureTileDataset *tileDataset, const QVector<QPolygonF> &tempPolygon, const TileId &tile, int zoomLevel,  TileMap &tiles, std::atomic<bool> &aCancel);
+    getTilesImpl(const GeoSceneTextureTileDataset *tileDataset, const QVector<QPolygonF> &tempPolygon, const TileId &tile, int zoomLevel, TileCoverage *tiles, std::atomic<bool> &aCancel, FragmentHash *fragments = nullptr, int maxFragmentSize = 0);
 
     static
     QSizeF
     getSize(GeoDataStyle::ConstPtr style, double radius, const GeoDataLineString *lineString);
+
+    FragmentHash m_fragments;
+    qint64 m_fragmentBytes;
+
+    // the layout fragments are clipped for, they are built on the first tile rendered
+    const GeoSceneTextureTileDataset *m_tileDataset;
+    int m_tileZoomLevel;
+    QMutex m_fragmentMutex;
+    std::atomic<bool> m_fragmentsBuilt;
 };
 
 }
@@ -21,6 +21,8 @@
 #include "geodata/data/GeoDataLabelStyle.h"
 #include "geodata/data/GeoDataIconStyle.h"
 #include "GeoPainter.h"
+#include "TileCoverageRasterizer.h"
+#include "TileCoverageValidation.h"
 #include "ViewportParams.h"
 #include "geodata/data/GeoDataStyle.h"
 #include "geodata/data/GeoDataMultiLineString.h"
@@ -230,24 +232,40 @@ void GeoMultiLineStringGraphicsItem::renderIcons(GeoPainter *painter, const View
 }
 
 void
-GeoMultiLineStringGraphicsItem::getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tileId, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel)
-{   
+GeoMultiLineStringGraphicsItem::getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tileId, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel)
+{
+    const TileCoverageRasterizer rasterizer(tileDataset, zoomLevel);
+
+    TileCoverage lineTiles;
+#ifdef VALIDATE_TILE_COVERAGE
+    QVector<QPolygonF> lineStrings;
+#endif
+
     foreach(const GeoDataLineString &lineString, m_lineStrings->lineStrings())
     {
-        int count = lineString.size();
-
-        QPolygonF tempPolygon(count);
-        for(int i = 0; i < count; ++i)
+        QPolygonF tempPolygon(lineString.size());
+        lineString.forEachLonLat(GeoDataCoordinates::Unit::Radian, [&tempPolygon](int i, double lon, double lat)
         {
-            double lon;
-            double lat;
-            lineString.getLonLat(i, lon, lat, GeoDataCoordinates::Unit::Radian);
-
             tempPolygon[i] = QPointF(lon, lat);
-        }
+        });
 
-        GeoLineStringGraphicsItem::getTilesImpl(tileDataset, QVector<QPolygonF>() << tempPolygon, tileId, zoomLevel, tiles, aCancel);
+        rasterizer.addLineString(tempPolygon, lineTiles, aCancel);
+
+#ifdef VALIDATE_TILE_COVERAGE
+        lineStrings.append(tempPolygon);
+#endif
+    }
+
+    Q_UNUSED(tileId);
+
+#ifdef VALIDATE_TILE_COVERAGE
+    if(!TileCoverageValidation::compareLineStrings(tileDataset, zoomLevel, lineStrings, lineTiles, aCancel))
+    {
+        qWarning() << "Rasterized multi line string coverage differs from the clipped one";
     }
+#endif
+
+    tiles.unite(lineTiles);
 }
 
 }
@@ -34,7 +34,7 @@ public:
 
     
     void
-    getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tileId, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel) override;
+    getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tileId, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel) override;
 
 protected:
 
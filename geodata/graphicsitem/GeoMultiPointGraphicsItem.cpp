@@ -142,7 +142,7 @@ const GeoDataLatLonAltBox& GeoMultiPointGraphicsItem::latLonAltBox() const
     return m_points->latLonAltBox();
 }
 
-void GeoMultiPointGraphicsItem::getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel)
+void GeoMultiPointGraphicsItem::getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel)
 {
     int count = m_points->size();
     for(int i =0; i < count; ++i)
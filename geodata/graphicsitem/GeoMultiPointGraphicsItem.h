@@ -40,7 +40,7 @@ public:
 
     
     void
-    getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel) override;
+    getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel) override;
 
 protected:   
     const GeoDataMultiPoint *m_points;
@@ -23,6 +23,8 @@
 #include "geodata/data/GeoDataLabelStyle.h"
 #include "geodata/data/GeoDataIconStyle.h"
 #include "GeoPainter.h"
+#include "TileCoverageRasterizer.h"
+#include "TileCoverageValidation.h"
 #include "ViewportParams.h"
 #include "geodata/data/GeoDataStyle.h"
 #include "geodata/data/GeoDataMultiLineString.h"
@@ -250,26 +252,33 @@ void GeoMultiPolygonGraphicsItem::renderIcons(GeoPainter *painter, const Viewpor
     }
 }
 
-void GeoMultiPolygonGraphicsItem::getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel)
+bool GeoMultiPolygonGraphicsItem::opaqueFillColor( GeoDataStyle::ConstPtr style, QColor &color ) const
 {
+    return GeoPolygonGraphicsItem::opaqueFillColorImpl(style, color);
+}
+
+void GeoMultiPolygonGraphicsItem::getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel)
+{
+    const TileCoverageRasterizer rasterizer(tileDataset, zoomLevel);
 
+    TileCoverage polygonTiles;
     foreach(const GeoDataPolygon &polygon, m_polygons->polygons())
     {
-        const GeoDataLinearRing &outerBoundary = polygon.outerBoundary();
-        int count = polygon.outerBoundary().size();
+        GeoPolygonGraphicsItem::rasterizeTiles(rasterizer, polygon, polygonTiles, aCancel);
 
-        QPolygonF tempPolygon(count);
-        for(int i = 0; i < count; ++i)
+#ifdef VALIDATE_TILE_COVERAGE
+        TileCoverage rasterizedTiles;
+        GeoPolygonGraphicsItem::rasterizeTiles(rasterizer, polygon, rasterizedTiles, aCancel);
+        if(!TileCoverageValidation::comparePolygon(tileDataset, zoomLevel, polygon, rasterizedTiles, aCancel))
         {
-            double lon;
-            double lat;
-            outerBoundary.getLonLat(i, lon, lat, GeoDataCoordinates::Unit::Radian);
-
-            tempPolygon[i] = QPointF(lon, lat);
+            qWarning() << "Rasterized multi polygon coverage differs from the clipped one";
         }
-
-        GeoPolygonGraphicsItem::getTilesImpl(tileDataset, tempPolygon, tile, zoomLevel, tiles, aCancel);
+#endif
     }
+
+    Q_UNUSED(tile);
+
+    tiles.unite(polygonTiles);
 }
 
 }
@@ -35,7 +35,10 @@ public:
 
     
     void
-    getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel) override;
+    getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel) override;
+
+    bool
+    opaqueFillColor( GeoDataStyle::ConstPtr style, QColor &color ) const override;
 
 protected:
     const GeoDataMultiPolygon *m_polygons;
@@ -137,12 +137,12 @@ const GeoDataLatLonAltBox& GeoPointGraphicsItem::latLonAltBox() const
     return m_point->latLonAltBox();
 }
 
-void GeoPointGraphicsItem::getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tileId, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel)
+void GeoPointGraphicsItem::getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tileId, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel)
 {
     getTilesImpl(tileDataset, m_point->coordinates(), tileId, zoomLevel, tiles, aCancel);
 }
 
-void GeoPointGraphicsItem::getTilesImpl(GeoSceneTextureTileDataset *tileDataset, const GeoDataCoordinates &point, const TileId &tile, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel)
+void GeoPointGraphicsItem::getTilesImpl(GeoSceneTextureTileDataset *tileDataset, const GeoDataCoordinates &point, const TileId &tile, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel)
 {
     if(aCancel)
     {
@@ -150,7 +150,7 @@ void GeoPointGraphicsItem::getTilesImpl(GeoSceneTextureTileDataset *tileDataset,
     }
 
     TileId tempTileId = TileId::fromCoordinates( tileDataset, point, zoomLevel );
-    tiles[tempTileId.tileLevel()][tempTileId.x()][tempTileId.y()] = Marble::TileStatus::Partially;
+    tiles.insert(tempTileId.tileLevel(), tempTileId.x(), tempTileId.y(), Marble::TileStatus::Partially);
 }
 
 }
@@ -48,14 +48,14 @@ public:
 
     
     void
-    getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tileId, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel) override;
+    getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tileId, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel) override;
 
 protected:
     friend class GeoMultiPointGraphicsItem;
 
     static
     void
-    getTilesImpl(GeoSceneTextureTileDataset *tileDataset, const GeoDataCoordinates &point, const TileId &tile, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel);
+    getTilesImpl(GeoSceneTextureTileDataset *tileDataset, const GeoDataCoordinates &point, const TileId &tile, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel);
 
     const GeoDataPoint *m_point;
 };
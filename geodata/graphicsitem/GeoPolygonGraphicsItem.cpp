@@ -24,12 +24,15 @@
 #include "GeoPainter.h"
 #include "geodata/parser/GeoDataTypes.h"
 #include "geodata/data/GeoDataPlacemark.h"
+#include "TileCoverageRasterizer.h"
+#include "TileCoverageValidation.h"
 #include "ViewportParams.h"
 #include "geodata/data/GeoDataStyle.h"
 #include "MarbleDirs.h"
 
 #include <QVector2D>
 #include <QtCore/qmath.h>
+#include <QtCore/QDebug>
 #include <QtCore/QElapsedTimer>
 
 namespace Marble
@@ -230,31 +233,73 @@ void GeoPolygonGraphicsItem::renderLabels(GeoPainter *painter, const ViewportPar
     }
 }
 
+bool
+GeoPolygonGraphicsItem::opaqueFillColor( GeoDataStyle::ConstPtr style, QColor &color ) const
+{
+    return opaqueFillColorImpl(style, color);
+}
+
+bool
+GeoPolygonGraphicsItem::opaqueFillColorImpl(GeoDataStyle::ConstPtr style, QColor &color)
+{
+    // Without a style the default brush paints nothing, textures vary across the tile.
+    if(!style || !style->polyStyle().fill() || !style->polyStyle().textureImage().isNull())
+    {
+        return false;
+    }
+
+    color = style->polyStyle().paintedColor();
+    return color.alpha() == 255;
+}
+
 void
-GeoPolygonGraphicsItem::getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel)
-{ //tile - object, geometry - geojson object, Number
-  //Convert tile to lon/lat
-    const GeoDataLinearRing &outerBoundary = m_polygon->outerBoundary();
-    int count = outerBoundary.size();
-
-    QPolygonF tempPolygon(count);
-    for(int i = 0; i < count; ++i)
+GeoPolygonGraphicsItem::getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel)
+{
+    TileCoverage polygonTiles;
+    rasterizeTiles(TileCoverageRasterizer(tileDataset, zoomLevel), *m_polygon, polygonTiles, aCancel);
+
+    Q_UNUSED(tile);
+
+#ifdef VALIDATE_TILE_COVERAGE
+    if(!TileCoverageValidation::comparePolygon(tileDataset, zoomLevel, *m_polygon, polygonTiles, aCancel))
     {
-        double lon;
-        double lat;
-        outerBoundary.getLonLat(i, lon, lat, GeoDataCoordinates::Unit::Radian);
+        qWarning() << "Rasterized polygon coverage differs from the clipped one";
+    }
+#endif
+
+    tiles.unite(polygonTiles);
+}
 
-        tempPolygon[i] = QPointF(lon, lat);
+void
+GeoPolygonGraphicsItem::rasterizeTiles(const TileCoverageRasterizer &rasterizer, const GeoDataPolygon &polygon, TileCoverage &tiles, std::atomic<bool> &aCancel)
+{
+    QVector<QPolygonF> innerBoundaries;
+    innerBoundaries.reserve(polygon.innerBoundaries().size());
+    foreach(const GeoDataLinearRing &innerBoundary, polygon.innerBoundaries())
+    {
+        innerBoundaries.append(lonLatPolygon(innerBoundary));
     }
 
-    getTilesImpl(tileDataset, tempPolygon, tile, zoomLevel, tiles, aCancel);
+    rasterizer.addPolygon(lonLatPolygon(polygon.outerBoundary()), innerBoundaries, tiles, aCancel);
+}
+
+QPolygonF
+GeoPolygonGraphicsItem::lonLatPolygon(const GeoDataLinearRing &ring)
+{
+    QPolygonF polygon(ring.size());
+    ring.forEachLonLat(GeoDataCoordinates::Unit::Radian, [&polygon](int i, double lon, double lat)
+    {
+        polygon[i] = QPointF(lon, lat);
+    });
+
+    return polygon;
 }
 
 namespace
 {
 
 void
-getTilesFromPainterPath(GeoSceneTextureTileDataset *tileDataset, const QPainterPath &subject, const TileId &tileId, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel)
+getTilesFromPainterPath(GeoSceneTextureTileDataset *tileDataset, const QPainterPath &subject, const TileId &tileId, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel)
 {
     if(aCancel)
     {
@@ -304,7 +349,7 @@ getTilesFromPainterPath(GeoSceneTextureTileDataset *tileDataset, const QPainterP
         if (result.boundingRect() == rect &&
             result.size() == 5)
         {
-            tiles[tileId.tileLevel()][tileId.x()][tileId.y()] = TileStatus::Full;
+            tiles.insert(tileId.tileLevel(), tileId.x(), tileId.y(), TileStatus::Full);
         }
         else
         {
@@ -325,7 +370,7 @@ getTilesFromPainterPath(GeoSceneTextureTileDataset *tileDataset, const QPainterP
             }
             else
             {
-                tiles[tileId.tileLevel()][tileId.x()][tileId.y()] = TileStatus::Partially;
+                tiles.insert(tileId.tileLevel(), tileId.x(), tileId.y(), TileStatus::Partially);
             }
         }
     }
@@ -335,7 +380,7 @@ getTilesFromPainterPath(GeoSceneTextureTileDataset *tileDataset, const QPainterP
 }
 
 void
-GeoPolygonGraphicsItem::getTilesImpl(GeoSceneTextureTileDataset *tileDataset, const QPolygonF &polygon, const TileId &tile, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel)
+GeoPolygonGraphicsItem::getTilesImpl(GeoSceneTextureTileDataset *tileDataset, const QPolygonF &polygon, const TileId &tile, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel)
 {
     QPainterPath subject;
     subject.addPolygon(polygon);
@@ -23,6 +23,7 @@ namespace Marble
 
 class GeoDataLinearRing;
 class GeoDataPolygon;
+class TileCoverageRasterizer;
 
 class MARBLE_EXPORT GeoPolygonGraphicsItem : public GeoGraphicsItem
 {
@@ -46,17 +47,33 @@ public:
     renderLabels( GeoPainter* painter, const ViewportParams *viewport, GeoDataStyle::ConstPtr style, GeoLabelPlaceHandler &placeHandler  ) override;
 
     
+    bool
+    opaqueFillColor( GeoDataStyle::ConstPtr style, QColor &color ) const override;
+
     void
-    getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel) override;
+    getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel) override;
 
 private:
     friend class GeoMultiPolygonGraphicsItem;
     friend class GeoGroundGraphicsItem;
     friend class GeoPointGraphicsItem;
+    friend class TileCoverageValidation;
+
+    static
+    void
+    getTilesImpl(GeoSceneTextureTileDataset *tileDataset, const QPolygonF &polygon, const TileId &tile, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel);
 
     static
     void
-    getTilesImpl(GeoSceneTextureTileDataset *tileDataset, const QPolygonF &polygon, const TileId &tile, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel);
+    rasterizeTiles(const TileCoverageRasterizer &rasterizer, const GeoDataPolygon &polygon, TileCoverage &tiles, std::atomic<bool> &aCancel);
+
+    static
+    QPolygonF
+    lonLatPolygon(const GeoDataLinearRing &ring);
+
+    static
+    bool
+    opaqueFillColorImpl(GeoDataStyle::ConstPtr style, QColor &color);
 
     static
     QVector<QPolygonF>
@@ -0,0 +1,279 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#include "TileCoverageValidation.h"
+#include "GeoLineStringGraphicsItem.h"
+#include "GeoPolygonGraphicsItem.h"
+
+#include "geodata/data/GeoDataLinearRing.h"
+#include "geodata/data/GeoDataPolygon.h"
+#include "geodata/scene/GeoSceneTextureTileDataset.h"
+
+#include "MarbleGlobal.h"
+#include "TileCoverage.h"
+#include "TileCoverageRasterizer.h"
+#include "TileId.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QtMath>
+
+namespace
+{
+
+// Lets consecutive longitudes differ by at most pi, like the rasterizer traces the segments.
+QPolygonF
+unwrapLineString(const QPolygonF &lineString)
+{
+    QPolygonF result = lineString;
+    for(int i = 1; i < result.size(); ++i)
+    {
+        double delta = lineString.at(i).x() - lineString.at(i - 1).x();
+        delta -= qRound(delta / (2 * M_PI)) * 2 * M_PI;
+        result[i].setX(result.at(i - 1).x() + delta);
+    }
+
+    return result;
+}
+
+// The copies of @p points shifted by whole turns which reach into [-pi, pi].
+QVector<QPolygonF>
+turnCopies(const QPolygonF &points)
+{
+    const QRectF bounds = points.boundingRect();
+
+    QVector<QPolygonF> result;
+    for(int turn = qFloor((bounds.left() + M_PI) / (2 * M_PI)); turn <= qFloor((bounds.right() + M_PI) / (2 * M_PI)); ++turn)
+    {
+        result.append(points.translated(-turn * 2 * M_PI, 0));
+    }
+
+    return result;
+}
+
+QPolygonF
+degrees(const QVector<QPointF> &points)
+{
+    QPolygonF result;
+    foreach(const QPointF &point, points)
+    {
+        result.append(point * Marble::DEG2RAD);
+    }
+
+    return result;
+}
+
+// Returns whether every tile kept by @p tiles is touched by @p otherTiles. Partially covered tiles at
+// @p borderLevel are also fine next to a tile @p otherTiles touches, unless @p borderLevel is -1.
+bool
+isTouchedBy(const Marble::TileCoverage &tiles, const Marble::TileCoverage &otherTiles, int borderLevel, int borderColumns)
+{
+    for(int level = 0; level <= tiles.maxLevel(); ++level)
+    {
+        foreach(quint64 code, tiles.mortonCodes(level))
+        {
+            int x, y;
+            Marble::TileCoverage::fromMortonCode(code, x, y);
+            if(otherTiles.touches(level, x, y))
+            {
+                continue;
+            }
+
+            Marble::TileStatus status;
+            if(level != borderLevel || !tiles.contains(level, x, y, status) || status != Marble::Partially)
+            {
+                return false;
+            }
+
+            bool nextToOther = false;
+            for(int dy = -1; dy <= 1 && !nextToOther; ++dy)
+            {
+                for(int dx = -1; dx <= 1 && !nextToOther; ++dx)
+                {
+                    const int neighbourX = (x + dx + borderColumns) % borderColumns;
+                    nextToOther = y + dy >= 0 && otherTiles.touches(level, neighbourX, y + dy);
+                }
+            }
+
+            if(!nextToOther)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool
+agree(const Marble::TileCoverage &rasterizedTiles, const Marble::TileCoverage &clippedTiles, const Marble::GeoSceneTextureTileDataset *tileDataset, int zoomLevel, bool exact)
+{
+    if(exact)
+    {
+        return rasterizedTiles == clippedTiles;
+    }
+
+    const int columns = tileDataset->levelZeroColumns() << zoomLevel;
+    return isTouchedBy(rasterizedTiles, clippedTiles, -1, columns) && isTouchedBy(clippedTiles, rasterizedTiles, zoomLevel, columns);
+}
+
+}
+
+namespace Marble
+{
+
+bool
+TileCoverageValidation::validate(GeoSceneTextureTileDataset *tileDataset, int zoomLevel)
+{
+    std::atomic<bool> cancel(false);
+    const TileCoverageRasterizer rasterizer(tileDataset, zoomLevel);
+    bool valid = true;
+
+    // Crosses the date line the short way, the clipping would take the long one.
+    const QPolygonF dateLineString = degrees(QVector<QPointF>() << QPointF(169.7, 10.3) << QPointF(-170.3, 21.1) << QPointF(-160.9, 20.2));
+    TileCoverage dateLineTiles;
+    rasterizer.addLineString(dateLineString, dateLineTiles, cancel);
+    if(!compareLineStrings(tileDataset, zoomLevel, QVector<QPolygonF>() << dateLineString, dateLineTiles, true, cancel))
+    {
+        qWarning() << "Tile coverage differs for a line string across the date line";
+        valid = false;
+    }
+
+    // The hole is large enough to hold full tiles from a few levels on.
+    const QPolygonF outerBoundary = degrees(QVector<QPointF>() << QPointF(10.3, 10.3) << QPointF(60.7, 10.3) << QPointF(60.7, 50.7) << QPointF(10.3, 50.7));
+    const QPolygonF innerBoundary = degrees(QVector<QPointF>() << QPointF(20.3, 20.3) << QPointF(20.3, 40.7) << QPointF(50.7, 40.7) << QPointF(50.7, 20.3));
+    TileCoverage holeTiles;
+    rasterizer.addPolygon(outerBoundary, QVector<QPolygonF>() << innerBoundary, holeTiles, cancel);
+    if(!comparePolygon(tileDataset, zoomLevel, outerBoundary, QVector<QPolygonF>() << innerBoundary, holeTiles, true, cancel))
+    {
+        qWarning() << "Tile coverage differs for a polygon with a hole";
+        valid = false;
+    }
+
+    // Winds around the south pole, so it can't be unwrapped and stays as it is.
+    const QPolygonF poleRing = degrees(QVector<QPointF>() << QPointF(-179.5, -70.3) << QPointF(-90.1, -69.7) << QPointF(0.3, -70.3) << QPointF(90.1, -69.7)
+                                                          << QPointF(179.5, -70.3) << QPointF(179.5, -90.0) << QPointF(-179.5, -90.0));
+    TileCoverage poleTiles;
+    rasterizer.addPolygon(poleRing, QVector<QPolygonF>(), poleTiles, cancel);
+    if(!comparePolygon(tileDataset, zoomLevel, poleRing, QVector<QPolygonF>(), poleTiles, true, cancel))
+    {
+        qWarning() << "Tile coverage differs for a ring around a pole";
+        valid = false;
+    }
+
+    // Passes through the centre of the map, where four tiles meet from level one on.
+    const QPolygonF borderLineString = degrees(QVector<QPointF>() << QPointF(-30.7, 20.3) << QPointF(0.0, 0.0) << QPointF(30.7, -20.3));
+    TileCoverage borderTiles;
+    rasterizer.addLineString(borderLineString, borderTiles, cancel);
+    if(!compareLineStrings(tileDataset, zoomLevel, QVector<QPolygonF>() << borderLineString, borderTiles, false, cancel))
+    {
+        qWarning() << "Tile coverage differs for a line string through a tile corner";
+        valid = false;
+    }
+
+    return valid;
+}
+
+bool
+TileCoverageValidation::compareLineStrings(GeoSceneTextureTileDataset *tileDataset, int zoomLevel, const QVector<QPolygonF> &lineStrings, const TileCoverage &rasterizedTiles, std::atomic<bool> &cancel)
+{
+    return compareLineStrings(tileDataset, zoomLevel, lineStrings, rasterizedTiles, false, cancel);
+}
+
+bool
+TileCoverageValidation::comparePolygon(GeoSceneTextureTileDataset *tileDataset, int zoomLevel, const GeoDataPolygon &polygon, const TileCoverage &rasterizedTiles, std::atomic<bool> &cancel)
+{
+    QVector<QPolygonF> innerBoundaries;
+    foreach(const GeoDataLinearRing &innerBoundary, polygon.innerBoundaries())
+    {
+        innerBoundaries.append(GeoPolygonGraphicsItem::lonLatPolygon(innerBoundary));
+    }
+
+    return comparePolygon(tileDataset, zoomLevel, GeoPolygonGraphicsItem::lonLatPolygon(polygon.outerBoundary()), innerBoundaries, rasterizedTiles, false, cancel);
+}
+
+bool
+TileCoverageValidation::compareLineStrings(GeoSceneTextureTileDataset *tileDataset, int zoomLevel, const QVector<QPolygonF> &lineStrings, const TileCoverage &rasterizedTiles, bool exact, std::atomic<bool> &cancel)
+{
+    QVector<QPolygonF> clippedLineStrings;
+    foreach(const QPolygonF &lineString, lineStrings)
+    {
+        clippedLineStrings += turnCopies(unwrapLineString(lineString));
+    }
+
+    TileCoverage clippedTiles;
+    GeoLineStringGraphicsItem::getTilesImpl(tileDataset, clippedLineStrings, TileId(0, 0, 0, 0), zoomLevel, &clippedTiles, cancel);
+
+    return cancel || agree(rasterizedTiles, clippedTiles, tileDataset, zoomLevel, exact);
+}
+
+bool
+TileCoverageValidation::comparePolygon(GeoSceneTextureTileDataset *tileDataset, int zoomLevel, const QPolygonF &outerBoundary, const QVector<QPolygonF> &innerBoundaries, const TileCoverage &rasterizedTiles, bool exact, std::atomic<bool> &cancel)
+{
+    if(outerBoundary.size() < 3)
+    {
+        return true;
+    }
+
+    const TileCoverageRasterizer rasterizer(tileDataset, zoomLevel);
+
+    // The clipping ignores holes, so it is compared against the outer boundary alone.
+    TileCoverage outerTiles;
+    rasterizer.addPolygon(outerBoundary, QVector<QPolygonF>(), outerTiles, cancel);
+
+    TileCoverage clippedTiles;
+    foreach(const QPolygonF &polygon, turnCopies(TileCoverageRasterizer::unwrapRing(outerBoundary)))
+    {
+        GeoPolygonGraphicsItem::getTilesImpl(tileDataset, polygon, TileId(0, 0, 0, 0), zoomLevel, clippedTiles, cancel);
+    }
+
+    if(cancel)
+    {
+        return true;
+    }
+
+    if(!agree(outerTiles, clippedTiles, tileDataset, zoomLevel, exact))
+    {
+        return false;
+    }
+
+    // Holes only take tiles away, and none of the tiles lying completely within one.
+    if(!isTouchedBy(rasterizedTiles, outerTiles, -1, 1))
+    {
+        return false;
+    }
+
+    foreach(const QPolygonF &innerBoundary, innerBoundaries)
+    {
+        if(innerBoundary.size() < 3)
+        {
+            continue;
+        }
+
+        TileCoverage holeTiles;
+        rasterizer.addPolygon(innerBoundary, QVector<QPolygonF>(), holeTiles, cancel);
+
+        for(int level = 0; level <= holeTiles.maxLevel(); ++level)
+        {
+            foreach(quint64 code, holeTiles.mortonCodes(level))
+            {
+                int x, y;
+                TileCoverage::fromMortonCode(code, x, y);
+
+                TileStatus status;
+                if(holeTiles.contains(level, x, y, status) && status == Full && rasterizedTiles.touches(level, x, y))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,70 @@
+//
+// This file is part of the Marble Virtual Globe.
+//
+// This program is free software licensed under the GNU LGPL. You can
+// find a copy of this license in LICENSE.txt in the top directory of
+// the source code.
+//
+
+#ifndef MARBLE_TILECOVERAGEVALIDATION_H
+#define MARBLE_TILECOVERAGEVALIDATION_H
+
+#include <QtCore/QVector>
+#include <QtGui/QPolygonF>
+
+#include <atomic>
+
+namespace Marble
+{
+
+class GeoDataPolygon;
+class GeoSceneTextureTileDataset;
+class TileCoverage;
+
+/**
+ * Checks the rasterized tile coverage of line strings and polygons against
+ * the coverage the recursive clipping finds.
+ *
+ * The rasterizer deliberately differs from the clipping in three ways, which
+ * the comparisons allow for: segments take the short way across the date
+ * line, so the clipping is fed the geometry unwrapped and shifted by whole
+ * turns; holes are left out of polygon coverage, which the clipping ignores,
+ * so only the outer ring is compared and the holes are checked on their own;
+ * geometry on a tile border counts for one side only, so partially covered
+ * tiles next to a rasterized one may be missing.
+ *
+ * All coordinates are longitude/latitude pairs in radian.
+ */
+class TileCoverageValidation
+{
+public:
+    /**
+     * Runs both producers on fixed geometries: a line across the date line,
+     * a polygon with a hole, a ring winding around a pole and a line through
+     * a tile corner. Warns about and returns false on any difference.
+     */
+    static
+    bool
+    validate(GeoSceneTextureTileDataset *tileDataset, int zoomLevel);
+
+    static
+    bool
+    compareLineStrings(GeoSceneTextureTileDataset *tileDataset, int zoomLevel, const QVector<QPolygonF> &lineStrings, const TileCoverage &rasterizedTiles, std::atomic<bool> &cancel);
+
+    static
+    bool
+    comparePolygon(GeoSceneTextureTileDataset *tileDataset, int zoomLevel, const GeoDataPolygon &polygon, const TileCoverage &rasterizedTiles, std::atomic<bool> &cancel);
+
+private:
+    static
+    bool
+    compareLineStrings(GeoSceneTextureTileDataset *tileDataset, int zoomLevel, const QVector<QPolygonF> &lineStrings, const TileCoverage &rasterizedTiles, bool exact, std::atomic<bool> &cancel);
+
+    static
+    bool
+    comparePolygon(GeoSceneTextureTileDataset *tileDataset, int zoomLevel, const QPolygonF &outerBoundary, const QVector<QPolygonF> &innerBoundaries, const TileCoverage &rasterizedTiles, bool exact, std::atomic<bool> &cancel);
+};
+
+}
+
+#endif // MARBLE_TILECOVERAGEVALIDATION_H
@@ -14,8 +14,10 @@
 
 // Marble
 #include "marble_export.h"
+#include "TileCoverage.h"
 #include "TileId.h"
 #include "geodata/data/GeoDataStyle.h"
+#include <QtGui/QColor>
 #include <atomic>
 
 class QString;
@@ -32,14 +34,6 @@ class GeoGraphicsItem;
 
 typedef QSharedPointer<Marble::GeoGraphicsItem> GeoGraphicsItemPtr;
 
-enum TileStatus
-{
-    Full,
-    Partially,
-};
-
-typedef QMap<int /* zoom level */, QMap<int /* x */, QMap<int /* y */, TileStatus> > >  TileMap;
-
 
 class MARBLE_EXPORT GeoGraphicsItem
 {
@@ -124,6 +118,19 @@ class MARBLE_EXPORT GeoGraphicsItem
     void
     renderGeometry( GeoPainter* painter, const ViewportParams *viewport, GeoDataStyle::ConstPtr style ) = 0;
 
+    /**
+     * Renders the geometry into the geometry tile @p tileId, which covers the
+     * whole @p viewport. Items keeping per tile data can use it instead of
+     * processing their complete geometry.
+     */
+    virtual
+    void
+    renderTileGeometry( GeoPainter* painter, const ViewportParams *viewport, GeoDataStyle::ConstPtr style, const TileId &tileId )
+    {
+        Q_UNUSED( tileId )
+        renderGeometry( painter, viewport, style );
+    }
+
     virtual
     void
     renderIcons( GeoPainter* painter, const ViewportParams *viewport, GeoDataStyle::ConstPtr style ) = 0;
@@ -132,11 +139,37 @@ class MARBLE_EXPORT GeoGraphicsItem
     void
     renderLabels( GeoPainter* painter, const ViewportParams *viewport, GeoDataStyle::ConstPtr style, GeoLabelPlaceHandler &placeHandler ) = 0;
 
+    /**
+     * Returns whether the item paints all of its interior with the single
+     * opaque @p color under @p style. Tiles the item covers completely are
+     * then filled with that color instead of rendering the geometry.
+     */
+    virtual
+    bool
+    opaqueFillColor( GeoDataStyle::ConstPtr style, QColor &color ) const
+    {
+        Q_UNUSED( style )
+        Q_UNUSED( color )
+        return false;
+    }
+
     virtual
     void
-    getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileMap &tiles, std::atomic<bool> &aCancel)
+    getTiles(GeoSceneTextureTileDataset *tileDataset, const TileId &tile, int zoomLevel, TileCoverage &tiles, std::atomic<bool> &aCancel)
     {}
 
+    /**
+     * Tells the item the tile layout it is rendered in, down to @p zoomLevel.
+     * Items preparing data per tile do so once they are first rendered.
+     */
+    virtual
+    void
+    setTileLayout(const GeoSceneTextureTileDataset *tileDataset, int zoomLevel)
+    {
+        Q_UNUSED( tileDataset )
+        Q_UNUSED( zoomLevel )
+    }
+
  protected:
     GeoGraphicsItemPrivate *const d;
 };
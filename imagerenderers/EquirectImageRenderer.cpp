@@ -93,6 +93,10 @@ EquirectImageRenderer::renderImage(GeoPainter *painter)
     m_threadPool.waitForDone();
 
     imageRect = imageRect.intersected( m_dirtyRect );
+    if ( m_viewport->isCancelled() ) {
+        return;
+    }
+
     painter->drawImage( imageRect, m_canvasImage, imageRect );
 }
 
@@ -141,6 +145,9 @@ void EquirectImageRenderer::RenderJob::run()
     // Scanline based algorithm to do texture mapping
 
     for ( int y = m_yTop; y < m_yBottom; ++y ) {
+        if ( m_viewport->isCancelled() ) {
+            return;
+        }
 
         QRgb * scanLine = (QRgb*)( m_canvasImage->scanLine( y ) );
 
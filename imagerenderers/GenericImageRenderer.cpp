@@ -94,6 +94,10 @@ GenericImageRenderer::renderImage(GeoPainter *painter)
     m_threadPool.waitForDone();
 
     imageRect = imageRect.intersected( m_dirtyRect );
+    if ( m_viewport->isCancelled() ) {
+        return;
+    }
+
     painter->drawImage( imageRect, m_canvasImage, imageRect );
 }
 
@@ -126,6 +130,9 @@ void GenericImageRenderer::RenderJob::run()
 
     // Paint the map.
     for ( int y = m_yTop; y < m_yBottom; ++y ) {
+        if ( m_viewport->isCancelled() ) {
+            return;
+        }
 
         // rx is the radius component in x direction
         const int rx = (int)sqrt( (qreal)( clipRadius * clipRadius
@@ -96,6 +96,10 @@ MercatorImageRenderer::renderImage(GeoPainter *painter)
     RenderJob job( &m_image, &m_canvasImage, m_viewport, painter->mapQuality(), yStart, yEnd, m_overlayLatLonBox , imageRect);
     job.run();
 
+    if ( m_viewport->isCancelled() ) {
+        return;
+    }
+
     painter->drawImage( m_dirtyRect, m_canvasImage, m_dirtyRect );
 }
 
@@ -143,6 +147,10 @@ void MercatorImageRenderer::RenderJob::run()
     while ( leftLon >  M_PI ) leftLon -= 2 * M_PI;
 
     for ( int y = m_yPaintedTop; y < m_yPaintedBottom; ++y ) {
+        // Checked per scanline, a cancelled render throws the canvas away anyway.
+        if ( m_viewport->isCancelled() ) {
+            return;
+        }
 
         QRgb * scanLine = (QRgb*)( m_canvasImage->scanLine( y ) );
         scanLine += xLeft;
@@ -90,6 +90,10 @@ SphericalImageRenderer::renderImage(GeoPainter *painter)
     m_threadPool.waitForDone();
 
     imageRect = imageRect.intersected( m_dirtyRect );
+    if ( m_viewport->isCancelled() ) {
+        return;
+    }
+
     painter->drawImage( imageRect, m_canvasImage, imageRect );
 }
 
@@ -127,6 +131,9 @@ void SphericalImageRenderer::RenderJob::run()
 
     // Scanline based algorithm to texture map a sphere
     for ( int y = m_yTop; y < m_yBottom; ++y ) {
+        if ( m_viewport->isCancelled() ) {
+            return;
+        }
 
         // Evaluate coordinates for the 3D position vector of the current pixel
         const qreal qy = inverseRadius * (qreal)( canvasHeight / 2 - y );
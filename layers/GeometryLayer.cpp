@@ -48,6 +48,7 @@
 #include "VectorTileLoader.h"
 #include "graphicsview/GeoGraphicsItem.h"
 #include "TileId.h"
+#include "TileInvalidationQueue.h"
 #include "graphicsview/MarbleGraphicsItem.h"
 #include "MarblePlacemarkModel.h"
 #include "GeoDataTreeModel.h"
@@ -75,6 +76,13 @@ const double EPSILON = 0.001;
 const double PIXEL_EPSILON = 3;
 const double MAX_SQR_DIFF_FOR_HIGHER_Z_LEVEL = 4.0;
 
+// Hover queries collect the items within this many eps of the cursor, so later moves can be tested against them.
+const double HOVER_MARGIN_FACTOR = 3.0;
+// Cached candidates are tested again as long as they cover this many eps around the cursor.
+const double HOVER_CUTOFF_FACTOR = 1.5;
+// With more hits under the cursor the cached result is not reused without testing them again.
+const int MAX_HOVER_HITS = 64;
+
 QPointF
 getPointRadian(const Marble::GeoDataCoordinates &coord)
 {
@@ -85,6 +93,184 @@ getPointRadian(const Marble::GeoDataCoordinates &coord)
     return QPointF(lon, lat);
 }
 
+double
+radianDistance(const Marble::GeoDataCoordinates &a, const Marble::GeoDataCoordinates &b)
+{
+    const QPointF delta = getPointRadian(a) - getPointRadian(b);
+
+    return qSqrt(delta.x() * delta.x() + delta.y() * delta.y());
+}
+
+Marble::GeoDataLatLonBox
+hoverBox(const Marble::GeoDataCoordinates &center, double margin)
+{
+    if(margin >= M_PI)
+    {
+        return Marble::GeoDataLatLonBox(M_PI / 2, -M_PI / 2, M_PI, -M_PI);
+    }
+
+    const double lon = center.longitude(Marble::GeoDataCoordinates::Radian);
+    const double lat = center.latitude(Marble::GeoDataCoordinates::Radian);
+
+    return Marble::GeoDataLatLonBox(qMin(lat + margin, M_PI / 2),
+                                    qMax(lat - margin, -M_PI / 2),
+                                    Marble::GeoDataCoordinates::normalizeLon(lon + margin),
+                                    Marble::GeoDataCoordinates::normalizeLon(lon - margin));
+}
+
+/*
+ * Returns how far the cursor may move before the hover result can change. A hit stops being one
+ * when it moves out of eps, another item wins when the order of the distances or their ratio
+ * against the higher z level threshold flips. Distances change no faster than the cursor moves:
+ * segments are measured exactly, polygons take the distance to their rings outside and a constant
+ * below eps inside, and anything not measured lies beyond the cutoff.
+ *
+ * @p distancesSqr holds the squared distances of the candidates measured with @p cutoff, items not
+ * measured are at least that far away.
+ */
+double
+hoverRadius(const QVector<double> &distancesSqr, double eps, double cutoff)
+{
+    // nodes are only measured within a manhattan distance of the cutoff
+    const double unseen = cutoff / M_SQRT2;
+    const double ratio = qSqrt(MAX_SQR_DIFF_FOR_HIGHER_Z_LEVEL);
+
+    double radius = unseen - eps;
+    QVector<double> hits;
+
+    foreach(double distanceSqr, distancesSqr)
+    {
+        const double distance = qSqrt(distanceSqr);
+        if(distance > eps)
+        {
+            radius = qMin(radius, qMin(distance, unseen) - eps);
+        }
+        else
+        {
+            radius = qMin(radius, eps - distance);
+            hits.append(distance);
+        }
+    }
+
+    if(hits.size() > MAX_HOVER_HITS)
+    {
+        return 0.0;
+    }
+
+    for(int i = 0; i < hits.size(); ++i)
+    {
+        for(int j = i + 1; j < hits.size(); ++j)
+        {
+            const double a = hits[i];
+            const double b = hits[j];
+
+            radius = qMin(radius, qAbs(a - b) / 2);
+            radius = qMin(radius, qAbs(a - ratio * b) / (1 + ratio));
+            radius = qMin(radius, qAbs(b - ratio * a) / (1 + ratio));
+        }
+    }
+
+    return qMax(radius, 0.0);
+}
+
+// The last hover result, along with the candidates around it and how far the cursor may move while it stays valid.
+struct HoverCache
+{
+    HoverCache()
+        :   viewport(nullptr),
+            viewportRadius(0),
+            projection(Marble::Spherical),
+            centerLon(0.0),
+            centerLat(0.0),
+            margin(0.0),
+            eps(0.0),
+            radius(0.0),
+            feature(nullptr)
+    {
+    }
+
+    void
+    clear()
+    {
+        viewport = nullptr;
+        candidates.clear();
+        feature = nullptr;
+    }
+
+    bool
+    matches(const Marble::ViewportParams *other) const
+    {
+        return viewport == other &&
+               viewportRadius == other->radius() &&
+               projection == other->projection() &&
+               centerLon == other->centerLongitude() &&
+               centerLat == other->centerLatitude() &&
+               size == other->size();
+    }
+
+    void
+    setViewport(const Marble::ViewportParams *other)
+    {
+        viewport = other;
+        viewportRadius = other->radius();
+        projection = other->projection();
+        centerLon = other->centerLongitude();
+        centerLat = other->centerLatitude();
+        size = other->size();
+    }
+
+    const Marble::ViewportParams *viewport;
+    int viewportRadius;
+    Marble::Projection projection;
+    qreal centerLon;
+    qreal centerLat;
+    QSize size;
+
+    // all items whose bounding box comes within margin of center
+    QList<Marble::GeoGraphicsItemPtr> candidates;
+    Marble::GeoDataCoordinates center;
+    double margin;
+
+    Marble::GeoDataCoordinates point;
+    double eps;
+    double radius;
+    const Marble::GeoDataFeature *feature;
+};
+
+double
+sqrDistanceToNode(const Marble::GeoDataLineString &lineString, int i, const QPointF &pos, double eps)
+{
+    double lon;
+    double lat;
+    lineString.getLonLat(i, lon, lat, Marble::GeoDataCoordinates::Radian);
+    const QPointF v(lon, lat);
+
+    /* Just a quick check if it is wurth doing the calc */
+    if(QPointF(v-pos).manhattanLength() < eps)
+    {
+        return GeometryHelper::sqr( v.x()-pos.x() ) + GeometryHelper::sqr( v.y()-pos.y() );
+    }
+
+    return 1.0e10;
+}
+
+// The exact distance to the segment, it changes no faster than the position moves.
+double
+sqrDistanceToSegment(const QPointF &v1, const QPointF &v2, const QPointF &pos)
+{
+    const QPointF direction = v2 - v1;
+    const double lengthSqr = QPointF::dotProduct(direction, direction);
+
+    double t = 0.0;
+    if(lengthSqr > 0.0)
+    {
+        t = qBound(0.0, QPointF::dotProduct(pos - v1, direction) / lengthSqr, 1.0);
+    }
+
+    const QPointF delta = v1 + t * direction - pos;
+    return QPointF::dotProduct(delta, delta);
+}
+
 double
 distanceToLineSqr(const QVector<Marble::GeoDataLineString> &lineStrings, const Marble::GeoDataCoordinates &coordinate, double eps)
 {
@@ -94,42 +280,24 @@ distanceToLineSqr(const QVector<Marble::GeoDataLineString> &lineStrings, const M
     QPointF pos = getPointRadian(coordinate);
     double prevPointDistance = 1.0e10;
 
+    // Segments not reaching into the box are at least eps away.
+    const QRectF box(pos.x() - eps, pos.y() - eps, 2 * eps, 2 * eps);
+
     foreach(const Marble::GeoDataLineString &lineString, lineStrings)
     {
-        int size = lineString.size();
-
-        for(int i = 0; i < size; ++i)
+        if(lineString.size() == 1)
         {
-            QPointF v2 = getPointRadian(lineString.at(i));
-
-            /* Just a quick check if it is wurth doing the calc */
-            if(QPointF(v2-pos).manhattanLength() < eps)
-            {
-                double pointDistance = GeometryHelper::sqr( v2.x()-pos.x() ) + GeometryHelper::sqr( v2.y()-pos.y() );
-                prevPointDistance = qMin(prevPointDistance, pointDistance);
-
-                qDebug() << "distanceToLine" << pointDistance << v2.x() << v2.y() << pos.x() << pos.y() << (v2-pos);
-            }
-
-
-            if(i != 0)
-            {
-                QPointF v1 = getPointRadian(lineString.at(i-1));
+            prevPointDistance = qMin(prevPointDistance, sqrDistanceToNode(lineString, 0, pos, eps));
+            continue;
+        }
 
-                if (!( (v1.x() <= pos.x() && pos.x() <= v2.x()) || (v2.x() <= pos.x() && pos.x() <= v1.x()) ))
-                {
-                  // test point not in x-range
-                  continue;
-                }
-                if (!( (v1.y() <= pos.y() && pos.y() <= v2.y()) || (v2.y() <= pos.y() && pos.y() <= v1.y()) ))
-                {
-                  // test point not in y-range
-                    continue;
-                }
+        foreach(int segment, lineString.segmentsIntersecting(box))
+        {
+            double lon1, lat1, lon2, lat2;
+            lineString.getLonLat(segment, lon1, lat1, Marble::GeoDataCoordinates::Radian);
+            lineString.getLonLat(segment + 1, lon2, lat2, Marble::GeoDataCoordinates::Radian);
 
-                double prodToLine = GeometryHelper::perpDotProduct(v1, v2, pos);
-                prevPointDistance = qMin(prodToLine, prevPointDistance);
-            }
+            prevPointDistance = qMin(prevPointDistance, sqrDistanceToSegment(QPointF(lon1, lat1), QPointF(lon2, lat2), pos));
         }
     }
 
@@ -245,11 +413,11 @@ sqrDistanceToPlacemark(Marble::GeoDataPlacemark *placemark, const Marble::GeoDat
 class FindFeatureRunnable : public QRunnable
 {
 public:
-    FindFeatureRunnable( QList< Marble::GeoGraphicsItemPtr > items, Marble::GeoDataCoordinates clickedPoint, double epsSqr, double eps)
+    FindFeatureRunnable( QList< Marble::GeoGraphicsItemPtr > items, Marble::GeoDataCoordinates clickedPoint, double epsSqr, double cutoff)
         :   aItems(std::move(items)),
             aClickedPoint(std::move(clickedPoint)),
             aEpsSqr(epsSqr),
-            aEps(eps),
+            aCutoff(cutoff),
             aFeature(nullptr),
             aPrevDistSqr(1.0e10)
     {
@@ -272,11 +440,19 @@ public:
         return aPrevDistSqr;
     }
 
+    /// The squared distances of all items within the cutoff.
+    const QVector<double> &
+    distancesSqr() const
+    {
+        return aDistancesSqr;
+    }
+
 private:
     QList< Marble::GeoGraphicsItemPtr > aItems;
     Marble::GeoDataCoordinates aClickedPoint;
     double aEpsSqr;
-    double aEps;
+    double aCutoff;
+    QVector<double> aDistancesSqr;
 
     const Marble::GeoDataFeature* aFeature;
     double aPrevDistSqr;
@@ -299,9 +475,14 @@ void FindFeatureRunnable::run()
             }
 
             Marble::GeoDataPlacemark *placemark = const_cast<Marble::GeoDataPlacemark*>(static_cast<const Marble::GeoDataPlacemark*>( item->feature()));
-            double tempDistSqr = sqrDistanceToPlacemark(placemark, aClickedPoint, aEps, aEpsSqr);
+            double tempDistSqr = sqrDistanceToPlacemark(placemark, aClickedPoint, aCutoff, aEpsSqr);
             qDebug() << "distanceToPlacemark" << tempDistSqr << placemark->name() << placemark->description();
 
+            if(tempDistSqr <= aCutoff * aCutoff)
+            {
+                aDistancesSqr.append(tempDistSqr);
+            }
+
             if ( tempDistSqr <= aEpsSqr &&
                  (tempDistSqr < aPrevDistSqr || (aFeature &&
                                                       (placemark->zLevel() > aFeature->zLevel()) &&
@@ -334,6 +515,7 @@ public:
 
     void createGraphicsItems( const GeoDataFeature *feature);
     bool removeGraphicsItems( const GeoDataFeature *feature );
+    bool removeGraphicsItems( const QVector<const GeoDataFeature*> &features );
     void requestDelayedRepaint();
     void reqeustStartGenerateNextLevel(const TileId &tileId);
     int getTileLevel(double radius);
@@ -341,13 +523,17 @@ public:
     QList<TileId>
     getTiles(int tileLevel, const GeoDataLatLonBox &latLongBox);
 
+    bool
+    pickFeature(const GeoDataCoordinates &clickedPoint, double eps, double epsSqr, const GeoDataFeature *&feature) const;
+
+    const GeoDataFeature *
+    findFeature(const QList<GeoGraphicsItemPtr> &items, const GeoDataCoordinates &clickedPoint, double epsSqr, double cutoff, QVector<double> &distancesSqr) const;
+
     const QAbstractItemModel *const m_model;
     GeoGraphicsScene m_scene;
     QString m_runtimeTrace;
 
-    const GeoDataFeature *m_previousFeature;
-    GeoDataCoordinates m_previousFeatureCoorinate;
-    const ViewportParams *m_previousViewport;
+    HoverCache m_hoverCache;
 
     mutable QThreadPool m_threadPool;
     mutable GeoLabelPlaceHandler placeHandler;
@@ -368,16 +554,17 @@ public:
     QTimer m_generateNextLevelTimer;
     QSet<TileId> m_generateNextLevelTiles;
 
+    TileInvalidationQueue m_invalidationQueue;
+
 };
 
 const int GEOMETRY_REPAINT_SCHEDULING_INTERVAL = 10;
+const int GEOMETRY_DEFAULT_TILE_SIZE = 2048;
 const int GEOMETRY_GENERATE_NEXT_LEVELT_SCHEDULING_INTERVAL = 100;
 
 GeometryLayerPrivate::GeometryLayerPrivate( const QAbstractItemModel *model,
                                             const SunLocator *sunLocator )
     : m_model( model ),
-      m_previousFeature(nullptr),
-      m_previousViewport(nullptr),
       m_centerCoordinates(),
       m_tileZoomLevel( -1 ),
       m_loader(&m_scene),
@@ -387,12 +574,15 @@ GeometryLayerPrivate::GeometryLayerPrivate( const QAbstractItemModel *model,
 {
     m_tileDataset = new GeoSceneTextureTileDataset(QStringLiteral("Geometry"));
     m_tileDataset->setProjection(GeoSceneTileDataset::Mercator);
-    m_tileDataset->setTileSize(QSize(2048, 2048));
+    m_tileDataset->setTileSize(QSize(GEOMETRY_DEFAULT_TILE_SIZE, GEOMETRY_DEFAULT_TILE_SIZE));
     m_tileDataset->setLevelZeroColumns(1);
     m_tileDataset->setLevelZeroRows(1);
 
     m_layerDecorator.setTextureLayers( QVector<const GeoSceneTextureTileDataset *>() << m_tileDataset );
     m_scene.setTextureLayer(m_tileDataset);
+
+    // Displayed tiles are scaled by up to a factor of two, so the pick radius covers twice the screen epsilon.
+    m_loader.setPickBufferRadius(qCeil(2 * PIXEL_EPSILON));
 }
 
 GeometryLayerPrivate::~GeometryLayerPrivate()
@@ -401,6 +591,116 @@ GeometryLayerPrivate::~GeometryLayerPrivate()
 }
 
 
+bool GeometryLayerPrivate::pickFeature(const GeoDataCoordinates &clickedPoint, double eps, double epsSqr, const GeoDataFeature *&feature) const
+{
+    if(m_tileZoomLevel < 0)
+    {
+        return false;
+    }
+
+    const TileId tileId = TileId::fromCoordinates(m_tileDataset, clickedPoint, m_tileZoomLevel);
+    const PickBuffer pickBuffer = m_loader.pickBuffer(tileId);
+
+    // Changes still collected by the invalidation queue haven't expired the tile yet.
+    if(pickBuffer.sceneVersion() < m_scene.version() && m_invalidationQueue.touches(tileId))
+    {
+        return false;
+    }
+
+    const QPointF pixel = PickBuffer::tilePixel(m_tileDataset, tileId, clickedPoint.longitude(GeoDataCoordinates::Radian), clickedPoint.latitude(GeoDataCoordinates::Radian));
+
+    QList<GeoGraphicsItemPtr> items;
+    switch(pickBuffer.pick(pixel, m_loader.pickBufferRadius(), items))
+    {
+    case PickBuffer::Nothing:
+        feature = nullptr;
+        return true;
+
+    case PickBuffer::Item:
+    {
+        // The buffer only narrows down the candidates, the nearest one is chosen like in the full query.
+        QVector<double> distancesSqr;
+        feature = findFeature(items, clickedPoint, epsSqr, eps, distancesSqr);
+
+        // Items covered by others all around are missing from the buffer, the full query may still find one.
+        return feature != nullptr;
+    }
+
+    case PickBuffer::Unknown:
+        break;
+    }
+
+    return false;
+}
+
+const GeoDataFeature *
+GeometryLayerPrivate::findFeature(const QList<GeoGraphicsItemPtr> &items, const GeoDataCoordinates &clickedPoint, double epsSqr, double cutoff, QVector<double> &distancesSqr) const
+{
+    distancesSqr.clear();
+
+    if(items.isEmpty())
+    {
+        return nullptr;
+    }
+
+    // a few candidates are not worth waking up the pool
+    const int numThreads = items.size() < MAX_HOVER_HITS ? 1 : qMax(m_threadPool.maxThreadCount(), 2);
+    const int yStep = qCeil(static_cast<double>(items.size()) / numThreads);
+    QList<FindFeatureRunnable *> jobs;
+    qDebug() << "whichFeatureAt starting job" << yStep << numThreads;
+
+    for ( int i = 0; i < numThreads; ++i )
+    {
+        QList< GeoGraphicsItemPtr > tempItems = items.mid(i*yStep, i == numThreads -1 ? -1 : yStep);
+        if(tempItems.size() == 0)
+        {
+            continue;
+        }
+
+        FindFeatureRunnable *job = new FindFeatureRunnable( tempItems, clickedPoint, epsSqr, cutoff );
+
+        qDebug() << "whichFeatureAt starting job" << tempItems.size();
+
+        job->setAutoDelete(false);
+        jobs.append(job);
+
+        if(numThreads == 1)
+        {
+            job->run();
+        }
+        else
+        {
+            m_threadPool.start( job );
+        }
+    }
+
+    m_threadPool.waitForDone();
+
+    const GeoDataFeature* feature = 0;
+    double prevDistSqr = 1.0e10;
+    foreach(auto job, jobs)
+    {
+        double tempDistSqr = job->prevDistSqr();
+        const Marble::GeoDataFeature* tempFeature = job->feature();
+        if ( tempFeature &&
+             tempDistSqr < epsSqr &&
+             (tempDistSqr < prevDistSqr || (feature &&
+                                                  (tempFeature->zLevel() > feature->zLevel()) &&
+                                                  (qFuzzyCompare(tempDistSqr, prevDistSqr) ||
+                                                   (!qFuzzyIsNull(tempDistSqr) && !qFuzzyIsNull(prevDistSqr) && tempDistSqr/prevDistSqr < MAX_SQR_DIFF_FOR_HIGHER_Z_LEVEL)))))
+        {
+            prevDistSqr = tempDistSqr;
+            feature = tempFeature;
+        }
+
+        distancesSqr += job->distancesSqr();
+
+        delete job;
+    }
+
+    return feature;
+}
+
 void GeometryLayerPrivate::createGraphicsItems(const GeoDataFeature *feature )
 {
     m_scene.createGraphicsItems(feature);
@@ -413,6 +713,16 @@ bool GeometryLayerPrivate::removeGraphicsItems( const GeoDataFeature *feature )
     return m_scene.removeGraphicsItems(feature);
 }
 
+bool GeometryLayerPrivate::removeGraphicsItems( const QVector<const GeoDataFeature*> &features )
+{
+    foreach( const GeoDataFeature *feature, features )
+    {
+        placeHandler.removeItem( feature );
+    }
+
+    return m_scene.removeGraphicsItems(features);
+}
+
 void GeometryLayerPrivate::requestDelayedRepaint()
 {
     if ( m_texmapper )
@@ -535,10 +845,14 @@ GeometryLayer::GeometryLayer( const QAbstractItemModel *model,
              &d->m_scene, SLOT(applySelected(QVector<GeoDataFeature*>)) );
     connect( &d->m_scene, SIGNAL(repaintNeeded()),
              this, SIGNAL(repaintNeeded()) );
-    connect( &d->m_scene, SIGNAL(updatedTiles(const TileMap &)),
-             this, SLOT(updateTileStatus(const TileMap &)) );
-    connect( &d->m_loader, SIGNAL(tileCompleted(TileId,QImage)),
-             this, SLOT(updateTile(TileId,QImage)) );
+    connect( &d->m_scene, SIGNAL(updatedTiles(const LayeredTileCoverage &)),
+             &d->m_invalidationQueue, SLOT(add(const LayeredTileCoverage &)) );
+    connect( &d->m_scene, SIGNAL(updatedTiles(const LayeredTileCoverage &)),
+             this, SLOT(clearHoverCache()) );
+    connect( &d->m_invalidationQueue, SIGNAL(expired(const LayeredTileCoverage &)),
+             this, SLOT(updateTileStatus(const LayeredTileCoverage &)) );
+    connect( &d->m_loader, SIGNAL(sparseTileCompleted(TileId,SparseTileImage)),
+             this, SLOT(updateTile(TileId,SparseTileImage)) );
 
     // Repaint timer
     d->m_repaintTimer.setSingleShot( true );
@@ -601,6 +915,10 @@ bool GeometryLayer::render( GeoPainter *painter, ViewportParams *viewport,
     d->m_latLonBox = viewport->viewLatLonAltBox();
     d->m_radius = viewport->radius();
 
+    // tiles of the displayed level are shown at no less than half their size
+    const int visibleTiles = qCeil( qMax( viewport->width(), viewport->height() ) * 2.0 / d->m_tileDataset->tileSize().width() ) + 1;
+    d->m_loader.setViewport( d->m_tileDataset, viewport->centerLongitude(), viewport->centerLatitude(), d->m_tileZoomLevel, visibleTiles );
+
     d->m_loader.resetTilehash();
     
     MapQuality originalMapQuality = painter->mapQuality();
@@ -613,7 +931,7 @@ bool GeometryLayer::render( GeoPainter *painter, ViewportParams *viewport,
 
     d->m_loader.cleanupTilehash();
 
-    d->m_runtimeTrace = QStringLiteral("Texture Cache: %1 ").arg(d->m_tileLoader.tileCount());
+    d->m_runtimeTrace = QStringLiteral("Texture Cache: %1 First Pixel: %2 ms ").arg(d->m_tileLoader.tileCount()).arg(d->m_loader.timeToFirstPixel());
 
     painter->save();
 
@@ -704,7 +1022,7 @@ void GeometryLayer::addPlacemarks( QModelIndex parent, int first, int last )
 void GeometryLayer::removePlacemarks( QModelIndex parent, int first, int last )
 {
     Q_ASSERT( last < d->m_model->rowCount( parent ) );
-    bool isRepaintNeeded = false;
+    QVector<const GeoDataFeature*> features;
     for( int i=first; i<=last; ++i )
     {
         QModelIndex index = d->m_model->index( i, 0, parent );
@@ -713,26 +1031,45 @@ void GeometryLayer::removePlacemarks( QModelIndex parent, int first, int last )
         const GeoDataFeature *feature = dynamic_cast<const GeoDataFeature*>( object );
         if( feature != nullptr )
         {
-           isRepaintNeeded = d->removeGraphicsItems( feature );
+           features.append( feature );
         }
     }
 
+    // All rows are expired in one go instead of once per feature.
+    bool isRepaintNeeded = d->removeGraphicsItems( features );
+
     if( isRepaintNeeded )
     {
-        d->m_previousFeature = nullptr;
-        d->m_previousFeatureCoorinate = GeoDataCoordinates();
-        d->m_previousViewport = nullptr;
+        d->m_hoverCache.clear();
 
         d->requestDelayedRepaint();
     }
 
 }
 
+QSize GeometryLayer::tileSize() const
+{
+    return d->m_tileDataset->tileSize();
+}
+
+void GeometryLayer::setTileSize(const QSize &size)
+{
+    if ( size.isEmpty() || size == d->m_tileDataset->tileSize() )
+        return;
+
+    d->m_tileDataset->setTileSize(size);
+
+    // The coverage cache keeps a file per tile layout, the deeper levels of smaller tiles go to another one.
+    d->m_scene.setTextureLayer(d->m_tileDataset);
+
+    // The scene tracks the item coverage deeper for smaller tiles, so the items have to be added again.
+    resetCacheData();
+}
+
 void GeometryLayer::resetCacheData()
 {
-    d->m_previousFeature = nullptr;
-    d->m_previousFeatureCoorinate = GeoDataCoordinates();
-    d->m_previousViewport = nullptr;
+    d->m_hoverCache.clear();
+    d->m_invalidationQueue.clear();
     d->m_tileLoader.clear();
     d->m_loader.clear();
 
@@ -771,13 +1108,6 @@ GeometryLayer::whichFeatureAt(const QPoint& curpos , const ViewportParams *viewp
 const GeoDataFeature*
 GeometryLayer::getFeature(const GeoDataCoordinates &clickedPoint, const ViewportParams *viewport)
 {
-    if(d->m_previousFeatureCoorinate.isValid() &&
-            d->m_previousViewport == viewport &&
-            clickedPoint == d->m_previousFeatureCoorinate)
-    {
-        return d->m_previousFeature;
-    }
-
     qreal y( 0.0 );
     QVector<double> x;
     bool globeHidesPoint;
@@ -860,63 +1190,67 @@ GeometryLayer::getFeature(const GeoDataCoordinates &clickedPoint, const Viewport
 
     double epsSqr = eps*eps;
 
-    QList< GeoGraphicsItemPtr > items = d->m_scene.items(box);
-
-    qWarning() << "whichFeatureAt elapsed getting items" << timer.nsecsElapsed() << items.size();
-
-    if(items.isEmpty())
+    HoverCache &cache = d->m_hoverCache;
+    if(epsOk && cache.matches(viewport))
     {
-        return nullptr;
-    }
+        // eps follows the cursor a little, its change counts like a move
+        const double epsChange = qAbs(eps - cache.eps);
+        if(radianDistance(clickedPoint, cache.point) + epsChange <= cache.radius)
+        {
+            qDebug() << "GeometryLayer::whichFeatureAt cached" << timer.nsecsElapsed();
 
-    const int numThreads = qMax(d->m_threadPool.maxThreadCount(), 2);
-    const int yStep = qCeil(static_cast<double>(items.size()) / numThreads);
-    QList<FindFeatureRunnable *> jobs;
-    qDebug() << "whichFeatureAt starting job" << yStep << numThreads;
+            return cache.feature;
+        }
 
-    for ( int i = 0; i < numThreads; ++i )
-    {
-        QList< GeoGraphicsItemPtr > tempItems = items.mid(i*yStep, i == numThreads -1 ? -1 : yStep);
-        if(tempItems.size() == 0)
+        const double cutoff = cache.margin - radianDistance(clickedPoint, cache.center);
+        if(cutoff >= HOVER_CUTOFF_FACTOR * eps)
         {
-            continue;
-        }
+            QVector<double> distancesSqr;
+            cache.feature = d->findFeature(cache.candidates, clickedPoint, epsSqr, cutoff, distancesSqr);
+            cache.point = clickedPoint;
+            cache.eps = eps;
+            cache.radius = hoverRadius(distancesSqr, eps, cutoff);
 
-        FindFeatureRunnable *job = new FindFeatureRunnable( tempItems, clickedPoint, epsSqr, eps );
+            qDebug() << "GeometryLayer::whichFeatureAt candidates" << timer.nsecsElapsed() << cache.candidates.size();
 
-        qDebug() << "whichFeatureAt starting job" << tempItems.size();
+            return cache.feature;
+        }
+    }
 
+    const GeoDataFeature *pickedFeature = nullptr;
+    if(epsOk && d->pickFeature(clickedPoint, eps, epsSqr, pickedFeature))
+    {
+        qDebug() << "GeometryLayer::whichFeatureAt picked" << timer.nsecsElapsed();
 
-        job->setAutoDelete(false);
-        jobs.append(job);
-        d->m_threadPool.start( job );
+        return pickedFeature;
     }
 
-    d->m_threadPool.waitForDone();
+    cache.clear();
 
-    const GeoDataFeature* feature = 0;
-    double prevDistSqr = 1.0e10;
-    foreach(auto job, jobs)
+    if(epsOk)
     {
-        double tempDistSqr = job->prevDistSqr();
-        const Marble::GeoDataFeature* tempFeature = job->feature();
-        if ( tempFeature &&
-             tempDistSqr < epsSqr &&
-             (tempDistSqr < prevDistSqr || (feature &&
-                                                  (tempFeature->zLevel() > feature->zLevel()) &&
-                                                  (qFuzzyCompare(tempDistSqr, prevDistSqr) ||
-                                                   (!qFuzzyIsNull(tempDistSqr) && !qFuzzyIsNull(prevDistSqr) && tempDistSqr/prevDistSqr < MAX_SQR_DIFF_FOR_HIGHER_Z_LEVEL)))))
-        {
-            prevDistSqr = tempDistSqr;
-            feature = tempFeature;
-        }
-
-        delete job;
+        box = hoverBox(clickedPoint, HOVER_MARGIN_FACTOR * eps);
     }
 
-    d->m_previousFeature = feature;
-    d->m_previousFeatureCoorinate = clickedPoint;
-    d->m_previousViewport = viewport;
+    QList< GeoGraphicsItemPtr > items = d->m_scene.items(box);
+
+    qWarning() << "whichFeatureAt elapsed getting items" << timer.nsecsElapsed() << items.size();
+
+    const double cutoff = epsOk ? HOVER_MARGIN_FACTOR * eps : eps;
+    QVector<double> distancesSqr;
+    const GeoDataFeature *feature = d->findFeature(items, clickedPoint, epsSqr, cutoff, distancesSqr);
+
+    if(epsOk)
+    {
+        cache.setViewport(viewport);
+        cache.candidates = items;
+        cache.center = clickedPoint;
+        cache.margin = cutoff;
+        cache.point = clickedPoint;
+        cache.eps = eps;
+        cache.radius = hoverRadius(distancesSqr, eps, cutoff);
+        cache.feature = feature;
+    }
 
     qDebug() << "GeometryLayer::whichFeatureAt elapsed" << timer.nsecsElapsed();
 
@@ -972,7 +1306,7 @@ void GeometryLayer::radiusChanged(int radius)
     d->m_radius = radius;
 }
 
-void GeometryLayer::updateTile(const TileId &tileId, const QImage &image)
+void GeometryLayer::updateTile(const TileId &tileId, const SparseTileImage &image)
 {
     if ( image.isNull() )
         return; // keep tiles in cache to improve performance
@@ -986,13 +1320,41 @@ void GeometryLayer::updateTile(const TileId &tileId, const QImage &image)
     }
 }
 
-void GeometryLayer::updateTileStatus(const TileMap &tiles)
+void GeometryLayer::clearHoverCache()
+{
+    d->m_hoverCache.clear();
+}
+
+void GeometryLayer::updateTileStatus(const LayeredTileCoverage &tiles)
 {
     d->m_loader.setTileExpired(d->m_tileDataset, tiles);
-    d->m_tileLoader.clear();
+
+    // The stacked tiles carry no z levels, any changed level expires them.
+    TileCoverage allTiles;
+    allTiles.unite(tiles.values().toVector());
+
+    // Displayed tiles stay until their new image arrives, tiles the vector loader doesn't render again are requested here.
+    foreach(const TileId &tileId, d->m_tileLoader.setTileExpired(allTiles))
+    {
+        if(d->m_loader.tileStatus(d->m_tileDataset, tileId) != VectorTileLoader::TileStatus::Expired)
+        {
+            d->m_loader.createTile(d->m_tileDataset, tileId, DownloadUsage::DownloadBulk);
+        }
+    }
+
     d->requestDelayedRepaint();
 }
 
+int GeometryLayer::tileInvalidationInterval() const
+{
+    return d->m_invalidationQueue.interval();
+}
+
+void GeometryLayer::setTileInvalidationInterval(int msec)
+{
+    d->m_invalidationQueue.setInterval(msec);
+}
+
 void GeometryLayer::startGenerateNextLevel()
 {
     foreach(const TileId &tileId, d->m_generateNextLevelTiles)
@@ -15,7 +15,9 @@
 
 #include <QObject>
 #include <QModelIndex>
+#include <QSize>
 #include "LayerInterface.h"
+#include "SparseTileImage.h"
 #include "geodata/data/GeoDataCoordinates.h"
 #include "graphicsview/GeoGraphicsItem.h"
 
@@ -53,6 +55,27 @@ public:
     void
     setProjection(Projection projection);
 
+    QSize
+    tileSize() const;
+
+    /**
+     * Sets the size of the rendered geometry tiles. Smaller tiles are expired
+     * and rendered at a finer granularity, larger ones carry less per tile
+     * overhead. Changing the size drops all rendered tiles.
+     */
+    void
+    setTileSize(const QSize &size);
+
+    int
+    tileInvalidationInterval() const;
+
+    /**
+     * Sets how long in milliseconds changes of the scene are collected
+     * before the tiles they touch are expired together.
+     */
+    void
+    setTileInvalidationInterval(int msec);
+
     
     QString
     runtimeTrace() const override;
@@ -116,10 +139,14 @@ Q_SIGNALS:
 
 private slots:
     void
-    updateTile(const TileId &tileId, const QImage &image);
+    updateTile(const TileId &tileId, const SparseTileImage &image);
+
+    void
+    updateTileStatus(const LayeredTileCoverage &tiles);
 
+    /// Drops the remembered hover result once the scene changed.
     void
-    updateTileStatus(const TileMap &tiles);
+    clearHoverCache();
 
     void
     startGenerateNextLevel();
@@ -380,6 +380,9 @@ bool AzimuthalProjectionPrivate::lineStringToPolygon( const GeoDataLineString &l
 
     while(itCoords < lineString.size())
     {
+        if ( itCoords % ViewportParams::CancelCheckInterval == 0 && viewport->isCancelled() ) {
+            return false;
+        }
 
         double lon1;
         double lat1;
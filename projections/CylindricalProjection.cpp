@@ -295,6 +295,11 @@ bool CylindricalProjectionPrivate::lineStringToPolygon( const GeoDataLineString
 
     while(itCoords < lineString.size())
     {
+        // Whatever was projected so far is dropped together with the cancelled render.
+        if ( itCoords % ViewportParams::CancelCheckInterval == 0 && viewport->isCancelled() ) {
+            return false;
+        }
+
         GeoDataCoordinates previousCoords = lineString.at(itPreviousCoords);
         GeoDataCoordinates coords = lineString.at(itCoords);
 